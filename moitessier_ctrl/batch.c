@@ -0,0 +1,173 @@
+/*
+    Batch mode of the Moitessier HAT control program (see batch.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "batch.h"
+
+#define BATCH_MAX_LINE              1024
+#define BATCH_MAX_ARGS              16
+#define BATCH_CONFIG_CACHE          4       /* number of configuration files kept parsed */
+
+/* configuration files are parsed only once per batch unless they change */
+struct st_configCache{
+    char                path[BATCH_MAX_LINE];
+    struct timespec     mtime;
+    off_t               size;
+    struct st_configHAT config;
+    bool                used;
+};
+
+static const struct st_configHAT* config_cached(struct st_configCache *cache, const char *path)
+{
+    struct stat st;
+    struct st_configCache *slot = NULL;
+    int i;
+
+    if(stat(path, &st) != 0)
+    {
+        printf("ERROR: could not open file \"%s\"\n", path);
+        return NULL;
+    }
+
+    for(i = 0; i < BATCH_CONFIG_CACHE; i++)
+    {
+        if(cache[i].used && !strcmp(cache[i].path, path))
+        {
+            if(cache[i].size == st.st_size && cache[i].mtime.tv_sec == st.st_mtim.tv_sec && cache[i].mtime.tv_nsec == st.st_mtim.tv_nsec)
+                return &cache[i].config;
+            slot = &cache[i];
+            break;
+        }
+        if(!slot && !cache[i].used)
+            slot = &cache[i];
+    }
+    if(!slot)
+        slot = &cache[0];
+
+    slot->used = false;
+    if(config_load_xml(path, &slot->config) != 0)
+        return NULL;
+    snprintf(slot->path, sizeof(slot->path), "%s", path);
+    slot->mtime = st.st_mtim;
+    slot->size = st.st_size;
+    slot->used = true;
+    return &slot->config;
+}
+
+int run_batch(int fd, const char *fileName)
+{
+    struct st_configCache cache[BATCH_CONFIG_CACHE];
+    const struct st_configHAT *configHAT;
+    char line[BATCH_MAX_LINE];
+    char *args[BATCH_MAX_ARGS];
+    char *save;
+    char *endp;
+    FILE *fp;
+    int nargs;
+    int cmd;
+    int rc = 0;
+    int result;
+    uint32_t lineNr = 0;
+    uint32_t executed = 0;
+    uint64_t start;
+    uint64_t t0;
+    uint64_t t1;
+
+    if(!fileName || !strcmp(fileName, "-"))
+        fp = stdin;
+    else if(!(fp = fopen(fileName, "r")))
+    {
+        printf("ERROR: could not open file \"%s\"\n", fileName);
+        return -1;
+    }
+
+    memset(cache, 0, sizeof(cache));
+    start = time_now_ns();
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        lineNr++;
+        nargs = 0;
+        for(args[nargs] = strtok_r(line, " \t\r\n", &save); args[nargs] && nargs < BATCH_MAX_ARGS - 1; args[nargs] = strtok_r(NULL, " \t\r\n", &save))
+            nargs++;
+        if(nargs == 0 || args[0][0] == '#')
+            continue;
+
+        t0 = time_now_ns();
+        if(!strcmp(args[0], "wait"))
+        {
+            if(nargs < 2)
+            {
+                printf("[batch] line %u: wait needs a time [ms]\n", lineNr);
+                rc = -1;
+                break;
+            }
+            sleep_until_ns(t0 + (uint64_t)atoi(args[1]) * 1000000ULL);
+            printf("[batch] line %u: wait %s ms\n", lineNr, args[1]);
+            continue;
+        }
+
+        cmd = strtol(args[0], &endp, 10);
+        if(*endp || cmd < 0 || cmd >= IOCTL_CMDs)
+        {
+            printf("[batch] line %u: command \"%s\" not supported\n", lineNr, args[0]);
+            rc = -1;
+            break;
+        }
+
+        configHAT = NULL;
+        if(cmd == 5)
+        {
+            if(nargs < 2)
+            {
+                printf("[batch] line %u: missing configuration file\n", lineNr);
+                rc = -1;
+                break;
+            }
+            if(!(configHAT = config_cached(cache, args[1])))
+                result = -1;
+        }
+
+        if(cmd != 5 || configHAT)
+            result = execute_ioctl_cmd(fd, cmd, nargs - 1, args + 1, configHAT);
+        t1 = time_now_ns();
+        executed++;
+
+        printf("[batch] line %u: cmd %d %s, result %d, %.3f ms\n", lineNr, cmd, (result < 0) ? "FAILED" : "ok", result, (double)(t1 - t0) / 1e6);
+        fflush(stdout);
+        if(result < 0)
+        {
+            rc = -1;
+            break;
+        }
+    }
+
+    printf("[batch] %u commands executed in %.3f ms%s\n", executed, (double)(time_now_ns() - start) / 1e6, rc ? ", stopped at first error" : "");
+    if(fp != stdin)
+        fclose(fp);
+    return rc;
+}
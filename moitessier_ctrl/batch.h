@@ -0,0 +1,36 @@
+/*
+    Batch mode of the Moitessier HAT control program. Executes a list of
+    commands over a single open control device.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+/* Reads commands from fileName (stdin if NULL or "-"), one per line:
+
+       <CMD_NR> <PARAM> ... <PARAM>     same numbering as on the command line (0...7)
+       wait <MS>                        pause before the next command
+       # comment
+
+   Every command is executed over the same file descriptor and its result and
+   latency are reported. Execution stops at the first failing command.
+   Returns 0 if all commands succeeded, else -1. */
+int run_batch(int fd, const char *fileName);
+
+#endif /* BATCH_H */
@@ -0,0 +1,172 @@
+/*
+    IOCTL latency benchmark of the Moitessier HAT control program (see
+    bench.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include "moitessier_ctrl.h"
+#include "bench.h"
+
+static const int ioctlCmds[IOCTL_CMDs] = {
+    IOCTL_GET_STATISTICS, IOCTL_GET_INFO, IOCTL_RESET_HAT, IOCTL_RESET_STATISTICS,
+    IOCTL_GNSS, IOCTL_CONFIG, IOCTL_ID_EEPROM, IOCTL_GNSS_MSG_CONFIG
+};
+
+static const char *cmdNames[IOCTL_CMDs] = {
+    "GET_STATISTICS", "GET_INFO", "RESET_HAT", "RESET_STATISTICS",
+    "GNSS", "CONFIG", "ID_EEPROM", "GNSS_MSG_CONFIG"
+};
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+/* nearest rank percentile of sorted samples */
+static double percentile_us(const uint64_t *sorted, uint32_t n, double p)
+{
+    uint32_t rank = (uint32_t)(p / 100.0 * n + 0.999999);
+
+    if(rank < 1)
+        rank = 1;
+    if(rank > n)
+        rank = n;
+    return sorted[rank - 1] / 1000.0;
+}
+
+/* parameter buffer of a command, 5 and 6 leave the HAT as it was, 4 and 7
+   enable GNSS and all NMEA messages, their state cannot be read back */
+static void prepare_buffer(int cmd, unsigned char *buf, const struct st_info *info)
+{
+    struct st_configHAT configHAT;
+    int i;
+
+    memset(buf, 0, IOCTL_BUF_SIZE);
+    switch(cmd)
+    {
+        case 4:
+            buf[0] = 1;
+            break;
+        case 5:
+            memset(&configHAT, 0, sizeof(configHAT));
+            for(i = 0; i < NUM_RCV; i++)
+                configHAT.rcv[i] = info->rcv[i].config;
+            configHAT.simulator = info->simulator;
+            configHAT.wpEEPROM = info->wpEEPROM;
+            memcpy(buf, &configHAT, sizeof(configHAT));
+            break;
+        case 6:
+            buf[0] = info->wpEEPROM;
+            break;
+        case 7:
+            buf[0] = 255;
+            break;
+        default:
+            break;
+    }
+}
+
+int run_ioctl_bench(int fd, uint32_t iterations, const char *cmdList)
+{
+    unsigned char buf[IOCTL_BUF_SIZE];
+    bool selected[IOCTL_CMDs];
+    struct st_info info;
+    uint64_t *samples;
+    uint64_t sum;
+    uint64_t t0;
+    uint32_t errors;
+    uint32_t i;
+    const char *p;
+    char *end;
+    long cmd;
+
+    if(iterations == 0)
+    {
+        printf("ERROR: number of iterations must be greater than 0\n");
+        return -1;
+    }
+
+    memset(selected, 0, sizeof(selected));
+    for(p = cmdList; *p; p = (*end == ',') ? end + 1 : end)
+    {
+        cmd = strtol(p, &end, 10);
+        if(end == p || cmd < 0 || cmd >= IOCTL_CMDs || (*end != ',' && *end != '\0'))
+        {
+            printf("ERROR: invalid command list \"%s\"\n", cmdList);
+            return -1;
+        }
+        selected[cmd] = true;
+    }
+
+    if(hat_get_info(fd, &info) != 0)
+    {
+        printf("ERROR: reading info failed\n");
+        return -1;
+    }
+
+    samples = malloc(iterations * sizeof(uint64_t));
+    if(samples == NULL)
+    {
+        printf("ERROR: out of memory\n");
+        return -1;
+    }
+
+    printf("%-18s %9s %9s %9s %9s %9s %9s %9s %9s %7s\n",
+           "command", "calls", "min/us", "p50/us", "p90/us", "p99/us", "p99.9/us", "max/us", "mean/us", "errors");
+    for(cmd = 0; cmd < IOCTL_CMDs; cmd++)
+    {
+        if(!selected[cmd])
+            continue;
+
+        sum = 0;
+        errors = 0;
+        for(i = 0; i < iterations; i++)
+        {
+            /* the buffer setup is part of the round trip, hat.c does the same */
+            t0 = time_now_ns();
+            prepare_buffer(cmd, buf, &info);
+            if(ioctl(fd, ioctlCmds[cmd], &buf) < 0)
+                errors++;
+            samples[i] = time_now_ns() - t0;
+            sum += samples[i];
+        }
+
+        qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+        printf("%-18s %9u %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %7u\n",
+               cmdNames[cmd], iterations,
+               samples[0] / 1000.0,
+               percentile_us(samples, iterations, 50.0),
+               percentile_us(samples, iterations, 90.0),
+               percentile_us(samples, iterations, 99.0),
+               percentile_us(samples, iterations, 99.9),
+               samples[iterations - 1] / 1000.0,
+               (double)sum / iterations / 1000.0,
+               errors);
+        fflush(stdout);
+    }
+
+    free(samples);
+    return 0;
+}
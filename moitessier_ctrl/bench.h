@@ -0,0 +1,36 @@
+/*
+    IOCTL latency benchmark of the Moitessier HAT control program.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#define BENCH_DEFAULT_CMDS          "0,1"
+
+/* Issues every IOCTL command of cmdList (comma separated, 0...7) iterations
+   times and prints the round trip latency percentiles per command. Commands
+   5 and 6 re-apply the configuration read before the benchmark. The GNSS state
+   and the NMEA message mask cannot be read back, so command 4 leaves GNSS
+   enabled and command 7 enables all NMEA messages. Command 2 really resets
+   the HAT. */
+int run_ioctl_bench(int fd, uint32_t iterations, const char *cmdList);
+
+#endif /* BENCH_H */
@@ -0,0 +1,237 @@
+/*
+    TCXO/AFC calibration of the Moitessier HAT control program (see calib.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "calib.h"
+
+#define GOLDEN      0.6180339887
+
+struct st_calibStep{
+    int32_t     tcxoOffset;     /* [Hz] relative to the original tcxoFreq */
+    uint32_t    afcRange;
+    double      payloadRate;    /* [B/s] */
+    double      crcRate;        /* [1/s] */
+    double      score;
+};
+
+struct st_calib{
+    int                     fd;
+    const struct st_calibParams *params;
+    struct st_configHAT     original;
+    struct st_calibStep     steps[CALIB_MAX_STEPS];
+    int                     numSteps;
+    int                     best;
+};
+
+static uint64_t counter_delta(uint64_t now, uint64_t before)
+{
+    /* the statistics have been reset in between */
+    return (now >= before) ? now - before : now;
+}
+
+/* applies one candidate to both receivers and scores it, returns -1 on error or stop request */
+static int evaluate(struct st_calib *c, int32_t tcxoOffset, uint32_t afcRange, double *score)
+{
+    struct st_configHAT cfg = c->original;
+    struct st_statistics s1;
+    struct st_statistics s2;
+    struct st_calibStep *step;
+    uint64_t t1;
+    uint64_t t2;
+    double dt;
+    int i;
+
+    /* the golden section search may ask for the same integer point again */
+    for(i = 0; i < c->numSteps; i++)
+    {
+        if(c->steps[i].tcxoOffset == tcxoOffset && c->steps[i].afcRange == afcRange)
+        {
+            *score = c->steps[i].score;
+            return 0;
+        }
+    }
+    if(c->numSteps == CALIB_MAX_STEPS)
+    {
+        printf("ERROR: too many calibration steps\n");
+        return -1;
+    }
+
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        cfg.rcv[i].tcxoFreq = (uint32_t)((int64_t)c->original.rcv[i].tcxoFreq + tcxoOffset);
+        cfg.rcv[i].afcRange = afcRange;
+    }
+    if(hat_config(c->fd, &cfg) != 0)
+    {
+        printf("ERROR: configuring HAT failed\n");
+        return -1;
+    }
+
+    if(sleep_until_ns(time_now_ns() + CALIB_SETTLE_MS * 1000000ULL) != 0 || stopRequested)
+        return -1;
+    if(hat_get_statistics(c->fd, &s1) != 0)
+        goto error;
+    t1 = time_now_ns();
+    if(sleep_until_ns(t1 + (uint64_t)c->params->dwellMs * 1000000ULL) != 0 || stopRequested)
+        return -1;
+    if(hat_get_statistics(c->fd, &s2) != 0)
+        goto error;
+    t2 = time_now_ns();
+
+    dt = (double)(t2 - t1) / 1e9;
+    step = &c->steps[c->numSteps];
+    step->tcxoOffset = tcxoOffset;
+    step->afcRange = afcRange;
+    step->payloadRate = counter_delta(s2.totalRxPayloadBytes, s1.totalRxPayloadBytes) / dt;
+    step->crcRate = (counter_delta(s2.payloadCrcErrors, s1.payloadCrcErrors) +
+                     counter_delta(s2.headerCrcErrors, s1.headerCrcErrors)) / dt;
+    step->score = step->payloadRate - CALIB_CRC_PENALTY * step->crcRate;
+    if(c->best < 0 || step->score > c->steps[c->best].score)
+        c->best = c->numSteps;
+
+    printf("%4d %10u %+8d %9u %14.1f %12.3f %12.1f\n", c->numSteps + 1,
+           (unsigned int)cfg.rcv[0].tcxoFreq, (int)tcxoOffset, (unsigned int)afcRange,
+           step->payloadRate, step->crcRate, step->score);
+    fflush(stdout);
+
+    c->numSteps++;
+    *score = step->score;
+    return 0;
+
+error:
+    printf("ERROR: reading statistics failed\n");
+    return -1;
+}
+
+/* evaluates x as tcxoFreq offset or afcRange, the other parameter is fixed */
+static int evaluate_at(struct st_calib *c, bool searchTcxo, double x, int32_t tcxoOffset, uint32_t afcRange, double *score)
+{
+    if(searchTcxo)
+        return evaluate(c, (int32_t)lround(x), afcRange, score);
+    return evaluate(c, tcxoOffset, (uint32_t)lround(x), score);
+}
+
+/* Golden section search for the maximum of the score over [lo, hi], one of
+   the two parameters is searched while the other one is fixed. */
+static int search(struct st_calib *c, bool searchTcxo, double lo, double hi, double resolution,
+                  int32_t tcxoOffset, uint32_t afcRange)
+{
+    double x1 = hi - GOLDEN * (hi - lo);
+    double x2 = lo + GOLDEN * (hi - lo);
+    double f1;
+    double f2;
+
+    if(evaluate_at(c, searchTcxo, x1, tcxoOffset, afcRange, &f1) != 0 ||
+       evaluate_at(c, searchTcxo, x2, tcxoOffset, afcRange, &f2) != 0)
+        return -1;
+    while(hi - lo > resolution)
+    {
+        if(f1 > f2)
+        {
+            hi = x2;
+            x2 = x1;
+            f2 = f1;
+            x1 = hi - GOLDEN * (hi - lo);
+            if(evaluate_at(c, searchTcxo, x1, tcxoOffset, afcRange, &f1) != 0)
+                return -1;
+        }
+        else
+        {
+            lo = x1;
+            x1 = x2;
+            f1 = f2;
+            x2 = lo + GOLDEN * (hi - lo);
+            if(evaluate_at(c, searchTcxo, x2, tcxoOffset, afcRange, &f2) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int run_calibration(int fd, const struct st_calibParams *params)
+{
+    static struct st_calib c;
+    struct st_configHAT cfg;
+    struct st_info info;
+    const struct st_calibStep *best;
+    double score;
+    int i;
+
+    if(params->dwellMs == 0 || params->tcxoResolutionHz == 0)
+    {
+        printf("ERROR: dwell time and resolution must be greater than 0\n");
+        return -1;
+    }
+
+    memset(&c, 0, sizeof(c));
+    c.fd = fd;
+    c.params = params;
+    c.best = -1;
+    if(hat_get_info(fd, &info) != 0 || !info.valid)
+    {
+        printf("ERROR: could not read the configuration of the HAT\n");
+        return -1;
+    }
+    config_from_info(&info, &c.original);
+
+    stop_on_signal();
+    printf("calibrating, dwell %u ms, tcxo offset +-%u Hz, resolution %u Hz\n",
+           params->dwellMs, params->tcxoRangeHz, params->tcxoResolutionHz);
+    printf("%4s %10s %8s %9s %14s %12s %12s\n", "step", "tcxoFreq", "offset", "afcRange", "payload [B/s]", "crc [1/s]", "score");
+
+    /* the running configuration is the reference every candidate has to beat */
+    if(evaluate(&c, 0, c.original.rcv[0].afcRange, &score) != 0)
+        goto stopped;
+    if(search(&c, true, -(double)params->tcxoRangeHz, (double)params->tcxoRangeHz, params->tcxoResolutionHz,
+              0, c.original.rcv[0].afcRange) != 0)
+        goto stopped;
+    if(search(&c, false, CALIB_AFC_MIN, CALIB_AFC_MAX, CALIB_AFC_RESOLUTION,
+              c.steps[c.best].tcxoOffset, c.original.rcv[0].afcRange) != 0)
+        goto stopped;
+
+    best = &c.steps[c.best];
+    cfg = c.original;
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        cfg.rcv[i].tcxoFreq = (uint32_t)((int64_t)c.original.rcv[i].tcxoFreq + best->tcxoOffset);
+        cfg.rcv[i].afcRange = best->afcRange;
+    }
+    if(hat_config(fd, &cfg) != 0)
+    {
+        printf("ERROR: configuring HAT failed\n");
+        return -1;
+    }
+    printf("best after %d dwells: tcxoFreq %u Hz (offset %+d Hz), afcRange %u Hz, score %.1f (reference %.1f)\n",
+           c.numSteps, (unsigned int)cfg.rcv[0].tcxoFreq, (int)best->tcxoOffset, (unsigned int)best->afcRange,
+           best->score, c.steps[0].score);
+    if(config_save_xml(params->outFile, &cfg) != 0)
+        return -1;
+    printf("configuration written to \"%s\"\n", params->outFile);
+    return 0;
+
+stopped:
+    printf("calibration aborted, restoring the original configuration\n");
+    hat_config(fd, &c.original);
+    return -1;
+}
@@ -0,0 +1,55 @@
+/*
+    TCXO/AFC calibration of the Moitessier HAT control program.
+
+    The HAT only reports statistics for both receivers together and both
+    receivers run from the same TCXO, so every candidate is applied to both
+    receivers and scored on the HAT wide counters during a dwell window:
+
+        score = (payload bytes - CALIB_CRC_PENALTY * CRC errors) / dwell time
+
+    The tcxoFreq offset and afterwards the afcRange are searched with a golden
+    section search, which needs one dwell per step and shrinks the interval by
+    0.618 each time.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+
+#define CALIB_CRC_PENALTY           50      /* [bytes] a CRC error costs about one AIS message */
+#define CALIB_SETTLE_MS             500     /* time for the receivers to lock after IOCTL_CONFIG */
+#define CALIB_AFC_MIN               500     /* [Hz] afcRange search interval */
+#define CALIB_AFC_MAX               3000
+#define CALIB_AFC_RESOLUTION        100
+#define CALIB_MAX_STEPS             64
+
+struct st_calibParams{
+    const char  *outFile;           /* config.xml written with the best values */
+    uint32_t    dwellMs;
+    uint32_t    tcxoRangeHz;        /* offsets -range...+range around the running tcxoFreq are searched */
+    uint32_t    tcxoResolutionHz;
+};
+
+/* Runs the calibration starting from the configuration the HAT is running.
+   The best configuration stays applied and is written to outFile. On
+   SIGINT/SIGTERM the original configuration is restored. */
+int run_calibration(int fd, const struct st_calibParams *params);
+
+#endif /* CALIB_H */
@@ -0,0 +1,178 @@
+/*
+    Receiver capacity benchmark of the Moitessier HAT control program (see
+    capacity.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "capacity.h"
+
+struct st_capacityStep{
+    double      payloadRate;        /* [B/s] */
+    double      overflowRate;       /* [1/s] */
+    double      crcRate;            /* [1/s] */
+};
+
+static uint64_t counter_delta(uint64_t now, uint64_t before)
+{
+    return (now >= before) ? now - before : now;
+}
+
+/* applies the simulator setting and measures one dwell, returns -1 on error or stop request */
+static int measure(int fd, const struct st_configHAT *base, bool enabled, uint32_t intervalMs, uint32_t dwellMs,
+                   struct st_capacityStep *step)
+{
+    struct st_configHAT cfg = *base;
+    struct st_statistics s1;
+    struct st_statistics s2;
+    uint64_t t1;
+    double dt;
+
+    cfg.simulator.enabled = enabled ? 1 : 0;
+    cfg.simulator.interval = intervalMs;
+    if(hat_config(fd, &cfg) != 0)
+    {
+        printf("ERROR: configuring HAT failed\n");
+        return -1;
+    }
+    if(sleep_until_ns(time_now_ns() + CAPACITY_SETTLE_MS * 1000000ULL) != 0 || stopRequested)
+        return -1;
+    if(hat_get_statistics(fd, &s1) != 0)
+        goto error;
+    t1 = time_now_ns();
+    if(sleep_until_ns(t1 + (uint64_t)dwellMs * 1000000ULL) != 0 || stopRequested)
+        return -1;
+    if(hat_get_statistics(fd, &s2) != 0)
+        goto error;
+
+    dt = (double)(time_now_ns() - t1) / 1e9;
+    step->payloadRate = counter_delta(s2.totalRxPayloadBytes, s1.totalRxPayloadBytes) / dt;
+    step->overflowRate = counter_delta(s2.fifoOverflows, s1.fifoOverflows) / dt;
+    step->crcRate = (counter_delta(s2.payloadCrcErrors, s1.payloadCrcErrors) +
+                     counter_delta(s2.headerCrcErrors, s1.headerCrcErrors)) / dt;
+    return 0;
+
+error:
+    printf("ERROR: reading statistics failed\n");
+    return -1;
+}
+
+/* one sweep from the slowest to the fastest interval */
+static int sweep(int fd, const struct st_configHAT *base, const struct st_capacityParams *params, bool gnss)
+{
+    struct st_capacityStep background;
+    struct st_capacityStep step;
+    double bytesPerReport = 0;
+    double offered;
+    double payload;
+    double loss;
+    double kneeOffered = 0;
+    double kneePayload = 0;
+    uint32_t kneeInterval = 0;
+    uint32_t interval;
+    uint32_t next;
+
+    if(hat_gnss(fd, gnss) != 0 || (gnss && hat_gnss_msg_config(fd, 0xFF) != 0))
+    {
+        printf("ERROR: changing GNSS output failed\n");
+        return -1;
+    }
+
+    /* real AIS traffic is not part of the simulator load */
+    if(measure(fd, base, false, base->simulator.interval, params->dwellMs, &background) != 0)
+        return -1;
+    printf("gnss %s, background: payload %.1f B/s, overflows %.3f 1/s, crc errors %.3f 1/s\n",
+           gnss ? "on" : "off", background.payloadRate, background.overflowRate, background.crcRate);
+    printf("%6s %13s %15s %14s %15s %10s %8s\n", "gnss", "interval [ms]", "offered [1/s]", "payload [B/s]", "overflows [1/s]", "crc [1/s]", "loss [%]");
+
+    for(interval = params->maxIntervalMs; interval >= params->minIntervalMs && interval > 0; interval = next)
+    {
+        if(measure(fd, base, true, interval, params->dwellMs, &step) != 0)
+            return -1;
+
+        offered = NUM_RCV_CHANNELS * 1000.0 / interval;
+        payload = step.payloadRate - background.payloadRate;
+        if(payload < 0)
+            payload = 0;
+        /* the slowest step defines the payload of one report */
+        if(bytesPerReport == 0)
+            bytesPerReport = payload / offered;
+        loss = (bytesPerReport > 0) ? 1.0 - payload / (offered * bytesPerReport) : 1.0;
+        if(loss < 0)
+            loss = 0;
+
+        printf("%6s %13u %15.1f %14.1f %15.3f %10.3f %8.1f\n", gnss ? "on" : "off", (unsigned int)interval, offered,
+               step.payloadRate, step.overflowRate, step.crcRate, loss * 100.0);
+        fflush(stdout);
+
+        if(loss < CAPACITY_KNEE_LOSS && step.overflowRate <= background.overflowRate)
+        {
+            kneeInterval = interval;
+            kneeOffered = offered;
+            kneePayload = payload;
+        }
+        if(loss > CAPACITY_ABORT_LOSS)
+            break;
+
+        next = (uint32_t)(interval * CAPACITY_STEP_RATIO);
+        if(next == interval)
+            next--;
+    }
+
+    if(kneeInterval)
+        printf("knee (gnss %s): interval %u ms, %.1f reports/s, %.1f B/s\n\n", gnss ? "on" : "off",
+               (unsigned int)kneeInterval, kneeOffered, kneePayload);
+    else
+        printf("knee (gnss %s): not found, already the slowest step loses reports\n\n", gnss ? "on" : "off");
+    return 0;
+}
+
+int run_capacity(int fd, const struct st_capacityParams *params)
+{
+    struct st_configHAT original;
+    struct st_info info;
+    int rc;
+
+    if(params->dwellMs == 0 || params->minIntervalMs == 0 || params->minIntervalMs > params->maxIntervalMs)
+    {
+        printf("ERROR: invalid sweep parameters\n");
+        return -1;
+    }
+    if(hat_get_info(fd, &info) != 0 || !info.valid)
+    {
+        printf("ERROR: could not read the configuration of the HAT\n");
+        return -1;
+    }
+    config_from_info(&info, &original);
+
+    stop_on_signal();
+    printf("capacity sweep %u...%u ms, dwell %u ms\n", params->maxIntervalMs, params->minIntervalMs, params->dwellMs);
+    rc = sweep(fd, &original, params, false);
+    if(rc == 0)
+        rc = sweep(fd, &original, params, true);
+    if(rc != 0)
+        printf("capacity sweep aborted\n");
+
+    hat_config(fd, &original);
+    hat_gnss(fd, true);
+    hat_gnss_msg_config(fd, 0xFF);
+    return rc;
+}
@@ -0,0 +1,48 @@
+/*
+    Receiver capacity benchmark of the Moitessier HAT control program.
+
+    The built-in AIS simulator generates position reports for two MMSIs every
+    simulator.interval. The benchmark sweeps the interval from slow to fast,
+    first with GNSS off, then with all GNSS sentences enabled, and measures
+    the payload rate, FIFO overflows and CRC errors at every step. The loss
+    is estimated from the payload per report measured at the slowest step,
+    the knee is the fastest step that still loses less than CAPACITY_KNEE_LOSS.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CAPACITY_H
+#define CAPACITY_H
+
+#include <stdint.h>
+
+#define CAPACITY_STEP_RATIO         0.7     /* interval of the next step */
+#define CAPACITY_KNEE_LOSS          0.05
+#define CAPACITY_ABORT_LOSS         0.5     /* faster steps are skipped once the loss is that high */
+#define CAPACITY_SETTLE_MS          1000
+
+struct st_capacityParams{
+    uint32_t    maxIntervalMs;      /* slowest step */
+    uint32_t    minIntervalMs;      /* fastest step */
+    uint32_t    dwellMs;
+};
+
+/* Runs the sweep and restores the configuration of the HAT afterwards. GNSS
+   is left enabled with all sentences, its previous state cannot be read. */
+int run_capacity(int fd, const struct st_capacityParams *params);
+
+#endif /* CAPACITY_H */
@@ -0,0 +1,486 @@
+/*
+    Loading and printing of the HAT configuration (config.xml).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "config_bind.h"
+#include "ezxml/ezxml.h"
+
+int config_load_xml(const char *fileName, struct st_configHAT *configHAT)
+{
+    struct stat st;
+    char *data;
+    size_t len = 0;
+    ssize_t n;
+    int fd;
+    int rc;
+
+    fd = open(fileName, O_RDONLY);
+    if(fd < 0)
+    {
+        printf("ERROR: could not open file \"%s\"\n", fileName);
+        return -1;
+    }
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        printf("ERROR: could not read file \"%s\"\n", fileName);
+        close(fd);
+        return -1;
+    }
+
+    /* read into memory rather than mapped, a file truncated by an editor while
+       it is scanned must not kill the resident or batch mode with SIGBUS */
+    data = malloc(st.st_size ? st.st_size : 1);
+    if(!data)
+    {
+        printf("ERROR: out of memory\n");
+        close(fd);
+        return -1;
+    }
+    while(len < (size_t)st.st_size && (n = read(fd, data + len, st.st_size - len)) != 0)
+    {
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+        {
+            printf("ERROR: could not read file \"%s\"\n", fileName);
+            free(data);
+            close(fd);
+            return -1;
+        }
+        len += n;
+    }
+    close(fd);
+
+    rc = config_bind_xml(fileName, data, len, configHAT);
+    free(data);
+    return rc;
+}
+
+void config_print(const struct st_configHAT *configHAT)
+{
+    uint32_t i;
+
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        printf("receiver %u\n", i + 1);
+        printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)configHAT->rcv[i].channelFreq[0]);
+        printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)configHAT->rcv[i].channelFreq[1]);
+        printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)configHAT->rcv[i].tcxoFreq);
+        printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)configHAT->rcv[i].metaDataMask);
+        printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)configHAT->rcv[i].afcRange);
+    }
+    printf("simulator\n");
+    printf("\tenabled:\t\t\t %u\n", (unsigned int)configHAT->simulator.enabled);
+    printf("\tinterval:\t\t\t %u\n", (unsigned int)configHAT->simulator.interval);
+    printf("\tmmsi:\t\t\t\t %09u %09u\n", (unsigned int)configHAT->simulator.mmsi[0], (unsigned int)configHAT->simulator.mmsi[1]);
+    printf("misc\n");
+    printf("\twrite protection ID EEPROM:\t %u\n", (unsigned int)configHAT->wpEEPROM);
+}
+
+/* adds the sub tag name to parent, with the number value as text */
+static ezxml_t config_xml_value(ezxml_t parent, const char *name, uint32_t value)
+{
+    char buf[16];
+
+    snprintf(buf, sizeof(buf), "%u", (unsigned int)value);
+    return ezxml_set_txt_d(ezxml_add_child(parent, name, 0), buf);
+}
+
+/* puts every sub tag of xml on a line of its own, indented by four spaces per
+   depth, by setting the whitespace around them as character content of xml */
+static void config_xml_indent(ezxml_t xml, int depth)
+{
+    ezxml_t child;
+    size_t size;
+    size_t len = 0;
+    char *ws;
+
+    if(!xml->child)
+        return;
+    /* a new line and the indentation per sub tag and before the end tag */
+    size = 1 + depth * 4 + 1;   /* including the terminating 0 */
+    for(child = xml->child; child; child = child->ordered)
+        size += 1 + (depth + 1) * 4;
+    if((ws = malloc(size)) == NULL)
+        return;
+    for(child = xml->child; child; child = child->ordered)
+    {
+        len += snprintf(ws + len, size - len, "\n%*s", (depth + 1) * 4, "");
+        child->off = len;
+        config_xml_indent(child, depth + 1);
+    }
+    snprintf(ws + len, size - len, "\n%*s", depth * 4, "");
+    ezxml_set_txt_d(xml, ws);
+    free(ws);
+}
+
+/* builds the tree of config.xml in the layout of the file shipped with this program */
+static ezxml_t config_to_xml(const struct st_configHAT *configHAT)
+{
+    ezxml_t root;
+    ezxml_t rcv;
+    ezxml_t xml;
+    char name[16];
+    uint32_t i;
+
+    root = ezxml_new("config");
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        rcv = ezxml_add_child(root, "receiver", 0);
+        snprintf(name, sizeof(name), "receiver%u", i + 1);
+        ezxml_set_attr_d(rcv, "name", name);
+        xml = ezxml_add_child(rcv, "channelFreq", 0);
+        config_xml_value(xml, "freq", configHAT->rcv[i].channelFreq[0]);
+        config_xml_value(xml, "freq", configHAT->rcv[i].channelFreq[1]);
+        config_xml_value(rcv, "metamask", configHAT->rcv[i].metaDataMask);
+        config_xml_value(rcv, "afcRange", configHAT->rcv[i].afcRange);
+        config_xml_value(rcv, "tcxoFreq", configHAT->rcv[i].tcxoFreq);
+    }
+    xml = ezxml_add_child(root, "simulator", 0);
+    config_xml_value(xml, "enabled", configHAT->simulator.enabled);
+    config_xml_value(xml, "interval", configHAT->simulator.interval);
+    xml = ezxml_add_child(xml, "mmsi", 0);
+    config_xml_value(xml, "id", configHAT->simulator.mmsi[0]);
+    config_xml_value(xml, "id", configHAT->simulator.mmsi[1]);
+    xml = ezxml_add_child(root, "misc", 0);
+    config_xml_value(xml, "eepromWpEnabled", configHAT->wpEEPROM);
+
+    config_xml_indent(root, 0);
+    return root;
+}
+
+int config_write_xml(int fd, const struct st_configHAT *configHAT)
+{
+    static const char head[] = "<?xml version=\"1.0\"?>\n";
+    ezxml_t root;
+    int rc;
+
+    root = config_to_xml(configHAT);
+    rc = (write(fd, head, sizeof(head) - 1) == sizeof(head) - 1 &&
+          ezxml_toxml_fd(root, fd) == 0 && write(fd, "\n", 1) == 1) ? 0 : -1;
+    ezxml_free(root);
+    return rc;
+}
+
+int config_save_xml(const char *fileName, const struct st_configHAT *configHAT)
+{
+    int fd;
+    int rc;
+
+    fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0)
+    {
+        printf("ERROR: could not create file \"%s\": %s\n", fileName, strerror(errno));
+        return -1;
+    }
+    rc = config_write_xml(fd, configHAT);
+    if(close(fd) != 0 || rc != 0)
+    {
+        printf("ERROR: could not write file \"%s\"\n", fileName);
+        return -1;
+    }
+    return 0;
+}
+
+int config_dump(int fd, const char *fileName)
+{
+    struct st_info info;
+    struct st_configHAT configHAT;
+
+    if(hat_get_info(fd, &info) != 0 || !info.valid)
+    {
+        printf("ERROR: could not read the configuration of the HAT\n");
+        return -1;
+    }
+    config_from_info(&info, &configHAT);
+    if(fileName)
+        return config_save_xml(fileName, &configHAT);
+
+    fflush(stdout);
+    if(config_write_xml(STDOUT_FILENO, &configHAT) != 0)
+    {
+        printf("ERROR: could not write the configuration: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* the configuration the HAT is running, as reported by IOCTL_GET_INFO */
+void config_from_info(const struct st_info *info, struct st_configHAT *configHAT)
+{
+    uint32_t i;
+
+    memset(configHAT, 0, sizeof(struct st_configHAT));
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        configHAT->rcv[i] = info->rcv[i].config;
+        configHAT->rcv[i].afcRangeDefault = 0;
+    }
+    configHAT->simulator = info->simulator;
+    configHAT->wpEEPROM = info->wpEEPROM;
+}
+
+/* CRC-32 (IEEE 802.3) */
+static uint32_t crc32(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc = 0xFFFFFFFF;
+    int k;
+
+    while(len--)
+    {
+        crc ^= *p++;
+        for(k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+int config_save_blob(const char *fileName, const struct st_configHAT *configHAT)
+{
+    struct st_configBlob blob;
+    FILE *fp;
+    uint32_t i;
+    uint32_t k;
+
+    /* zero the padding, so equal configurations give identical files */
+    memset(&blob, 0, sizeof(blob));
+    blob.magic = CONFIG_BLOB_MAGIC;
+    blob.version = CONFIG_BLOB_VERSION;
+    blob.size = sizeof(struct st_configHAT);
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        blob.config.rcv[i].metaDataMask = configHAT->rcv[i].metaDataMask;
+        blob.config.rcv[i].afcRange = configHAT->rcv[i].afcRange;
+        blob.config.rcv[i].afcRangeDefault = configHAT->rcv[i].afcRangeDefault;
+        blob.config.rcv[i].tcxoFreq = configHAT->rcv[i].tcxoFreq;
+        for(k = 0; k < NUM_RCV_CHANNELS; k++)
+            blob.config.rcv[i].channelFreq[k] = configHAT->rcv[i].channelFreq[k];
+    }
+    blob.config.simulator = configHAT->simulator;
+    blob.config.wpEEPROM = configHAT->wpEEPROM;
+    blob.crc = crc32(&blob.config, sizeof(blob.config));
+
+    fp = fopen(fileName, "wb");
+    if(!fp)
+    {
+        printf("ERROR: could not create file \"%s\": %s\n", fileName, strerror(errno));
+        return -1;
+    }
+    if(fwrite(&blob, sizeof(blob), 1, fp) != 1)
+    {
+        printf("ERROR: could not write file \"%s\": %s\n", fileName, strerror(errno));
+        fclose(fp);
+        return -1;
+    }
+    if(fclose(fp) != 0)
+        return -1;
+    return 0;
+}
+
+int config_load_blob(const char *fileName, struct st_configHAT *configHAT)
+{
+    struct st_configBlob blob;
+    FILE *fp;
+    size_t len;
+
+    fp = fopen(fileName, "rb");
+    if(!fp)
+    {
+        printf("ERROR: could not open file \"%s\"\n", fileName);
+        return -1;
+    }
+    len = fread(&blob, 1, sizeof(blob), fp);
+    fclose(fp);
+
+    if(len != sizeof(blob) || blob.magic != CONFIG_BLOB_MAGIC)
+    {
+        printf("ERROR: \"%s\" is not a configuration blob\n", fileName);
+        return -1;
+    }
+    if(blob.version != CONFIG_BLOB_VERSION || blob.size != sizeof(struct st_configHAT))
+    {
+        printf("ERROR: \"%s\" has version %u/size %u, expected %u/%u, recompile it\n", fileName,
+               (unsigned int)blob.version, (unsigned int)blob.size, CONFIG_BLOB_VERSION, (unsigned int)sizeof(struct st_configHAT));
+        return -1;
+    }
+    if(blob.crc != crc32(&blob.config, sizeof(blob.config)))
+    {
+        printf("ERROR: \"%s\" is corrupted (CRC mismatch)\n", fileName);
+        return -1;
+    }
+    *configHAT = blob.config;
+    return 0;
+}
+
+int config_load(const char *fileName, struct st_configHAT *configHAT)
+{
+    uint32_t magic = 0;
+    FILE *fp;
+
+    fp = fopen(fileName, "rb");
+    if(!fp)
+    {
+        printf("ERROR: could not open file \"%s\"\n", fileName);
+        return -1;
+    }
+    if(fread(&magic, sizeof(magic), 1, fp) != 1)
+        magic = 0;
+    fclose(fp);
+
+    if(magic == CONFIG_BLOB_MAGIC)
+        return config_load_blob(fileName, configHAT);
+    return config_load_xml(fileName, configHAT);
+}
+
+#define DIFF_FIELD(name, running, wanted) \
+    do{ \
+        if((running) != (wanted)) \
+        { \
+            if(verbose) \
+                printf("\t%s: %u -> %u\n", name, (unsigned int)(running), (unsigned int)(wanted)); \
+            diffs++; \
+        } \
+    }while(0)
+
+int config_diff(const struct st_info *info, const struct st_configHAT *configHAT, bool verbose)
+{
+    const struct st_receiverConfig *running;
+    const struct st_receiverConfig *wanted;
+    char name[64];
+    int diffs = 0;
+    uint32_t i;
+    uint32_t k;
+
+    /* afcRangeDefault is not used by the HAT and therefore not compared */
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        running = &info->rcv[i].config;
+        wanted = &configHAT->rcv[i];
+        for(k = 0; k < NUM_RCV_CHANNELS; k++)
+        {
+            snprintf(name, sizeof(name), "receiver %u channel frequency %u", i + 1, k + 1);
+            DIFF_FIELD(name, running->channelFreq[k], wanted->channelFreq[k]);
+        }
+        snprintf(name, sizeof(name), "receiver %u meta data mask", i + 1);
+        DIFF_FIELD(name, running->metaDataMask, wanted->metaDataMask);
+        snprintf(name, sizeof(name), "receiver %u afc range", i + 1);
+        DIFF_FIELD(name, running->afcRange, wanted->afcRange);
+        snprintf(name, sizeof(name), "receiver %u tcxo frequency", i + 1);
+        DIFF_FIELD(name, running->tcxoFreq, wanted->tcxoFreq);
+    }
+    DIFF_FIELD("simulator enabled", info->simulator.enabled, configHAT->simulator.enabled);
+    DIFF_FIELD("simulator interval", info->simulator.interval, configHAT->simulator.interval);
+    for(k = 0; k < NUM_RCV_CHANNELS; k++)
+    {
+        snprintf(name, sizeof(name), "simulator mmsi %u", k + 1);
+        DIFF_FIELD(name, info->simulator.mmsi[k], configHAT->simulator.mmsi[k]);
+    }
+    DIFF_FIELD("write protection ID EEPROM", info->wpEEPROM, configHAT->wpEEPROM);
+
+    return diffs;
+}
+
+int config_compare(const struct st_configHAT *applied, const struct st_configHAT *configHAT, bool verbose)
+{
+    struct st_info info;
+    uint32_t i;
+
+    memset(&info, 0, sizeof(info));
+    for(i = 0; i < NUM_RCV; i++)
+        info.rcv[i].config = applied->rcv[i];
+    info.simulator = applied->simulator;
+    info.wpEEPROM = applied->wpEEPROM;
+    return config_diff(&info, configHAT, verbose);
+}
+
+#define CHECK_RANGE(what, value, min, max) \
+    do{ \
+        if((value) < (min) || (value) > (max)) \
+        { \
+            printf("ERROR: %s %u out of range [%u, %u]\n", what, (unsigned int)(value), (unsigned int)(min), (unsigned int)(max)); \
+            errors++; \
+        } \
+    }while(0)
+
+int config_validate(const struct st_configHAT *configHAT)
+{
+    char name[64];
+    int errors = 0;
+    uint32_t i;
+    uint32_t k;
+
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        for(k = 0; k < NUM_RCV_CHANNELS; k++)
+        {
+            snprintf(name, sizeof(name), "receiver %u channel frequency %u", i + 1, k + 1);
+            CHECK_RANGE(name, configHAT->rcv[i].channelFreq[k], CONFIG_FREQ_MIN, CONFIG_FREQ_MAX);
+        }
+        snprintf(name, sizeof(name), "receiver %u afc range", i + 1);
+        CHECK_RANGE(name, configHAT->rcv[i].afcRange, CONFIG_AFC_MIN, CONFIG_AFC_MAX);
+        snprintf(name, sizeof(name), "receiver %u tcxo frequency", i + 1);
+        CHECK_RANGE(name, configHAT->rcv[i].tcxoFreq, CONFIG_TCXO_MIN, CONFIG_TCXO_MAX);
+    }
+    CHECK_RANGE("simulator enabled", configHAT->simulator.enabled, 0, 1);
+    if(configHAT->simulator.enabled)
+        CHECK_RANGE("simulator interval", configHAT->simulator.interval, 1, 0xFFFFFFFFu);
+    for(k = 0; k < NUM_RCV_CHANNELS; k++)
+    {
+        snprintf(name, sizeof(name), "simulator mmsi %u", k + 1);
+        CHECK_RANGE(name, configHAT->simulator.mmsi[k], 0, CONFIG_MMSI_MAX);
+    }
+    CHECK_RANGE("write protection ID EEPROM", configHAT->wpEEPROM, 0, 1);
+
+    return errors ? -1 : 0;
+}
+
+int config_push(int fd, const struct st_configHAT *configHAT, bool force)
+{
+    struct st_info info;
+
+    if(!force)
+    {
+        if(hat_get_info(fd, &info) != 0)
+        {
+            printf("ERROR: reading HAT info failed\n");
+            return -1;
+        }
+        /* without valid info we cannot tell what is running, so push */
+        if(info.valid && config_diff(&info, configHAT, true) == 0)
+            return 0;
+    }
+
+    if(hat_config(fd, configHAT) != 0)
+    {
+        printf("ERROR: configuring HAT failed\n");
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,79 @@
+/*
+    Loading and printing of the HAT configuration (config.xml).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "moitessier_ctrl.h"
+
+#define CONFIG_BLOB_MAGIC           0x4746434d      /* "MCFG" */
+#define CONFIG_BLOB_VERSION         1
+
+/* limits checked by config_validate() */
+#define CONFIG_FREQ_MIN             156000000       /* [Hz] maritime VHF band */
+#define CONFIG_FREQ_MAX             163000000
+#define CONFIG_TCXO_MIN             12987000        /* [Hz] 13 MHz +-1000 ppm */
+#define CONFIG_TCXO_MAX             13013000
+#define CONFIG_AFC_MIN              1               /* [Hz] */
+#define CONFIG_AFC_MAX              10000
+#define CONFIG_MMSI_MAX             999999999
+
+/* Binary configuration as written by command 11. The blob is stored in the
+   byte order of the machine that compiled it, the HAT is only used on
+   the Raspberry Pi, so there is no conversion. */
+struct st_configBlob{
+    uint32_t            magic;
+    uint16_t            version;
+    uint16_t            size;           /* sizeof(struct st_configHAT) */
+    uint32_t            crc;            /* CRC-32 of config */
+    struct st_configHAT config;
+};
+
+/* binds the given config.xml to configHAT (see config_bind.h), returns 0 on success, -1 on error */
+int config_load_xml(const char *fileName, struct st_configHAT *configHAT);
+int config_save_blob(const char *fileName, const struct st_configHAT *configHAT);
+int config_load_blob(const char *fileName, struct st_configHAT *configHAT);
+/* loads either a blob or a config.xml depending on the content of the file */
+int config_load(const char *fileName, struct st_configHAT *configHAT);
+void config_print(const struct st_configHAT *configHAT);
+/* writes configHAT as config.xml, returns 0 on success, -1 on error */
+int config_save_xml(const char *fileName, const struct st_configHAT *configHAT);
+/* same as config_save_xml() for an open file, nothing is printed, errno is set on error */
+int config_write_xml(int fd, const struct st_configHAT *configHAT);
+/* Writes the configuration the HAT is running (IOCTL_GET_INFO) as config.xml
+   to fileName, or to stdout if fileName is NULL. Returns 0 on success, -1 on error. */
+int config_dump(int fd, const char *fileName);
+void config_from_info(const struct st_info *info, struct st_configHAT *configHAT);
+
+/* Compares the configuration reported by IOCTL_GET_INFO with configHAT, prints
+   each differing field if verbose is set and returns the number of differences. */
+int config_diff(const struct st_info *info, const struct st_configHAT *configHAT, bool verbose);
+
+/* same as config_diff() for the configuration applied last */
+int config_compare(const struct st_configHAT *applied, const struct st_configHAT *configHAT, bool verbose);
+
+/* checks the values against the limits above, prints every violation, returns 0 if valid */
+int config_validate(const struct st_configHAT *configHAT);
+
+/* Pushes the configuration with IOCTL_CONFIG unless the HAT already runs it
+   (or force is set). Returns 1 if pushed, 0 if unchanged and -1 on error. */
+int config_push(int fd, const struct st_configHAT *configHAT, bool force);
+
+#endif /* CONFIG_H */
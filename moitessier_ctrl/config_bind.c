@@ -0,0 +1,488 @@
+/*
+    Direct binding of config.xml to struct st_configHAT of the Moitessier HAT
+    control program (see config_bind.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "config_bind.h"
+
+#define RCV_OFFSET(member)          (offsetof(struct st_configHAT, rcv) + offsetof(struct st_receiverConfig, member))
+#define SIM_OFFSET(member)          (offsetof(struct st_configHAT, simulator) + offsetof(struct st_simulator, member))
+#define WP_OFFSET                   offsetof(struct st_configHAT, wpEEPROM)
+#define RCV_STRIDE                  sizeof(struct st_receiverConfig)
+
+/* the layout of config.xml, see config_save_xml(); at most 32 fields with at
+   most 32 occurrences each, the seen bits of a field fit into an uint32_t */
+static const struct st_bindField bindFields[] = {
+    /* path                                 count                           stride                              offset                  type        min                 max */
+    {{"receiver", "channelFreq", "freq"},   {NUM_RCV, 1, NUM_RCV_CHANNELS}, {RCV_STRIDE, 0, sizeof(uint32_t)},  RCV_OFFSET(channelFreq), BIND_U32,  CONFIG_FREQ_MIN,    CONFIG_FREQ_MAX},
+    {{"receiver", "metamask"},              {NUM_RCV, 1},                   {RCV_STRIDE, 0},                    RCV_OFFSET(metaDataMask), BIND_U8,  0,                  0xFF},
+    {{"receiver", "afcRange"},              {NUM_RCV, 1},                   {RCV_STRIDE, 0},                    RCV_OFFSET(afcRange),   BIND_U32,   CONFIG_AFC_MIN,     CONFIG_AFC_MAX},
+    {{"receiver", "tcxoFreq"},              {NUM_RCV, 1},                   {RCV_STRIDE, 0},                    RCV_OFFSET(tcxoFreq),   BIND_U32,   CONFIG_TCXO_MIN,    CONFIG_TCXO_MAX},
+    {{"simulator", "enabled"},              {1, 1},                         {0, 0},                             SIM_OFFSET(enabled),    BIND_U32,   0,                  1},
+    {{"simulator", "interval"},             {1, 1},                         {0, 0},                             SIM_OFFSET(interval),   BIND_U32,   0,                  0xFFFFFFFF},
+    {{"simulator", "mmsi", "id"},           {1, 1, NUM_RCV_CHANNELS},       {0, 0, sizeof(uint32_t)},           SIM_OFFSET(mmsi),       BIND_U32,   0,                  CONFIG_MMSI_MAX},
+    {{"misc", "eepromWpEnabled"},           {1, 1},                         {0, 0},                             WP_OFFSET,              BIND_U8,    0,                  1},
+};
+
+#define BIND_NUM_FIELDS             (sizeof(bindFields) / sizeof(bindFields[0]))
+
+/* one open element */
+struct st_bindFrame{
+    const char  *name;
+    size_t      len;
+    uint32_t    mask;                       /* fields whose path matches up to this element */
+    uint8_t     index;                      /* occurrence among the siblings of the same name */
+    uint8_t     children[BIND_NUM_FIELDS];  /* matching children seen so far, per field */
+};
+
+struct st_bind{
+    const char              *name;
+    const char              *data;
+    const char              *end;
+    struct st_configHAT     *configHAT;
+    struct st_bindFrame     frames[BIND_MAX_DEPTH];
+    int                     depth;
+    const char              *root;
+    size_t                  rootLen;
+    bool                    rootClosed;
+    int                     leaf;           /* field of the innermost open element, -1 if none */
+    int                     leafDepth;
+    const char              *leafPos;
+    char                    value[BIND_MAX_VALUE + 1];
+    size_t                  valueLen;
+    bool                    valueTooLong;
+    uint32_t                seen[BIND_NUM_FIELDS];  /* bound occurrences, one bit each */
+    int                     errors;
+};
+
+static int line_of(const struct st_bind *bind, const char *pos)
+{
+    const char *p;
+    int line = 1;
+
+    for(p = bind->data; p < pos; p++)
+    {
+        if(*p == '\n')
+            line++;
+    }
+    return line;
+}
+
+static int syntax_error(const struct st_bind *bind, const char *pos, const char *what)
+{
+    printf("ERROR: \"%s\" line %d: %s\n", bind->name, line_of(bind, pos), what);
+    return -1;
+}
+
+static int num_segments(const struct st_bindField *field)
+{
+    int n = 0;
+
+    while(n < BIND_MAX_SEGMENTS && field->path[n])
+        n++;
+    return n;
+}
+
+static int num_slots(const struct st_bindField *field)
+{
+    int slots = 1;
+    int s;
+
+    for(s = 0; s < num_segments(field); s++)
+        slots *= field->count[s];
+    return slots;
+}
+
+/* "/config/receiver[2]/channelFreq/freq[1]", indices are 1-based like in XPath
+   and only given for elements that occur more than once */
+static void format_path(const struct st_bind *bind, const struct st_bindField *field, const uint8_t *index, char *buf, size_t size)
+{
+    size_t pos;
+    int s;
+
+    pos = snprintf(buf, size, "/%.*s", (int)bind->rootLen, bind->root);
+    for(s = 0; s < num_segments(field) && pos < size; s++)
+    {
+        if(field->count[s] > 1)
+            pos += snprintf(buf + pos, size - pos, "/%s[%u]", field->path[s], (unsigned int)index[s] + 1);
+        else
+            pos += snprintf(buf + pos, size - pos, "/%s", field->path[s]);
+    }
+}
+
+/* parses a decimal number, surrounding whitespace is allowed */
+static int parse_u32(const char *txt, uint32_t *value)
+{
+    uint64_t v = 0;
+
+    while(*txt == ' ' || *txt == '\t' || *txt == '\r' || *txt == '\n')
+        txt++;
+    if(*txt < '0' || *txt > '9')
+        return -1;
+    while(*txt >= '0' && *txt <= '9')
+    {
+        v = v * 10 + (uint64_t)(*txt++ - '0');
+        if(v > 0xFFFFFFFFULL)
+            return -1;
+    }
+    while(*txt == ' ' || *txt == '\t' || *txt == '\r' || *txt == '\n')
+        txt++;
+    if(*txt)
+        return -1;
+    *value = (uint32_t)v;
+    return 0;
+}
+
+/* stores the text of the leaf element that has just been closed */
+static void bind_value(struct st_bind *bind)
+{
+    const struct st_bindField *field = &bindFields[bind->leaf];
+    uint8_t index[BIND_MAX_SEGMENTS] = {0};
+    char path[128];
+    uint8_t *dst;
+    uint32_t value;
+    int slot = 0;
+    int s;
+
+    for(s = 0; s < num_segments(field); s++)
+    {
+        index[s] = bind->frames[s + 1].index;
+        slot = slot * field->count[s] + index[s];
+    }
+    bind->seen[bind->leaf] |= 1u << slot;
+    format_path(bind, field, index, path, sizeof(path));
+
+    bind->value[bind->valueLen] = '\0';
+    if(bind->value[strspn(bind->value, " \t\r\n")] == '\0')
+    {
+        printf("ERROR: \"%s\" line %d: %s has no value\n", bind->name, line_of(bind, bind->leafPos), path);
+        bind->errors++;
+        return;
+    }
+    if(bind->valueTooLong || parse_u32(bind->value, &value) != 0)
+    {
+        printf("ERROR: \"%s\" line %d: %s \"%s%s\" is not a number\n", bind->name, line_of(bind, bind->leafPos),
+               path, bind->value, bind->valueTooLong ? "..." : "");
+        bind->errors++;
+        return;
+    }
+    if(value < field->min || value > field->max)
+    {
+        printf("ERROR: \"%s\" line %d: %s %u out of range [%u, %u]\n", bind->name, line_of(bind, bind->leafPos),
+               path, (unsigned int)value, (unsigned int)field->min, (unsigned int)field->max);
+        bind->errors++;
+        return;
+    }
+
+    dst = (uint8_t*)bind->configHAT + field->offset;
+    for(s = 0; s < num_segments(field); s++)
+        dst += index[s] * field->stride[s];
+    if(field->type == BIND_U8)
+        *dst = (uint8_t)value;
+    else
+        memcpy(dst, &value, sizeof(value));
+}
+
+static int open_element(struct st_bind *bind, const char *name, size_t len)
+{
+    struct st_bindFrame *parent;
+    struct st_bindFrame *frame;
+    const struct st_bindField *field;
+    int seg = bind->depth - 1;
+    int first = -1;
+    uint32_t f;
+
+    if(bind->depth == BIND_MAX_DEPTH)
+        return syntax_error(bind, name, "elements nested too deep");
+    if(bind->depth == 0 && bind->rootClosed)
+        return syntax_error(bind, name, "more than one root element");
+
+    frame = &bind->frames[bind->depth];
+    frame->name = name;
+    frame->len = len;
+    frame->mask = 0;
+    frame->index = 0;
+    memset(frame->children, 0, sizeof(frame->children));
+
+    if(bind->depth == 0)
+    {
+        /* the name of the root element is not checked */
+        bind->root = name;
+        bind->rootLen = len;
+        frame->mask = (1u << BIND_NUM_FIELDS) - 1;
+    }
+    else
+    {
+        parent = &bind->frames[bind->depth - 1];
+        for(f = 0; f < BIND_NUM_FIELDS; f++)
+        {
+            field = &bindFields[f];
+            if(!(parent->mask & (1u << f)) || seg >= num_segments(field) ||
+               strlen(field->path[seg]) != len || memcmp(field->path[seg], name, len) != 0)
+                continue;
+            if(first < 0)
+            {
+                first = f;
+                frame->index = parent->children[f];
+            }
+            if(parent->children[f] < 0xFF)
+                parent->children[f]++;
+            /* further occurrences are not bound */
+            if(frame->index < field->count[seg])
+                frame->mask |= 1u << f;
+        }
+    }
+    bind->depth++;
+
+    /* the path of a field ends here, its text is collected until the element is closed */
+    for(f = 0; f < BIND_NUM_FIELDS; f++)
+    {
+        if((frame->mask & (1u << f)) && num_segments(&bindFields[f]) == seg + 1)
+        {
+            bind->leaf = f;
+            bind->leafDepth = bind->depth;
+            bind->leafPos = name;
+            bind->valueLen = 0;
+            bind->valueTooLong = false;
+            break;
+        }
+    }
+    return 0;
+}
+
+static int close_element(struct st_bind *bind, const char *name, size_t len)
+{
+    const struct st_bindFrame *frame;
+    char what[160];
+
+    if(bind->depth == 0)
+        return syntax_error(bind, name, "closing tag without an open element");
+    frame = &bind->frames[bind->depth - 1];
+    if(name && (frame->len != len || memcmp(frame->name, name, len) != 0))
+    {
+        snprintf(what, sizeof(what), "</%.*s> does not close <%.*s>", (int)(len > 64 ? 64 : len), name,
+                 (int)(frame->len > 64 ? 64 : frame->len), frame->name);
+        return syntax_error(bind, name, what);
+    }
+
+    if(bind->leaf >= 0 && bind->leafDepth == bind->depth)
+    {
+        bind_value(bind);
+        bind->leaf = -1;
+    }
+    bind->depth--;
+    if(bind->depth == 0)
+        bind->rootClosed = true;
+    return 0;
+}
+
+static void character_data(struct st_bind *bind, const char *txt, size_t len)
+{
+    /* text of elements nested in the leaf does not belong to its value */
+    if(bind->leaf < 0 || bind->leafDepth != bind->depth)
+        return;
+    if(bind->valueLen + len > BIND_MAX_VALUE)
+    {
+        len = BIND_MAX_VALUE - bind->valueLen;
+        bind->valueTooLong = true;
+    }
+    memcpy(bind->value + bind->valueLen, txt, len);
+    bind->valueLen += len;
+}
+
+/* returns the first occurrence of str in [p, end) or NULL */
+static const char* find(const char *p, const char *end, const char *str)
+{
+    size_t len = strlen(str);
+
+    while((p = memchr(p, str[0], end - p)) && (size_t)(end - p) >= len)
+    {
+        if(memcmp(p, str, len) == 0)
+            return p;
+        p++;
+    }
+    return NULL;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_name_end(char c)
+{
+    return is_space(c) || c == '/' || c == '>' || c == '=';
+}
+
+/* scans the document once, calling open_element(), close_element() and character_data() */
+static int scan(struct st_bind *bind)
+{
+    const char *p = bind->data;
+    const char *end = bind->end;
+    const char *q;
+    const char *name;
+    size_t len;
+    int nest;
+
+    while(p < end)
+    {
+        if(*p != '<')
+        {
+            q = memchr(p, '<', end - p);
+            if(!q)
+                q = end;
+            character_data(bind, p, q - p);
+            p = q;
+            continue;
+        }
+
+        if(end - p >= 2 && p[1] == '?')
+        {
+            if(!(q = find(p + 2, end, "?>")))
+                return syntax_error(bind, p, "unterminated processing instruction");
+            p = q + 2;
+        }
+        else if(end - p >= 4 && memcmp(p, "<!--", 4) == 0)
+        {
+            if(!(q = find(p + 4, end, "-->")))
+                return syntax_error(bind, p, "unterminated comment");
+            p = q + 3;
+        }
+        else if(end - p >= 9 && memcmp(p, "<![CDATA[", 9) == 0)
+        {
+            if(!(q = find(p + 9, end, "]]>")))
+                return syntax_error(bind, p, "unterminated CDATA section");
+            character_data(bind, p + 9, q - p - 9);
+            p = q + 3;
+        }
+        else if(end - p >= 2 && p[1] == '!')
+        {
+            /* DOCTYPE, an internal subset may contain '>' within [] */
+            for(q = p + 2, nest = 0; q < end && (*q != '>' || nest > 0); q++)
+            {
+                if(*q == '[')
+                    nest++;
+                else if(*q == ']')
+                    nest--;
+            }
+            if(q == end)
+                return syntax_error(bind, p, "unterminated declaration");
+            p = q + 1;
+        }
+        else if(end - p >= 2 && p[1] == '/')
+        {
+            for(name = q = p + 2; q < end && !is_name_end(*q); q++);
+            len = q - name;
+            while(q < end && is_space(*q))
+                q++;
+            if(len == 0 || q == end || *q != '>')
+                return syntax_error(bind, p, "malformed closing tag");
+            if(close_element(bind, name, len) != 0)
+                return -1;
+            p = q + 1;
+        }
+        else
+        {
+            for(name = q = p + 1; q < end && !is_name_end(*q); q++);
+            len = q - name;
+            if(len == 0)
+                return syntax_error(bind, p, "malformed tag");
+            /* attributes are not bound, skip them including quoted '>' */
+            while(q < end && *q != '>')
+            {
+                if(*q == '"' || *q == '\'')
+                {
+                    if(!(q = memchr(q + 1, *q, end - q - 1)))
+                        return syntax_error(bind, p, "unterminated attribute value");
+                }
+                q++;
+            }
+            if(q == end)
+                return syntax_error(bind, p, "unterminated tag");
+            if(open_element(bind, name, len) != 0)
+                return -1;
+            if(q[-1] == '/' && close_element(bind, NULL, 0) != 0)
+                return -1;
+            p = q + 1;
+        }
+    }
+
+    if(bind->depth > 0)
+    {
+        printf("ERROR: \"%s\" ends before <%.*s> is closed\n", bind->name,
+               (int)bind->frames[bind->depth - 1].len, bind->frames[bind->depth - 1].name);
+        return -1;
+    }
+    if(!bind->root)
+    {
+        printf("ERROR: \"%s\" has no root element\n", bind->name);
+        return -1;
+    }
+    return 0;
+}
+
+int config_bind_xml(const char *name, const char *data, size_t len, struct st_configHAT *configHAT)
+{
+    struct st_bind bind;
+    const struct st_bindField *field;
+    uint8_t index[BIND_MAX_SEGMENTS];
+    char path[128];
+    uint32_t f;
+    int slot;
+    int rest;
+    int s;
+
+    memset(&bind, 0, sizeof(bind));
+    bind.name = name;
+    bind.data = data;
+    bind.end = data + len;
+    bind.configHAT = configHAT;
+    bind.leaf = -1;
+
+    /* the AFC default range is not used, so it stays 0 */
+    memset(configHAT, 0, sizeof(struct st_configHAT));
+
+    if(scan(&bind) != 0)
+        return -1;
+
+    for(f = 0; f < BIND_NUM_FIELDS; f++)
+    {
+        field = &bindFields[f];
+        for(slot = 0; slot < num_slots(field); slot++)
+        {
+            if(bind.seen[f] & (1u << slot))
+                continue;
+            for(s = num_segments(field) - 1, rest = slot; s >= 0; s--)
+            {
+                index[s] = rest % field->count[s];
+                rest /= field->count[s];
+            }
+            format_path(&bind, field, index, path, sizeof(path));
+            printf("ERROR: \"%s\" is missing %s\n", name, path);
+            bind.errors++;
+        }
+    }
+
+    return bind.errors ? -1 : 0;
+}
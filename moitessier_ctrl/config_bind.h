@@ -0,0 +1,60 @@
+/*
+    Direct binding of config.xml to struct st_configHAT of the Moitessier HAT
+    control program.
+
+    The document is scanned once, without building an XML tree. Each element
+    path is matched against a static table that holds the offset, type and
+    limits of the bound field in struct st_configHAT.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef CONFIG_BIND_H
+#define CONFIG_BIND_H
+
+#include <stddef.h>
+#include "moitessier_ctrl.h"
+
+#define BIND_MAX_SEGMENTS           3       /* element names below the root element */
+#define BIND_MAX_DEPTH              16      /* nesting limit of the document */
+#define BIND_MAX_VALUE              32      /* longest accepted value text */
+
+enum e_bindType{
+    BIND_U8,
+    BIND_U32
+};
+
+/* One bound field. Elements that occur more than once (the receivers, the
+   frequencies of a receiver, ...) are mapped to arrays by count and stride
+   of the path segment, further occurrences are ignored. */
+struct st_bindField{
+    const char      *path[BIND_MAX_SEGMENTS];       /* NULL terminated if shorter */
+    uint8_t         count[BIND_MAX_SEGMENTS];       /* occurrences bound per segment */
+    uint16_t        stride[BIND_MAX_SEGMENTS];      /* [bytes] between two occurrences */
+    uint16_t        offset;                         /* in struct st_configHAT, first occurrence */
+    enum e_bindType type;
+    uint32_t        min;
+    uint32_t        max;
+};
+
+/* Fills configHAT from the config.xml held in data (len bytes, does not need
+   to be NUL terminated). name is used in the error messages only. Every
+   syntax error, missing value, malformed number or value out of range is
+   printed with its line and path. Returns 0 on success, -1 on error. */
+int config_bind_xml(const char *name, const char *data, size_t len, struct st_configHAT *configHAT);
+
+#endif /* CONFIG_BIND_H */
@@ -0,0 +1,464 @@
+/*
+    Userspace stand-in for the control device of the Moitessier HAT.
+
+    This library is preloaded into moitessier_ctrl (or any other program
+    talking to the control device) and emulates the IOCTL interface of the
+    kernel driver, so the control path can be tested and benchmarked without
+    a HAT:
+
+        LD_PRELOAD=bin/libmoitessier_emu.so bin/moitessier_ctrl /dev/moitessier.ctrl 1
+
+    The emulation is configured with environment variables:
+
+        MOITESSIER_EMU_DEVICES      fnmatch() pattern of the emulated device paths
+                                    (default "/dev/moitessier*.ctrl"), every path
+                                    gets its own state and serial number
+        MOITESSIER_EMU_RATES        growth of the statistics counters [1/s] in the
+                                    order of struct st_statistics, comma separated
+                                    (default "100,2000,0,2100,0.5,0.2,0")
+        MOITESSIER_EMU_OVF_MIN_BITS FIFO overflows only grow while at least this many
+                                    GNSS sentences are enabled (default 0, always)
+        MOITESSIER_EMU_RESET_MS     time from IOCTL_RESET_HAT until the info is
+                                    valid again (default 2000)
+        MOITESSIER_EMU_IOCTL_US     additional latency of every IOCTL (default 0)
+        MOITESSIER_EMU_TCXO         "<FREQ>,<WIDTH>", reception model for the calibration:
+                                    the payload drops and the CRC errors rise the further
+                                    tcxoFreq is away from FREQ [Hz], a wider afcRange
+                                    tolerates more offset but adds CRC errors (default off)
+        MOITESSIER_EMU_SIM          "<BYTES_PER_MSG>,<FIFO_BPS>,<GNSS_BPS>", traffic of the
+                                    AIS simulator (two targets, one report per interval
+                                    each), the FIFO drains FIFO_BPS, every enabled GNSS
+                                    sentence takes GNSS_BPS / 8 of it, the rest of the
+                                    simulated reports overflows (default "40,8000,1600")
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <math.h>
+#include "../moitessier_ctrl.h"
+
+#define EMU_MAX_DEVICES             16
+#define EMU_MAX_FDS                 64
+
+/* state of one emulated HAT */
+struct st_emuDevice{
+    char                    path[256];
+    bool                    used;
+    struct st_info          info;
+    struct st_configHAT     config;
+    double                  counters[7];    /* values at lastUpdate */
+    uint64_t                lastUpdate;     /* [ns] */
+    uint64_t                validAt;        /* [ns] the HAT is in reset until then */
+    bool                    gnssOn;
+    uint8_t                 gnssMask;
+};
+
+struct st_emuFd{
+    int                     fd;
+    struct st_emuDevice     *dev;
+};
+
+static struct st_emuDevice devices[EMU_MAX_DEVICES];
+static struct st_emuFd fds[EMU_MAX_FDS];
+static double rates[7] = {100, 2000, 0, 2100, 0.5, 0.2, 0};
+static uint32_t ovfMinBits = 0;
+static uint64_t resetNs = 2000000000ULL;
+static uint64_t ioctlNs = 0;
+static double tcxoOpt = 0;
+static double tcxoWidth = 0;
+static double simMsgBytes = 40;
+static double simFifoBps = 8000;
+static double simGnssBps = 1600;
+static const char *pattern = "/dev/moitessier*.ctrl";
+static bool initialized = false;
+
+static int (*real_open)(const char *path, int flags, ...);
+static int (*real_close)(int fd);
+static int (*real_ioctl)(int fd, unsigned long request, ...);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void emu_init(void)
+{
+    const char *env;
+    char *end;
+    int i;
+
+    if(initialized)
+        return;
+    initialized = true;
+
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_close = dlsym(RTLD_NEXT, "close");
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+    if((env = getenv("MOITESSIER_EMU_DEVICES")))
+        pattern = env;
+    if((env = getenv("MOITESSIER_EMU_RATES")))
+    {
+        for(i = 0; i < 7 && *env; i++)
+        {
+            rates[i] = strtod(env, &end);
+            env = (*end == ',') ? end + 1 : end;
+        }
+    }
+    if((env = getenv("MOITESSIER_EMU_OVF_MIN_BITS")))
+        ovfMinBits = atoi(env);
+    if((env = getenv("MOITESSIER_EMU_RESET_MS")))
+        resetNs = (uint64_t)atoi(env) * 1000000ULL;
+    if((env = getenv("MOITESSIER_EMU_IOCTL_US")))
+        ioctlNs = (uint64_t)atoi(env) * 1000ULL;
+    if((env = getenv("MOITESSIER_EMU_TCXO")))
+    {
+        tcxoOpt = strtod(env, &end);
+        tcxoWidth = (*end == ',') ? strtod(end + 1, NULL) : 100;
+    }
+    if((env = getenv("MOITESSIER_EMU_SIM")))
+    {
+        simMsgBytes = strtod(env, &end);
+        if(*end == ',')
+            simFifoBps = strtod(end + 1, &end);
+        if(*end == ',')
+            simGnssBps = strtod(end + 1, &end);
+    }
+}
+
+/* configuration the HAT uses after power up or reset */
+static void default_config(struct st_configHAT *config)
+{
+    int i;
+
+    memset(config, 0, sizeof(*config));
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        config->rcv[i].channelFreq[0] = 161975000;
+        config->rcv[i].channelFreq[1] = 162025000;
+        config->rcv[i].afcRange = 1500;
+        config->rcv[i].afcRangeDefault = 1500;
+        config->rcv[i].tcxoFreq = 13000000;
+    }
+    config->simulator.interval = 100;
+    config->simulator.mmsi[0] = 5551122;
+    config->simulator.mmsi[1] = 6884120;
+    config->wpEEPROM = 1;
+}
+
+static void apply_config(struct st_emuDevice *dev)
+{
+    int i;
+
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        dev->info.rcv[i].config = dev->config.rcv[i];
+        dev->info.rcv[i].config.afcRangeDefault = 1500;
+    }
+    dev->info.simulator = dev->config.simulator;
+    dev->info.wpEEPROM = dev->config.wpEEPROM;
+}
+
+static void reset_device(struct st_emuDevice *dev, uint64_t now)
+{
+    memset(dev->counters, 0, sizeof(dev->counters));
+    dev->lastUpdate = now;
+    dev->gnssOn = true;
+    dev->gnssMask = 0xFF;
+    default_config(&dev->config);
+    apply_config(dev);
+}
+
+static struct st_emuDevice* get_device(const char *path)
+{
+    struct st_emuDevice *dev;
+    uint32_t hash = 2166136261u;
+    const char *p;
+    int i;
+
+    for(i = 0; i < EMU_MAX_DEVICES; i++)
+    {
+        if(devices[i].used && !strcmp(devices[i].path, path))
+            return &devices[i];
+    }
+    for(i = 0; i < EMU_MAX_DEVICES && devices[i].used; i++);
+    if(i == EMU_MAX_DEVICES)
+        return NULL;
+
+    dev = &devices[i];
+    memset(dev, 0, sizeof(*dev));
+    dev->used = true;
+    snprintf(dev->path, sizeof(dev->path), "%s", path);
+
+    /* the serial number is derived from the path, so it is stable between runs */
+    for(p = path; *p; p++)
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    dev->info.mode = 'N';
+    strcpy((char*)dev->info.hwId, "MOITESSIER-EMU");
+    strcpy((char*)dev->info.hwVer, "1.0");
+    strcpy((char*)dev->info.bootVer, "emu-boot");
+    strcpy((char*)dev->info.appVer, "emu-app");
+    strcpy((char*)dev->info.gnssVer, "emu-gnss");
+    dev->info.functionality = 0x0000000F;
+    dev->info.serial.h = 0x454d55;      /* "EMU" */
+    dev->info.serial.m = (uint32_t)i;
+    dev->info.serial.l = hash;
+    dev->info.rcv[0].rng[0] = 0x11;
+    dev->info.rcv[0].rng[1] = 0x12;
+    dev->info.rcv[1].rng[0] = 0x21;
+    dev->info.rcv[1].rng[1] = 0x22;
+    dev->info.gnssSysSupported = 3;
+    reset_device(dev, now_ns());
+    dev->validAt = dev->lastUpdate;
+    return dev;
+}
+
+/* advances the counters to now */
+static void update_counters(struct st_emuDevice *dev, uint64_t now)
+{
+    double dt;
+    double quality;
+    double afcScale;
+    double afc;
+    double offset;
+    double offered;
+    double delivered;
+    uint32_t bits = 0;
+    uint8_t mask;
+    int i;
+
+    if(now <= dev->lastUpdate)
+        return;
+    dt = (double)(now - dev->lastUpdate) / 1e9;
+    dev->lastUpdate = now;
+    if(now < dev->validAt)
+        return; /* no traffic while the HAT resets */
+
+    for(mask = dev->gnssOn ? dev->gnssMask : 0; mask; mask &= mask - 1)
+        bits++;
+
+    /* reception quality of the receivers, 1.0 without the TCXO model */
+    quality = 1.0;
+    afcScale = 1.0;
+    if(tcxoWidth > 0)
+    {
+        quality = 0;
+        for(i = 0; i < NUM_RCV; i++)
+        {
+            afc = dev->config.rcv[i].afcRange ? dev->config.rcv[i].afcRange / 1500.0 : 1.0;
+            offset = ((double)dev->config.rcv[i].tcxoFreq - tcxoOpt) / (tcxoWidth * sqrt(afc));
+            quality += exp(-offset * offset) / NUM_RCV;
+            afcScale += (afc - 1.0) / NUM_RCV;
+        }
+    }
+
+    for(i = 0; i < 7; i++)
+    {
+        if(i == 2 && bits < ovfMinBits)
+            continue;
+        if(i == 1 || i == 3)
+            dev->counters[i] += rates[i] * quality * dt;
+        else if(i == 4 || i == 5)
+            dev->counters[i] += rates[i] * (2.0 - quality) * afcScale * dt;
+        else
+            dev->counters[i] += rates[i] * dt;
+    }
+
+    /* simulated position reports share the FIFO with the GNSS sentences */
+    if(dev->config.simulator.enabled && dev->config.simulator.interval)
+    {
+        offered = NUM_RCV_CHANNELS * simMsgBytes * 1000.0 / dev->config.simulator.interval;
+        delivered = simFifoBps - simGnssBps * bits / 8.0;
+        if(delivered > offered)
+            delivered = offered;
+        if(delivered < 0)
+            delivered = 0;
+        dev->counters[1] += delivered * dt;
+        dev->counters[3] += delivered * dt;
+        dev->counters[2] += (offered - delivered) / simMsgBytes * dt;
+    }
+}
+
+static struct st_emuFd* find_fd(int fd)
+{
+    int i;
+
+    if(fd < 0)
+        return NULL;
+    for(i = 0; i < EMU_MAX_FDS; i++)
+    {
+        if(fds[i].dev && fds[i].fd == fd)
+            return &fds[i];
+    }
+    return NULL;
+}
+
+static int emu_open(const char *path, int flags, mode_t mode)
+{
+    struct st_emuDevice *dev;
+    int fd;
+    int i;
+
+    emu_init();
+    if(!path || fnmatch(pattern, path, 0) != 0)
+        return real_open(path, flags, mode);
+
+    dev = get_device(path);
+    for(i = 0; i < EMU_MAX_FDS && fds[i].dev; i++);
+    if(!dev || i == EMU_MAX_FDS)
+    {
+        errno = ENFILE;
+        return -1;
+    }
+
+    /* a real file descriptor, so poll(), close() etc. behave */
+    fd = real_open("/dev/null", O_RDONLY | O_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    fds[i].fd = fd;
+    fds[i].dev = dev;
+    return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+    va_list ap;
+    mode_t mode = 0;
+
+    if(flags & O_CREAT)
+    {
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    return emu_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+    va_list ap;
+    mode_t mode = 0;
+
+    if(flags & O_CREAT)
+    {
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+    return emu_open(path, flags, mode);
+}
+
+/* used instead of open() if the program was built with _FORTIFY_SOURCE */
+int __open_2(const char *path, int flags)
+{
+    return emu_open(path, flags, 0);
+}
+
+int __open64_2(const char *path, int flags)
+{
+    return emu_open(path, flags, 0);
+}
+
+int close(int fd)
+{
+    struct st_emuFd *e;
+
+    emu_init();
+    if((e = find_fd(fd)))
+        e->dev = NULL;
+    return real_close(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    struct st_emuFd *e;
+    struct st_emuDevice *dev;
+    struct st_statistics statistics;
+    unsigned char *buf;
+    uint64_t now;
+    va_list ap;
+    int i;
+
+    emu_init();
+    va_start(ap, request);
+    buf = va_arg(ap, unsigned char*);
+    va_end(ap);
+
+    if(!(e = find_fd(fd)))
+        return real_ioctl(fd, request, buf);
+    dev = e->dev;
+
+    if(ioctlNs)
+    {
+        struct timespec ts = {(time_t)(ioctlNs / 1000000000ULL), (long)(ioctlNs % 1000000000ULL)};
+        nanosleep(&ts, NULL);
+    }
+
+    now = now_ns();
+    update_counters(dev, now);
+
+    switch(request)
+    {
+        case IOCTL_GET_STATISTICS:
+            for(i = 0; i < 7; i++)
+                ((uint64_t*)&statistics)[i] = (uint64_t)dev->counters[i];
+            memcpy(buf, &statistics, sizeof(statistics));
+            return sizeof(statistics);
+        case IOCTL_GET_INFO:
+            dev->info.valid = (now >= dev->validAt);
+            memcpy(buf, &dev->info, sizeof(dev->info));
+            return sizeof(dev->info);
+        case IOCTL_RESET_HAT:
+            reset_device(dev, now);
+            dev->validAt = now + resetNs;
+            return 0;
+        case IOCTL_RESET_STATISTICS:
+            memset(dev->counters, 0, sizeof(dev->counters));
+            return 0;
+        case IOCTL_GNSS:
+            dev->gnssOn = (buf[0] != 0);
+            return 0;
+        case IOCTL_CONFIG:
+            memcpy(&dev->config, buf, sizeof(dev->config));
+            apply_config(dev);
+            return 0;
+        case IOCTL_ID_EEPROM:
+            dev->info.wpEEPROM = buf[0];
+            dev->config.wpEEPROM = buf[0];
+            return 0;
+        case IOCTL_GNSS_MSG_CONFIG:
+            dev->gnssMask = buf[0];
+            return 0;
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+}
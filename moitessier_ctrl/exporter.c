@@ -0,0 +1,500 @@
+/*
+    OpenMetrics exporter of the Moitessier HAT control program (see
+    exporter.h).
+
+    The exposition is formatted once per polling interval into a buffer that
+    already contains the HTTP response header. A scrape only copies that
+    buffer to the socket, it never triggers an IOCTL.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "moitessier_ctrl.h"
+#include "rates.h"
+#include "outbuf.h"
+#include "exporter.h"
+
+#define EXPORTER_REQUEST_TIMEOUT_MS     100     /* time a client has to send its request */
+
+static const char *counterMetricNames[RATE_COUNTERS] = {
+    "moitessier_spi_cycles",
+    "moitessier_rx_payload_bytes",
+    "moitessier_fifo_overflows",
+    "moitessier_fifo_bytes_processed",
+    "moitessier_payload_crc_errors",
+    "moitessier_header_crc_errors",
+    "moitessier_keep_alive_errors"
+};
+
+static const char *counterMetricHelp[RATE_COUNTERS] = {
+    "SPI cycles between the Raspberry Pi and the HAT.",
+    "Received AIS payload bytes.",
+    "FIFO overflows, AIS data has been lost.",
+    "Bytes processed from the FIFO.",
+    "Messages with payload CRC errors.",
+    "Messages with header CRC errors.",
+    "Keep alive errors."
+};
+
+static void family(struct st_outBuf *ob, const char *name, const char *type, const char *help)
+{
+    outbuf_printf(ob, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+/* starts a sample line, combining the labels of the source with extra labels */
+static void sample_start(struct st_outBuf *ob, const char *name, const char *suffix, const char *labels, const char *extra)
+{
+    bool haveLabels = labels && *labels;
+    bool haveExtra = extra && *extra;
+
+    outbuf_printf(ob, "%s%s", name, suffix);
+    if(haveLabels || haveExtra)
+        outbuf_printf(ob, "{%s%s%s}", haveLabels ? labels : "", (haveLabels && haveExtra) ? "," : "", haveExtra ? extra : "");
+}
+
+static void sample_u64(struct st_outBuf *ob, const char *name, const char *suffix, const char *labels, const char *extra, uint64_t value)
+{
+    sample_start(ob, name, suffix, labels, extra);
+    outbuf_printf(ob, " %llu\n", (unsigned long long)value);
+}
+
+static void sample_double(struct st_outBuf *ob, const char *name, const char *labels, const char *extra, double value)
+{
+    sample_start(ob, name, "", labels, extra);
+    outbuf_printf(ob, " %.6g\n", value);
+}
+
+void exporter_label(struct st_outBuf *ob, const char *name, const uint8_t *value, size_t size)
+{
+    size_t i;
+    char c;
+
+    outbuf_printf(ob, "%s=\"", name);
+    for(i = 0; i < size && value[i]; i++)
+    {
+        c = (char)value[i];
+        if(c == '\\' || c == '"')
+            outbuf_printf(ob, "\\%c", c);
+        else if(c == '\n')
+            outbuf_append(ob, "\\n", 2);
+        else if((unsigned char)c >= 0x20 && (unsigned char)c < 0x7f)
+            outbuf_append(ob, &c, 1);
+    }
+    outbuf_append(ob, "\"", 1);
+}
+
+void exporter_format(struct st_outBuf *ob, const struct st_exportSource *src, int n)
+{
+    static const char *kinds[2] = {"window", "ewma"};
+    char extra[128];
+    char serial[32];
+    uint8_t mode[2];
+    struct st_outBuf lb;
+    const struct st_info *info;
+    int c;
+    int d;
+    int w;
+    int k;
+    int i;
+    int bit;
+
+    for(c = 0; c < RATE_COUNTERS; c++)
+    {
+        family(ob, counterMetricNames[c], "counter", counterMetricHelp[c]);
+        for(d = 0; d < n; d++)
+            sample_u64(ob, counterMetricNames[c], "_total", src[d].labels, NULL, ((const uint64_t*)src[d].statistics)[c]);
+    }
+
+    family(ob, "moitessier_counter_rate", "gauge", "Rate of the statistics counters [1/s].");
+    for(d = 0; d < n; d++)
+    {
+        if(!src[d].rates || !src[d].rates->samples)
+            continue;
+        for(c = 0; c < RATE_COUNTERS; c++)
+        {
+            snprintf(extra, sizeof(extra), "counter=\"%s\",kind=\"instant\"", rateCounterNames[c]);
+            sample_double(ob, "moitessier_counter_rate", src[d].labels, extra, src[d].rates->instant[c]);
+            for(k = 0; k < 2; k++)
+            {
+                for(w = 0; w < RATE_WINDOWS; w++)
+                {
+                    snprintf(extra, sizeof(extra), "counter=\"%s\",kind=\"%s\",window=\"%us\"", rateCounterNames[c], kinds[k], rateWindowSec[w]);
+                    sample_double(ob, "moitessier_counter_rate", src[d].labels, extra, k ? src[d].rates->ewma[w][c] : src[d].rates->window[w][c]);
+                }
+            }
+        }
+    }
+
+    family(ob, "moitessier_crc_errors_per_kilobyte", "gauge", "Payload and header CRC errors per 1000 payload bytes.");
+    for(d = 0; d < n; d++)
+    {
+        if(!src[d].rates || !src[d].rates->samples)
+            continue;
+        for(w = 0; w < RATE_WINDOWS; w++)
+        {
+            snprintf(extra, sizeof(extra), "window=\"%us\"", rateWindowSec[w]);
+            sample_double(ob, "moitessier_crc_errors_per_kilobyte", src[d].labels, extra, src[d].rates->crcErrorsPerKB[w]);
+        }
+    }
+
+    family(ob, "moitessier_counter_resets", "counter", "Detected resets of the statistics counters.");
+    for(d = 0; d < n; d++)
+        sample_u64(ob, "moitessier_counter_resets", "_total", src[d].labels, NULL, src[d].rates ? src[d].rates->counterResets : 0);
+
+    family(ob, "moitessier_ioctl_errors", "counter", "Failed IOCTLs of the exporter.");
+    for(d = 0; d < n; d++)
+        sample_u64(ob, "moitessier_ioctl_errors", "_total", src[d].labels, NULL, src[d].ioctlErrors);
+
+    family(ob, "moitessier_info_valid", "gauge", "1 if the HAT info is valid.");
+    for(d = 0; d < n; d++)
+        sample_u64(ob, "moitessier_info_valid", "", src[d].labels, NULL, src[d].info && src[d].info->valid);
+
+    /* everything below is only meaningful if the HAT reported valid info */
+    family(ob, "moitessier_hat", "info", "Versions and serial of the HAT.");
+    outbuf_init(&lb, 512);
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        mode[0] = info->mode;
+        mode[1] = 0;
+        snprintf(serial, sizeof(serial), "%08x%08x%08x", (unsigned int)info->serial.h, (unsigned int)info->serial.m, (unsigned int)info->serial.l);
+        outbuf_reset(&lb);
+        exporter_label(&lb, "mode", mode, sizeof(mode));
+        exporter_label(&lb, ",hw_id", info->hwId, sizeof(info->hwId));
+        exporter_label(&lb, ",hw_version", info->hwVer, sizeof(info->hwVer));
+        exporter_label(&lb, ",boot_version", info->bootVer, sizeof(info->bootVer));
+        exporter_label(&lb, ",app_version", info->appVer, sizeof(info->appVer));
+        exporter_label(&lb, ",gnss_version", info->gnssVer, sizeof(info->gnssVer));
+        exporter_label(&lb, ",hat_serial", (const uint8_t*)serial, sizeof(serial));
+        sample_u64(ob, "moitessier_hat", "_info", src[d].labels, lb.data, 1);
+    }
+    outbuf_free(&lb);
+
+    family(ob, "moitessier_system_error", "gauge", "Bits of the system error register.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(bit = 0; bit < 32; bit++)
+        {
+            snprintf(extra, sizeof(extra), "bit=\"%d\"", bit);
+            sample_u64(ob, "moitessier_system_error", "", src[d].labels, extra, (info->systemErrors >> bit) & 1);
+        }
+    }
+
+    family(ob, "moitessier_functionality", "gauge", "Bits of the functionality register.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(bit = 0; bit < 32; bit++)
+        {
+            snprintf(extra, sizeof(extra), "bit=\"%d\"", bit);
+            sample_u64(ob, "moitessier_functionality", "", src[d].labels, extra, (info->functionality >> bit) & 1);
+        }
+    }
+
+    family(ob, "moitessier_channel_frequency_hertz", "gauge", "Receiver channel frequency.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(i = 0; i < NUM_RCV; i++)
+        {
+            for(k = 0; k < NUM_RCV_CHANNELS; k++)
+            {
+                snprintf(extra, sizeof(extra), "receiver=\"%d\",channel=\"%d\"", i + 1, k + 1);
+                sample_u64(ob, "moitessier_channel_frequency_hertz", "", src[d].labels, extra, info->rcv[i].config.channelFreq[k]);
+            }
+        }
+    }
+
+    family(ob, "moitessier_rng", "gauge", "Receiver random number per channel.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(i = 0; i < NUM_RCV; i++)
+        {
+            for(k = 0; k < NUM_RCV_CHANNELS; k++)
+            {
+                snprintf(extra, sizeof(extra), "receiver=\"%d\",channel=\"%d\"", i + 1, k + 1);
+                sample_u64(ob, "moitessier_rng", "", src[d].labels, extra, info->rcv[i].rng[k]);
+            }
+        }
+    }
+
+    family(ob, "moitessier_tcxo_frequency_hertz", "gauge", "TCXO frequency used by the receiver.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(i = 0; i < NUM_RCV; i++)
+        {
+            snprintf(extra, sizeof(extra), "receiver=\"%d\"", i + 1);
+            sample_u64(ob, "moitessier_tcxo_frequency_hertz", "", src[d].labels, extra, info->rcv[i].config.tcxoFreq);
+        }
+    }
+
+    family(ob, "moitessier_afc_range_hertz", "gauge", "Automatic frequency control range of the receiver.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(i = 0; i < NUM_RCV; i++)
+        {
+            snprintf(extra, sizeof(extra), "receiver=\"%d\"", i + 1);
+            sample_u64(ob, "moitessier_afc_range_hertz", "", src[d].labels, extra, info->rcv[i].config.afcRange);
+        }
+    }
+
+    family(ob, "moitessier_meta_data_mask", "gauge", "Meta data mask of the receiver.");
+    for(d = 0; d < n; d++)
+    {
+        if(!(info = src[d].info) || !info->valid)
+            continue;
+        for(i = 0; i < NUM_RCV; i++)
+        {
+            snprintf(extra, sizeof(extra), "receiver=\"%d\"", i + 1);
+            sample_u64(ob, "moitessier_meta_data_mask", "", src[d].labels, extra, info->rcv[i].config.metaDataMask);
+        }
+    }
+
+    family(ob, "moitessier_simulator_enabled", "gauge", "1 if the AIS simulator is enabled.");
+    for(d = 0; d < n; d++)
+        if((info = src[d].info) && info->valid)
+            sample_u64(ob, "moitessier_simulator_enabled", "", src[d].labels, NULL, info->simulator.enabled);
+
+    family(ob, "moitessier_simulator_interval_milliseconds", "gauge", "Interval of the simulated position reports.");
+    for(d = 0; d < n; d++)
+        if((info = src[d].info) && info->valid)
+            sample_u64(ob, "moitessier_simulator_interval_milliseconds", "", src[d].labels, NULL, info->simulator.interval);
+
+    family(ob, "moitessier_eeprom_write_protected", "gauge", "1 if the ID EEPROM is write protected.");
+    for(d = 0; d < n; d++)
+        if((info = src[d].info) && info->valid)
+            sample_u64(ob, "moitessier_eeprom_write_protected", "", src[d].labels, NULL, info->wpEEPROM);
+
+    family(ob, "moitessier_button_pressed", "gauge", "1 if the write button is pressed.");
+    for(d = 0; d < n; d++)
+        if((info = src[d].info) && info->valid)
+            sample_u64(ob, "moitessier_button_pressed", "", src[d].labels, NULL, info->buttonPressed);
+
+    family(ob, "moitessier_gnss_systems_supported", "gauge", "Satellite systems supported by the GNSS receiver.");
+    for(d = 0; d < n; d++)
+        if((info = src[d].info) && info->valid)
+            sample_u64(ob, "moitessier_gnss_systems_supported", "", src[d].labels, NULL, info->gnssSysSupported);
+
+    outbuf_printf(ob, "# EOF\n");
+}
+
+/* creates the listening socket, returns the file descriptor or -1 on error */
+int exporter_listen(const char *address)
+{
+    struct sockaddr_un sun;
+    struct sockaddr_in sin;
+    const char *port;
+    char host[64];
+    int fd = -1;
+    int one = 1;
+
+    if(!strncmp(address, "unix:", 5))
+    {
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        if(strlen(address + 5) >= sizeof(sun.sun_path))
+        {
+            printf("ERROR: socket path \"%s\" too long\n", address + 5);
+            return -1;
+        }
+        strcpy(sun.sun_path, address + 5);
+        unlink(sun.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0 || bind(fd, (struct sockaddr*)&sun, sizeof(sun)) != 0)
+            goto error;
+    }
+    else
+    {
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        port = strrchr(address, ':');
+        if(port)
+        {
+            snprintf(host, sizeof(host), "%.*s", (int)(port - address), address);
+            if(inet_pton(AF_INET, host, &sin.sin_addr) != 1)
+            {
+                printf("ERROR: invalid address \"%s\"\n", host);
+                return -1;
+            }
+            port++;
+        }
+        else
+            port = address;
+        sin.sin_port = htons((uint16_t)atoi(port));
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+            goto error;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(bind(fd, (struct sockaddr*)&sin, sizeof(sin)) != 0)
+            goto error;
+    }
+
+    if(listen(fd, 16) != 0)
+        goto error;
+    return fd;
+
+error:
+    printf("ERROR: could not listen on \"%s\": %s\n", address, strerror(errno));
+    if(fd >= 0)
+        close(fd);
+    return -1;
+}
+
+/* Accepts one client and sends the prebuilt response. HTTP clients (e.g.
+   Prometheus) get the full response, clients that do not send a request
+   (e.g. "socat - UNIX-CONNECT:...") only get the exposition. */
+void exporter_serve(int listenFd, const struct st_outBuf *response, size_t headerLen)
+{
+    struct pollfd pfd;
+    char request[512];
+    ssize_t n = 0;
+    int client;
+
+    client = accept(listenFd, NULL, NULL);
+    if(client < 0)
+        return;
+
+    pfd.fd = client;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, EXPORTER_REQUEST_TIMEOUT_MS) > 0)
+        n = recv(client, request, sizeof(request) - 1, MSG_DONTWAIT);
+
+    if(n >= 4 && !strncmp(request, "GET ", 4))
+        send(client, response->data, response->len, MSG_NOSIGNAL);
+    else
+        send(client, response->data + headerLen, response->len - headerLen, MSG_NOSIGNAL);
+    close(client);
+}
+
+/* builds the HTTP response around the exposition, returns the header length */
+size_t exporter_response(struct st_outBuf *response, const struct st_outBuf *body)
+{
+    size_t headerLen;
+
+    outbuf_reset(response);
+    outbuf_printf(response, "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+                            "Content-Length: %lu\r\n"
+                            "Connection: close\r\n\r\n", (unsigned long)body->len);
+    headerLen = response->len;
+    outbuf_append(response, body->data, body->len);
+    return headerLen;
+}
+
+int run_exporter(int fd, const char *address, uint32_t intervalMs)
+{
+    static struct st_rateEngine re;
+    struct st_statistics statistics;
+    struct st_info info;
+    struct st_exportSource src;
+    struct st_outBuf body;
+    struct st_outBuf response;
+    struct pollfd pfd;
+    size_t headerLen;
+    uint64_t interval;
+    uint64_t deadline;
+    uint64_t now;
+    int listenFd;
+    int timeout;
+
+    if(intervalMs == 0)
+    {
+        printf("ERROR: polling interval must be greater than 0\n");
+        return -1;
+    }
+
+    listenFd = exporter_listen(address);
+    if(listenFd < 0)
+        return -1;
+
+    rates_init(&re);
+    memset(&statistics, 0, sizeof(statistics));
+    memset(&info, 0, sizeof(info));
+    memset(&src, 0, sizeof(src));
+    src.statistics = &statistics;
+    src.info = &info;
+    src.rates = &re.rates;
+    src.labels = "";
+    outbuf_init(&body, 16384);
+    outbuf_init(&response, 16384);
+
+    stop_on_signal();
+    printf("serving OpenMetrics on \"%s\", refreshing every %u ms\n", address, intervalMs);
+    fflush(stdout);
+
+    interval = (uint64_t)intervalMs * 1000000ULL;
+    deadline = time_now_ns();
+    headerLen = 0;
+
+    while(!stopRequested)
+    {
+        now = time_now_ns();
+        if(now >= deadline)
+        {
+            if(hat_get_statistics(fd, &statistics) == 0)
+                rates_update(&re, time_now_ns(), &statistics);
+            else
+                src.ioctlErrors++;
+            if(hat_get_info(fd, &info) != 0)
+                src.ioctlErrors++;
+
+            outbuf_reset(&body);
+            exporter_format(&body, &src, 1);
+            headerLen = exporter_response(&response, &body);
+
+            deadline += interval;
+            if(deadline < now)
+                deadline = now + interval;
+            continue;
+        }
+
+        timeout = (int)((deadline - now + 999999) / 1000000);
+        pfd.fd = listenFd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN))
+            exporter_serve(listenFd, &response, headerLen);
+    }
+
+    close(listenFd);
+    if(!strncmp(address, "unix:", 5))
+        unlink(address + 5);
+    outbuf_free(&body);
+    outbuf_free(&response);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+    OpenMetrics exporter of the Moitessier HAT control program.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <stdint.h>
+#include "moitessier_ctrl.h"
+#include "rates.h"
+#include "outbuf.h"
+
+#define EXPORTER_DEFAULT_LISTEN     "127.0.0.1:9745"
+
+/* one HAT whose data is exported, labels are added to every sample (may be empty) */
+struct st_exportSource{
+    const struct st_statistics  *statistics;
+    const struct st_info        *info;
+    const struct st_rates       *rates;
+    uint64_t                    ioctlErrors;
+    const char                  *labels;    /* e.g. serial="..." */
+};
+
+/* appends the label name="value" to ob, '\\', '"' and new lines are escaped,
+   other control characters and non ASCII bytes are dropped. value is not
+   necessarily terminated (string fields of st_info). */
+void exporter_label(struct st_outBuf *ob, const char *name, const uint8_t *value, size_t size);
+
+/* formats the OpenMetrics exposition (including "# EOF") of all sources */
+void exporter_format(struct st_outBuf *ob, const struct st_exportSource *src, int n);
+
+/* socket helpers, shared with the multi device mode */
+int exporter_listen(const char *address);
+size_t exporter_response(struct st_outBuf *response, const struct st_outBuf *body);
+void exporter_serve(int listenFd, const struct st_outBuf *response, size_t headerLen);
+
+/* Listens on address ("unix:<PATH>" or "[<IPv4>:]<PORT>", loopback by default)
+   and serves the latest snapshot, which is refreshed every intervalMs. */
+int run_exporter(int fd, const char *address, uint32_t intervalMs);
+
+#endif /* EXPORTER_H */
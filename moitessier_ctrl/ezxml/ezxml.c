@@ -27,16 +27,54 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #ifndef EZXML_NOMMAP
 #include <sys/mman.h>
 #endif // EZXML_NOMMAP
 #include <sys/stat.h>
+#include <stdint.h>
 #include "ezxml.h"
 
+// Vectorized scanning of character data, selected at compile time. AVX2 needs
+// -mavx2 (or -march=...), NEON needs -mfpu=neon on 32 bit ARM (the Makefile
+// passes -mfpu=neon-vfpv4 for the Pi). Define EZXML_NOSIMD to use the scalar
+// fallback only.
+#ifndef EZXML_NOSIMD
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define EZXML_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define EZXML_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define EZXML_NEON
+#endif
+#endif // EZXML_NOSIMD
+
 #define EZXML_WS   "\t\r\n "  // whitespace
+#define EZXML_SP   "\t\n\v\f\r " // characters isspace() is true for
+#define EZXML_SCANL 8         // maximum number of characters ezxml_scan() looks for
 #define EZXML_ERRL 128        // maximum error string length
+#define EZXML_ALIGN 8         // alignment and header size of arena allocations
+#define EZXML_ARENA_MIN 4096  // smallest arena block
+#define EZXML_INDEX_MIN 8     // names or attributes searched before indexing
+#define EZXML_NAMES 64        // initial size of the interned names table
+#define EZXML_IOV 256         // pieces per writev() of ezxml_toxml_fd()
+
+typedef struct ezxml_block *ezxml_block_t;
+struct ezxml_block {      // arena block, the allocations follow the header
+    ezxml_block_t next;   // block filled before this one
+    size_t size;          // usable bytes
+    size_t used;          // bytes handed out
+    size_t last;          // offset of the last allocation, it can grow in place
+};
+
+#define EZXML_BLOCK ((sizeof(struct ezxml_block) + EZXML_ALIGN - 1) & \
+                     ~(size_t)(EZXML_ALIGN - 1))
 
 typedef struct ezxml_root *ezxml_root_t;
 struct ezxml_root {       // additional data for the root tag
@@ -52,22 +90,234 @@ struct ezxml_root {       // additional data for the root tag
     char ***pi;           // processing instructions
     short standalone;     // non-zero if <?xml standalone="yes"?>
     char err[EZXML_ERRL]; // error string
+    ezxml_block_t arena;  // current arena block, NULL if allocated by malloc()
+    short dirty;          // arena tree holds malloced strings or tags
+    struct ezxml_stats stats; // allocation counters
+    char **names;         // interned tag names, hash table
+    size_t nmask;         // size of names - 1
+    size_t nnames;        // number of interned names
+    ezxml_t last;         // last sub tag of cur while parsing, NULL if none
+    size_t tlen;          // length of the character content of cur while parsing
+};
+
+struct ezxml_slot {       // sub tags of one name in an index
+    const char *name;     // tag name, NULL for an empty slot
+    size_t hash;          // ezxml_hash() of name
+    size_t n;             // number of tags
+    ezxml_t *tags;        // tags in next order
+};
+
+struct ezxml_index {      // lookup index of a tag, see ezxml_index()
+    size_t mask;          // name slots - 1
+    struct ezxml_slot *slot; // sub tags by name
+    size_t amask;         // attribute slots - 1
+    int *attr;            // attribute positions by name, -1 if empty
+    int end;              // position of the attribute list terminator
 };
 
 char *EZXML_NIL[] = { NULL }; // empty, null terminated array of strings
 
+// adds a block of at least size usable bytes to the arena of root
+static ezxml_block_t ezxml_block(ezxml_root_t root, size_t size)
+{
+    ezxml_block_t b;
+
+    if (root->arena && size < root->arena->size * 2)
+        size = root->arena->size * 2; // grow geometrically
+    if (size < EZXML_ARENA_MIN) size = EZXML_ARENA_MIN;
+    if (! (b = malloc(EZXML_BLOCK + size))) return NULL;
+    b->next = root->arena;
+    b->size = size;
+    b->used = b->last = 0;
+    root->stats.allocs++;
+    root->stats.arena_bytes += size;
+    return root->arena = b;
+}
+
+// Allocates from the arena of root, or with malloc() if the document has none.
+// root may be NULL for tags that do not belong to a parsed document.
+static void *ezxml_alloc(ezxml_root_t root, size_t size)
+{
+    ezxml_block_t b;
+    size_t n = EZXML_ALIGN + ((size + EZXML_ALIGN - 1) & ~(size_t)(EZXML_ALIGN - 1));
+    char *p;
+
+    if (! root || ! root->arena) {
+        if (root) root->stats.allocs++;
+        return malloc(size);
+    }
+    b = root->arena;
+    if (b->used + n > b->size && ! (b = ezxml_block(root, n))) return NULL;
+
+    p = (char *)b + EZXML_BLOCK + b->used;
+    *(size_t *)p = size; // header, needed by ezxml_realloc()
+    b->last = b->used;
+    b->used += n;
+    root->stats.arena_allocs++;
+    return p + EZXML_ALIGN;
+}
+
+// realloc() counterpart of ezxml_alloc(). The last arena allocation grows in
+// place if the block has room, others are moved to twice their size, so that
+// text appended piece by piece costs linear time.
+static void *ezxml_realloc(ezxml_root_t root, void *m, size_t size)
+{
+    ezxml_block_t b;
+    size_t n = EZXML_ALIGN + ((size + EZXML_ALIGN - 1) & ~(size_t)(EZXML_ALIGN - 1));
+    size_t old;
+    char *p;
+
+    if (! root || ! root->arena) {
+        if (root) root->stats.allocs++;
+        return realloc(m, size);
+    }
+    if (! m) return ezxml_alloc(root, size);
+
+    b = root->arena;
+    old = *(size_t *)((char *)m - EZXML_ALIGN);
+    if (size <= old) return m; // arena memory never shrinks
+    if ((char *)m - EZXML_ALIGN == (char *)b + EZXML_BLOCK + b->last &&
+        b->last + n <= b->size) { // last allocation of the block
+        *(size_t *)((char *)m - EZXML_ALIGN) = size;
+        b->used = b->last + n;
+        root->stats.arena_allocs++;
+        return m;
+    }
+    if ((p = ezxml_alloc(root, (size < old * 2) ? old * 2 : size)))
+        memcpy(p, m, old);
+    return p;
+}
+
+// free() counterpart of ezxml_alloc(), arena memory is released with the root
+static void ezxml_release(ezxml_root_t root, void *m)
+{
+    if (! root || ! root->arena) free(m);
+}
+
+// returns the root of the document if xml is allocated from its arena
+static ezxml_root_t ezxml_arena_root(ezxml_t xml)
+{
+    if (! xml || ! (xml->flags & EZXML_ARENA)) return NULL;
+    while (xml->parent) xml = xml->parent;
+    return (ezxml_root_t)xml;
+}
+
+// FNV-1a hash of a tag or attribute name
+static size_t ezxml_hash(const char *s)
+{
+    size_t h = 2166136261u;
+
+    while (*s) h = (h ^ (unsigned char)*(s++)) * 16777619u;
+    return h;
+}
+
+// non-zero if the names are equal, interned names are equal pointers
+static int ezxml_same(const char *a, const char *b)
+{
+    return a == b || ! strcmp(a, b);
+}
+
+// drops the lookup index of xml after a change of its sub tags or attributes
+static void ezxml_unindex(ezxml_t xml)
+{
+    if (! xml || ! xml->index) return;
+    ezxml_release(ezxml_arena_root(xml), xml->index);
+    xml->index = NULL;
+}
+
+// Returns the lookup index of xml, building it if there is none. Sub tags
+// are hashed by name, each slot holds the tags of one name in order, and
+// attributes are hashed to their position. Returns NULL if out of memory.
+static struct ezxml_index *ezxml_index(ezxml_t xml)
+{
+    struct ezxml_index *idx;
+    struct ezxml_slot *sl;
+    ezxml_t c, t, *tags;
+    size_t n = 0, d = 0, m, am, h;
+    int a, i;
+
+    if (xml->index) return xml->index;
+    for (c = xml->child; c; c = c->ordered) n++; // sub tags
+    for (c = xml->child; c; c = c->sibling) d++; // distinct names
+    for (a = 0; xml->attr[a]; a += 2);
+    for (m = 1; m < d * 2; m *= 2); // at most half full
+    for (am = 1; am < (size_t)a; am *= 2);
+
+    if (! (idx = ezxml_alloc(ezxml_arena_root(xml), sizeof(struct ezxml_index)
+                             + m * sizeof(struct ezxml_slot) +
+                             n * sizeof(ezxml_t) + am * sizeof(int))))
+        return NULL;
+    idx->slot = memset(idx + 1, '\0', m * sizeof(struct ezxml_slot));
+    tags = (ezxml_t *)(idx->slot + m);
+    idx->attr = memset(tags + n, 0xFF, am * sizeof(int)); // all -1
+    idx->mask = m - 1;
+    idx->amask = am - 1;
+    idx->end = a;
+
+    for (c = xml->child; c; c = c->sibling) { // one slot per name
+        for (h = ezxml_hash(c->name), i = h & idx->mask; idx->slot[i].name;
+             i = (i + 1) & idx->mask);
+        sl = &idx->slot[i];
+        sl->name = c->name;
+        sl->hash = h;
+        for (sl->tags = tags, t = c; t; t = t->next) tags[sl->n++] = t;
+        tags += sl->n;
+    }
+    for (a = 0; xml->attr[a]; a += 2) { // first of duplicate names wins
+        for (i = ezxml_hash(xml->attr[a]) & idx->amask; idx->attr[i] >= 0 &&
+             strcmp(xml->attr[idx->attr[i]], xml->attr[a]);
+             i = (i + 1) & idx->amask);
+        if (idx->attr[i] < 0) idx->attr[i] = a;
+    }
+    return xml->index = idx;
+}
+
+// returns the index slot of the sub tags of xml with the given name or NULL
+static struct ezxml_slot *ezxml_index_tags(ezxml_t xml, const char *name)
+{
+    struct ezxml_index *idx = ezxml_index(xml);
+    size_t h = ezxml_hash(name), i;
+
+    if (! idx) return NULL;
+    for (i = h & idx->mask; idx->slot[i].name; i = (i + 1) & idx->mask)
+        if (idx->slot[i].hash == h && ezxml_same(idx->slot[i].name, name))
+            return &idx->slot[i];
+    return NULL;
+}
+
 // returns the first child tag with the given name or NULL if not found
 ezxml_t ezxml_child(ezxml_t xml, const char *name)
 {
-    xml = (xml) ? xml->child : NULL;
-    while (xml && strcmp(name, xml->name)) xml = xml->sibling;
-    return xml;
+    struct ezxml_slot *sl;
+    ezxml_t c = (xml) ? xml->child : NULL;
+    int i;
+
+    for (i = 0; c && i < EZXML_INDEX_MIN; i++, c = c->sibling)
+        if (ezxml_same(name, c->name)) return c;
+    if (! c) return NULL;
+
+    if (ezxml_index(xml)) { // many names, use the index
+        sl = ezxml_index_tags(xml, name);
+        return (sl) ? sl->tags[0] : NULL;
+    }
+    while (c && strcmp(name, c->name)) c = c->sibling; // out of memory
+    return c;
 }
 
 // returns the Nth tag with the same name in the same subsection or NULL if not
 // found
 ezxml_t ezxml_idx(ezxml_t xml, int idx)
 {
+    struct ezxml_slot *sl;
+    int i;
+
+    for (i = 0; xml && idx && i < EZXML_INDEX_MIN; idx--, i++) xml = xml->next;
+    if (! xml || ! idx) return xml;
+
+    // a long list, if it started at the first tag the index has its position
+    if (xml->parent && (sl = ezxml_index_tags(xml->parent, xml->name)) &&
+        (size_t)i < sl->n && sl->tags[i] == xml)
+        return ((size_t)idx < sl->n - i) ? sl->tags[i + idx] : NULL;
     for (; xml && idx; idx--) xml = xml->next;
     return xml;
 }
@@ -75,11 +325,22 @@ ezxml_t ezxml_idx(ezxml_t xml, int idx)
 // returns the value of the requested tag attribute or NULL if not found
 const char *ezxml_attr(ezxml_t xml, const char *attr)
 {
+    struct ezxml_index *idx;
     int i = 0, j = 1;
+    size_t k;
     ezxml_root_t root = (ezxml_root_t)xml;
 
     if (! xml || ! xml->attr) return NULL;
-    while (xml->attr[i] && strcmp(attr, xml->attr[i])) i += 2;
+    while (xml->attr[i] && strcmp(attr, xml->attr[i])) {
+        if ((i += 2) == EZXML_INDEX_MIN * 2 && xml->attr[i] &&
+            (idx = ezxml_index(xml))) { // many attributes, use index
+            for (k = ezxml_hash(attr) & idx->amask; idx->attr[k] >= 0 &&
+                 strcmp(attr, xml->attr[idx->attr[k]]);
+                 k = (k + 1) & idx->amask);
+            i = (idx->attr[k] >= 0) ? idx->attr[k] : idx->end;
+            break;
+        }
+    }
     if (xml->attr[i]) return xml->attr[i + 1]; // found attribute
 
     while (root->xml.parent) root = (ezxml_root_t)root->xml.parent; // root tag
@@ -132,6 +393,63 @@ const char **ezxml_pi(ezxml_t xml, const char *target)
     return (const char **)((root->pi[i]) ? root->pi[i] + 1 : EZXML_NIL);
 }
 
+// returns 1 if c is '\0' or one of the characters in set
+static int ezxml_in(char c, const char *set)
+{
+    if (! c) return 1;
+    while (*set) if (*(set++) == c) return 1;
+    return 0;
+}
+
+// Returns the first character of [s, e) that is '\0' or one of the characters
+// in set (at most EZXML_SCANL), or e if there is none. Ordinary character data
+// is skipped a block at a time, loads never reach beyond e.
+static char *ezxml_scan(char *s, char *e, const char *set)
+{
+#if defined(EZXML_AVX2)
+    __m256i v[EZXML_SCANL], x, hit;
+    unsigned int mask;
+    int i, n;
+
+    for (n = 0; set[n]; n++) v[n] = _mm256_set1_epi8(set[n]);
+    for (; e - s >= 32; s += 32) {
+        x = _mm256_loadu_si256((const __m256i *)s);
+        hit = _mm256_cmpeq_epi8(x, _mm256_setzero_si256());
+        for (i = 0; i < n; i++) hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, v[i]));
+        if ((mask = (unsigned int)_mm256_movemask_epi8(hit)))
+            return s + __builtin_ctz(mask);
+    }
+#elif defined(EZXML_SSE2)
+    __m128i v[EZXML_SCANL], x, hit;
+    unsigned int mask;
+    int i, n;
+
+    for (n = 0; set[n]; n++) v[n] = _mm_set1_epi8(set[n]);
+    for (; e - s >= 16; s += 16) {
+        x = _mm_loadu_si128((const __m128i *)s);
+        hit = _mm_cmpeq_epi8(x, _mm_setzero_si128());
+        for (i = 0; i < n; i++) hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, v[i]));
+        if ((mask = (unsigned int)_mm_movemask_epi8(hit)))
+            return s + __builtin_ctz(mask);
+    }
+#elif defined(EZXML_NEON)
+    uint8x16_t v[EZXML_SCANL], x, hit;
+    uint8x8_t r;
+    int i, n;
+
+    for (n = 0; set[n]; n++) v[n] = vdupq_n_u8((uint8_t)set[n]);
+    for (; e - s >= 16; s += 16) {
+        x = vld1q_u8((const uint8_t *)s);
+        hit = vceqq_u8(x, vdupq_n_u8(0));
+        for (i = 0; i < n; i++) hit = vorrq_u8(hit, vceqq_u8(x, v[i]));
+        r = vorr_u8(vget_low_u8(hit), vget_high_u8(hit)); // no movemask on NEON
+        if (vget_lane_u64(vreinterpret_u64_u8(r), 0)) break; // in this block
+    }
+#endif
+    while (s < e && ! ezxml_in(*s, set)) s++;
+    return s;
+}
+
 // set an error string and return root
 ezxml_t ezxml_err(ezxml_root_t root, char *s, const char *err, ...)
 {
@@ -155,23 +473,36 @@ ezxml_t ezxml_err(ezxml_root_t root, char *s, const char *err, ...)
 // for cdata sections, ' ' for attribute normalization, or '*' for non-cdata
 // attribute normalization. Returns s, or if the decoded string is longer than
 // s, returns a malloced string that must be freed.
-char *ezxml_decode(char *s, char **ent, char t)
+char *ezxml_decode(ezxml_root_t root, char *s, char **ent, char t)
 {
-    char *e, *r = s, *m = s;
+    char *e, *r = s, *m = s, *w, *end = s + strlen(s);
+    const char *set;
     long b, c, d, l;
 
-    for (; *s; s++) { // normalize line endings
-        while (*s == '\r') {
-            *(s++) = '\n';
-            if (*s == '\n') memmove(s, (s + 1), strlen(s));
+    if (*(s = ezxml_scan(r, end, "\r"))) { // normalize line endings
+        for (w = s; s < end; ) { // \r\n and \r become \n
+            if (*s == '\r') {
+                *(w++) = '\n';
+                s += (s[1] == '\n') ? 2 : 1;
+            }
+            else {
+                e = ezxml_scan(s, end, "\r");
+                memmove(w, s, e - s);
+                w += e - s;
+                s = e;
+            }
         }
+        memset(w, '\0', end - w); // no stale new lines for ezxml_err()
+        end = w;
     }
-    
-    for (s = r; ; ) {
-        while (*s && *s != '&' && (*s != '%' || t != '%') && !isspace(*s)) s++;
+
+    // characters that may need decoding, nothing does in cdata sections
+    set = (t == '%') ? "&%" : (t == ' ' || t == '*') ? "&" EZXML_SP : "&";
+    for (s = r; t != 'c'; ) {
+        s = ezxml_scan(s, end, set);
 
         if (! *s) break;
-        else if (t != 'c' && ! strncmp(s, "&#", 2)) { // character reference
+        else if (! strncmp(s, "&#", 2)) { // character reference
             if (s[2] == 'x') c = strtol(s + 3, &e, 16); // base 16
             else c = strtol(s + 2, &e, 10); // base 10
             if (! c || *e != ';') { s++; continue; } // not a character ref
@@ -184,7 +515,9 @@ char *ezxml_decode(char *s, char **ent, char t)
                 while (b) *(s++) = 0x80 | ((c >> (6 * --b)) & 0x3F); // payload
             }
 
-            memmove(s, strchr(s, ';') + 1, strlen(strchr(s, ';')));
+            e = strchr(s, ';');
+            memmove(s, e + 1, end - e); // shift rest of string
+            end = s + (end - e) - 1;
         }
         else if ((*s == '&' && (t == '&' || t == ' ' || t == '*')) ||
                  (*s == '%' && t == '%')) { // entity reference
@@ -192,14 +525,18 @@ char *ezxml_decode(char *s, char **ent, char t)
                  b += 2); // find entity in entity list
 
             if (ent[b++]) { // found a match
-                if ((c = strlen(ent[b])) - 1 > (e = strchr(s, ';')) - s) {
-                    l = (d = (s - r)) + c + strlen(e); // new length
-                    r = (r == m) ? strcpy(malloc(l), r) : realloc(r, l);
+                e = strchr(s, ';');
+                l = end - e; // rest of the string starting at ;
+                if ((c = strlen(ent[b])) - 1 > e - s) {
+                    d = s - r; // new length is d + c + l
+                    r = (r == m) ? strcpy(ezxml_alloc(root, d + c + l), r)
+                                 : ezxml_realloc(root, r, d + c + l);
                     e = strchr((s = r + d), ';'); // fix up pointers
                 }
 
-                memmove(s + c, e + 1, strlen(e)); // shift rest of string
+                memmove(s + c, e + 1, l); // shift rest of string
                 strncpy(s, ent[b], c); // copy in replacement text
+                end = s + c + l - 1;
             }
             else s++; // not a known entity
         }
@@ -217,16 +554,72 @@ char *ezxml_decode(char *s, char **ent, char t)
     return r;
 }
 
+// Returns the interned copy of the tag name s of a parsed document, s itself
+// if it is the first of its name. Tags of the same name share one string.
+static char *ezxml_intern(ezxml_root_t root, char *s)
+{
+    char **t;
+    size_t i, j, m;
+
+    if ((root->nnames + 1) * 2 > root->nmask + 1) { // at most half full
+        m = (root->names) ? (root->nmask + 1) * 2 : EZXML_NAMES;
+        if (! (t = ezxml_alloc(root, m * sizeof(char *)))) return s;
+        memset(t, '\0', m * sizeof(char *));
+        for (i = 0; root->names && i <= root->nmask; i++) { // rehash
+            if (! root->names[i]) continue;
+            for (j = ezxml_hash(root->names[i]) & (m - 1); t[j];
+                 j = (j + 1) & (m - 1));
+            t[j] = root->names[i];
+        }
+        ezxml_release(root, root->names);
+        root->names = t;
+        root->nmask = m - 1;
+    }
+    for (i = ezxml_hash(s) & root->nmask; root->names[i];
+         i = (i + 1) & root->nmask)
+        if (! strcmp(root->names[i], s)) return root->names[i];
+    root->nnames++;
+    return root->names[i] = s;
+}
+
+// Allocates a tag and inserts it into xml. While parsing, prev is the last
+// sub tag of xml so far, a tag of the same name is appended after it without
+// searching the sub tag lists. NULL otherwise.
+static ezxml_t ezxml_add_tag(ezxml_root_t root, ezxml_t xml, const char *name,
+                             size_t off, ezxml_t prev)
+{
+    ezxml_t child;
+
+    if (! xml) return NULL;
+    child = (ezxml_t)memset(ezxml_alloc(root, sizeof(struct ezxml)), '\0',
+                            sizeof(struct ezxml));
+    child->name = (char *)name;
+    child->attr = EZXML_NIL;
+    child->txt = "";
+    if (root && root->arena) child->flags = EZXML_ARENA;
+
+    if (prev && prev->name == name) { // interned, so the same name
+        child->parent = xml;
+        child->off = off;
+        return prev->ordered = prev->next = child;
+    }
+    return ezxml_insert(child, xml, off);
+}
+
 // called when parser finds start of new tag
 void ezxml_open_tag(ezxml_root_t root, char *name, char **attr)
 {
     ezxml_t xml = root->cur;
-    
-    if (xml->name) xml = ezxml_add_child(xml, name, strlen(xml->txt));
+
+    name = ezxml_intern(root, name);
+    if (xml->name)
+        xml = ezxml_add_tag(root, xml, name, root->tlen, root->last);
     else xml->name = name; // first open tag
 
     xml->attr = attr;
     root->cur = xml; // update tag insertion point
+    root->last = NULL; // no sub tags yet
+    root->tlen = 0; // no character content yet
 }
 
 // called when parser finds character content between open and closing tag
@@ -239,18 +632,22 @@ void ezxml_char_content(ezxml_root_t root, char *s, size_t len, char t)
     if (! xml || ! xml->name || ! len) return; // sanity check
 
     s[len] = '\0'; // null terminate text (calling functions anticipate this)
-    len = strlen(s = ezxml_decode(s, root->ent, t)) + 1;
+    len = strlen(s = ezxml_decode(root, s, root->ent, t)) + 1;
 
     if (! *(xml->txt)) xml->txt = s; // initial character content
     else { // allocate our own memory and make a copy
-        xml->txt = (xml->flags & EZXML_TXTM) // allocate some space
-                   ? realloc(xml->txt, (l = strlen(xml->txt)) + len)
-                   : strcpy(malloc((l = strlen(xml->txt)) + len), xml->txt);
+        l = root->tlen; // strlen(xml->txt), counting would be quadratic
+        xml->txt = ((xml->flags & EZXML_TXTM) || (root->arena && // arena text
+                    (xml->txt < root->s || xml->txt > root->e)))
+                   ? ezxml_realloc(root, xml->txt, l + len)
+                   : strcpy(ezxml_alloc(root, l + len), xml->txt);
         strcpy(xml->txt + l, s); // add new char content
-        if (s != m) free(s); // free s if it was malloced by ezxml_decode()
+        if (s != m) ezxml_release(root, s); // s was allocated by ezxml_decode()
     }
+    root->tlen += len - 1;
 
-    if (xml->txt != m) ezxml_set_flag(xml, EZXML_TXTM);
+    // arena memory is not flagged, EZXML_TXTM means it has to be freed
+    if (xml->txt != m && ! root->arena) ezxml_set_flag(xml, EZXML_TXTM);
 }
 
 // called when parser finds closing tag
@@ -259,6 +656,8 @@ ezxml_t ezxml_close_tag(ezxml_root_t root, char *name, char *s)
     if (! root->cur || ! root->cur->name || strcmp(name, root->cur->name))
         return ezxml_err(root, s, "unexpected closing tag </%s>", name);
 
+    root->last = root->cur; // last sub tag of the parent so far
+    root->tlen = root->cur->off; // the parent's content ends where cur started
     root->cur = root->cur->parent;
     return NULL;
 }
@@ -296,20 +695,21 @@ void ezxml_proc_inst(ezxml_root_t root, char *s, size_t len)
         return;
     }
 
-    if (! root->pi[0]) *(root->pi = malloc(sizeof(char **))) = NULL; //first pi
+    if (! root->pi[0]) //first pi
+        *(root->pi = ezxml_alloc(root, sizeof(char **))) = NULL;
 
     while (root->pi[i] && strcmp(target, root->pi[i][0])) i++; // find target
     if (! root->pi[i]) { // new target
-        root->pi = realloc(root->pi, sizeof(char **) * (i + 2));
-        root->pi[i] = malloc(sizeof(char *) * 3);
+        root->pi = ezxml_realloc(root, root->pi, sizeof(char **) * (i + 2));
+        root->pi[i] = ezxml_alloc(root, sizeof(char *) * 3);
         root->pi[i][0] = target;
         root->pi[i][1] = (char *)(root->pi[i + 1] = NULL); // terminate pi list
-        root->pi[i][2] = strdup(""); // empty document position list
+        root->pi[i][2] = strcpy(ezxml_alloc(root, 1), ""); // empty position list
     }
 
     while (root->pi[i][j]) j++; // find end of instruction list for this target
-    root->pi[i] = realloc(root->pi[i], sizeof(char *) * (j + 3));
-    root->pi[i][j + 2] = realloc(root->pi[i][j + 1], j + 1);
+    root->pi[i] = ezxml_realloc(root, root->pi[i], sizeof(char *) * (j + 3));
+    root->pi[i][j + 2] = ezxml_realloc(root, root->pi[i][j + 1], j + 1);
     strcpy(root->pi[i][j + 2] + j - 1, (root->xml.name) ? ">" : "<");
     root->pi[i][j + 1] = NULL; // null terminate pi list for this target
     root->pi[i][j] = s; // set instruction
@@ -321,7 +721,8 @@ short ezxml_internal_dtd(ezxml_root_t root, char *s, size_t len)
     char q, *c, *t, *n = NULL, *v, **ent, **pe;
     int i, j;
     
-    pe = memcpy(malloc(sizeof(EZXML_NIL)), EZXML_NIL, sizeof(EZXML_NIL));
+    pe = memcpy(ezxml_alloc(root, sizeof(EZXML_NIL)), EZXML_NIL,
+                sizeof(EZXML_NIL));
 
     for (s[len] = '\0'; s; ) {
         while (*s && *s != '<' && *s != '%') s++; // find next declaration
@@ -339,16 +740,16 @@ short ezxml_internal_dtd(ezxml_root_t root, char *s, size_t len)
             }
 
             for (i = 0, ent = (*c == '%') ? pe : root->ent; ent[i]; i++);
-            ent = realloc(ent, (i + 3) * sizeof(char *)); // space for next ent
+            ent = ezxml_realloc(root, ent, (i + 3) * sizeof(char *)); // next ent
             if (*c == '%') pe = ent;
             else root->ent = ent;
 
             *(++s) = '\0'; // null terminate name
             if ((s = strchr(v, q))) *(s++) = '\0'; // null terminate value
-            ent[i + 1] = ezxml_decode(v, pe, '%'); // set value
+            ent[i + 1] = ezxml_decode(root, v, pe, '%'); // set value
             ent[i + 2] = NULL; // null terminate entity list
             if (! ezxml_ent_ok(n, ent[i + 1], ent)) { // circular reference
-                if (ent[i + 1] != v) free(ent[i + 1]);
+                if (ent[i + 1] != v) ezxml_release(root, ent[i + 1]);
                 ezxml_err(root, v, "circular entity declaration &%s", n);
                 break;
             }
@@ -385,21 +786,21 @@ short ezxml_internal_dtd(ezxml_root_t root, char *s, size_t len)
                 else { ezxml_err(root, t, "malformed <!ATTLIST"); break; }
 
                 if (! root->attr[i]) { // new tag name
-                    root->attr = (! i) ? malloc(2 * sizeof(char **))
-                                       : realloc(root->attr,
+                    root->attr = (! i) ? ezxml_alloc(root, 2 * sizeof(char **))
+                                       : ezxml_realloc(root, root->attr,
                                                  (i + 2) * sizeof(char **));
-                    root->attr[i] = malloc(2 * sizeof(char *));
+                    root->attr[i] = ezxml_alloc(root, 2 * sizeof(char *));
                     root->attr[i][0] = t; // set tag name
                     root->attr[i][1] = (char *)(root->attr[i + 1] = NULL);
                 }
 
                 for (j = 1; root->attr[i][j]; j += 3); // find end of list
-                root->attr[i] = realloc(root->attr[i],
-                                        (j + 4) * sizeof(char *));
+                root->attr[i] = ezxml_realloc(root, root->attr[i],
+                                              (j + 4) * sizeof(char *));
 
                 root->attr[i][j + 3] = NULL; // null terminate list
                 root->attr[i][j + 2] = c; // is it cdata?
-                root->attr[i][j + 1] = (v) ? ezxml_decode(v, root->ent, *c)
+                root->attr[i][j + 1] = (v) ? ezxml_decode(root, v, root->ent, *c)
                                            : NULL;
                 root->attr[i][j] = n; // attribute name 
             }
@@ -413,13 +814,13 @@ short ezxml_internal_dtd(ezxml_root_t root, char *s, size_t len)
         else if (*(s++) == '%' && ! root->standalone) break;
     }
 
-    free(pe);
+    ezxml_release(root, pe);
     return ! *root->err;
 }
 
 // Converts a UTF-16 string to UTF-8. Returns a new string that must be freed
 // or NULL if no conversion was needed.
-char *ezxml_str2utf8(char **s, size_t *len)
+char *ezxml_str2utf8(ezxml_root_t root, char **s, size_t *len)
 {
     char *u;
     size_t l = 0, sl, max = *len;
@@ -428,7 +829,7 @@ char *ezxml_str2utf8(char **s, size_t *len)
 
     if (be == -1) return NULL; // not UTF-16
 
-    u = malloc(max);
+    u = ezxml_alloc(root, max);
     for (sl = 2; sl < *len - 1; sl += 2) {
         c = (be) ? (((*s)[sl] & 0xFF) << 8) | ((*s)[sl + 1] & 0xFF)  //UTF-16BE
                  : (((*s)[sl + 1] & 0xFF) << 8) | ((*s)[sl] & 0xFF); //UTF-16LE
@@ -438,7 +839,7 @@ char *ezxml_str2utf8(char **s, size_t *len)
             c = (((c & 0x3FF) << 10) | (d & 0x3FF)) + 0x10000;
         }
 
-        while (l + 6 > max) u = realloc(u, max += EZXML_BUFSIZE);
+        while (l + 6 > max) u = ezxml_realloc(root, u, max += EZXML_BUFSIZE);
         if (c < 0x80) u[l++] = c; // US-ASCII subset
         else { // multi-byte UTF-8 sequence
             for (b = 0, d = c; d; d /= 2) b++; // bits in c
@@ -447,11 +848,12 @@ char *ezxml_str2utf8(char **s, size_t *len)
             while (b) u[l++] = 0x80 | ((c >> (6 * --b)) & 0x3F); // payload
         }
     }
-    return *s = realloc(u, *len = l);
+    return *s = ezxml_realloc(root, u, *len = l);
 }
 
-// frees a tag attribute list
-void ezxml_free_attr(char **attr) {
+// frees a tag attribute list, the lists of arena tags are released with the
+// arena, only strduped names and values are freed
+void ezxml_free_attr(char **attr, short arena) {
     int i = 0;
     char *m;
     
@@ -462,26 +864,67 @@ void ezxml_free_attr(char **attr) {
         if (m[i] & EZXML_NAMEM) free(attr[i * 2]);
         if (m[i] & EZXML_TXTM) free(attr[(i * 2) + 1]);
     }
+    if (arena) return;
     free(m);
     free(attr);
 }
 
+// returns a new empty root tag, with EZXML_OPT_ARENA the root and the tags
+// of its document are allocated from an arena of about size bytes
+static ezxml_root_t ezxml_new_root(const char *name, int opt, size_t size)
+{
+    static char *ent[] = { "lt;", "&#60;", "gt;", "&#62;", "quot;", "&#34;",
+                           "apos;", "&#39;", "amp;", "&#38;", NULL };
+    struct ezxml_root tmp;
+    ezxml_root_t root;
+
+    if (opt & EZXML_OPT_ARENA) { // the root is the first arena allocation
+        memset(&tmp, '\0', sizeof(struct ezxml_root));
+        if (! ezxml_block(&tmp, sizeof(struct ezxml_root) + size * 2 +
+                          EZXML_NAMES * sizeof(char *))) // and interned names
+            return NULL;
+        root = memset(ezxml_alloc(&tmp, sizeof(struct ezxml_root)), '\0',
+                      sizeof(struct ezxml_root));
+        root->arena = tmp.arena;
+        root->stats = tmp.stats;
+        root->xml.flags = EZXML_ARENA;
+    }
+    else {
+        root = memset(malloc(sizeof(struct ezxml_root)), '\0',
+                      sizeof(struct ezxml_root));
+        root->stats.allocs = 1;
+    }
+    root->xml.name = (char *)name;
+    root->cur = &root->xml;
+    strcpy(root->err, root->xml.txt = "");
+    root->ent = memcpy(ezxml_alloc(root, sizeof(ent)), ent, sizeof(ent));
+    root->attr = root->pi = (char ***)(root->xml.attr = EZXML_NIL);
+    return root;
+}
+
 // parse the given xml string and return an ezxml structure
 ezxml_t ezxml_parse_str(char *s, size_t len)
 {
-    ezxml_root_t root = (ezxml_root_t)ezxml_new(NULL);
+    return ezxml_parse_str_opt(s, len, 0);
+}
+
+// same as ezxml_parse_str() with parser options
+ezxml_t ezxml_parse_str_opt(char *s, size_t len, int opt)
+{
+    ezxml_root_t root = ezxml_new_root(NULL, opt, len);
     char q, e, *d, **attr, **a = NULL; // initialize a to avoid compile warning
     int l, i, j;
 
+    if (! root) return NULL;
     root->m = s;
     if (! len) return ezxml_err(root, NULL, "root tag missing");
-    root->u = ezxml_str2utf8(&s, &len); // convert utf-16 to utf-8
+    root->u = ezxml_str2utf8(root, &s, &len); // convert utf-16 to utf-8
     root->e = (root->s = s) + len; // record start and end of work area
     
     e = s[len - 1]; // save end char
     s[len - 1] = '\0'; // turn end char into null terminator
 
-    while (*s && *s != '<') s++; // find first tag
+    s = ezxml_scan(s, root->e, "<"); // find first tag
     if (! *s) return ezxml_err(root, s, "root tag missing");
 
     for (; ; ) {
@@ -499,10 +942,10 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
                 for (i = 0; (a = root->attr[i]) && strcmp(a[0], d); i++);
 
             for (l = 0; *s && *s != '/' && *s != '>'; l += 2) { // new attrib
-                attr = (l) ? realloc(attr, (l + 4) * sizeof(char *))
-                           : malloc(4 * sizeof(char *)); // allocate space
-                attr[l + 3] = (l) ? realloc(attr[l + 1], (l / 2) + 2)
-                                  : malloc(2); // mem for list of maloced vals
+                attr = (l) ? ezxml_realloc(root, attr, (l + 4) * sizeof(char *))
+                           : ezxml_alloc(root, 4 * sizeof(char *)); // space
+                attr[l + 3] = (l) ? ezxml_realloc(root, attr[l + 1], (l / 2) + 2)
+                                  : ezxml_alloc(root, 2); // list of maloced vals
                 strcpy(attr[l + 3] + (l / 2), " "); // value is not malloced
                 attr[l + 2] = NULL; // null terminate list
                 attr[l + 1] = ""; // temporary attribute value
@@ -514,17 +957,17 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
                     q = *(s += strspn(s, EZXML_WS "="));
                     if (q == '"' || q == '\'') { // attribute value
                         attr[l + 1] = ++s;
-                        while (*s && *s != q) s++;
+                        s = ezxml_scan(s, root->e, (q == '"') ? "\"" : "'");
                         if (*s) *(s++) = '\0'; // null terminate attribute val
                         else {
-                            ezxml_free_attr(attr);
+                            ezxml_free_attr(attr, root->arena != NULL);
                             return ezxml_err(root, d, "missing %c", q);
                         }
 
                         for (j = 1; a && a[j] && strcmp(a[j], attr[l]); j +=3);
-                        attr[l + 1] = ezxml_decode(attr[l + 1], root->ent, (a
-                                                   && a[j]) ? *a[j + 2] : ' ');
-                        if (attr[l + 1] < d || attr[l + 1] > s)
+                        attr[l + 1] = ezxml_decode(root, attr[l + 1], root->ent,
+                                                   (a && a[j]) ? *a[j + 2] : ' ');
+                        if ((attr[l + 1] < d || attr[l + 1] > s) && ! root->arena)
                             attr[l + 3][l / 2] = EZXML_TXTM; // value malloced
                     }
                 }
@@ -534,7 +977,7 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
             if (*s == '/') { // self closing tag
                 *(s++) = '\0';
                 if ((*s && *s != '>') || (! *s && e != '>')) {
-                    if (l) ezxml_free_attr(attr);
+                    if (l) ezxml_free_attr(attr, root->arena != NULL);
                     return ezxml_err(root, d, "missing >");
                 }
                 ezxml_open_tag(root, d, attr);
@@ -546,7 +989,7 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
                 *s = q;
             }
             else {
-                if (l) ezxml_free_attr(attr);
+                if (l) ezxml_free_attr(attr, root->arena != NULL);
                 return ezxml_err(root, d, "missing >"); 
             }
         }
@@ -573,7 +1016,11 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
             if (! *s && e != '>')
                 return ezxml_err(root, d, "unclosed <!DOCTYPE");
             d = (l) ? strchr(d, '[') + 1 : d;
-            if (l && ! ezxml_internal_dtd(root, d, s++ - d)) return &root->xml;
+            if (l) {
+                q = *s; // ezxml_internal_dtd() null terminates the subset
+                if (! ezxml_internal_dtd(root, d, s - d)) return &root->xml;
+                if (q) s++; // not past the end when the subset ends the document
+            }
         }
         else if (*s == '?') { // <?...?> processing instructions
             do { s = strchr(s, '?'); } while (s && *(++s) && *s != '>');
@@ -587,7 +1034,7 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
         *s = '\0';
         d = ++s;
         if (*s && *s != '<') { // tag character content
-            while (*s && *s != '<') s++;
+            s = ezxml_scan(s, root->e, "<");
             if (*s) ezxml_char_content(root, d, s - d, '&');
             else break;
         }
@@ -604,48 +1051,99 @@ ezxml_t ezxml_parse_str(char *s, size_t len)
 // or ezxml_parse_fd()
 ezxml_t ezxml_parse_fp(FILE *fp)
 {
-    ezxml_root_t root;
-    size_t l, len = 0;
-    char *s;
+    return ezxml_parse_fp_opt(fp, 0);
+}
 
-    if (! (s = malloc(EZXML_BUFSIZE))) return NULL;
-    do {
-        len += (l = fread((s + len), 1, EZXML_BUFSIZE, fp));
-        if (l == EZXML_BUFSIZE) s = realloc(s, len + EZXML_BUFSIZE);
-    } while (s && l == EZXML_BUFSIZE);
+// same as ezxml_parse_fp() with parser options
+ezxml_t ezxml_parse_fp_opt(FILE *fp, int opt)
+{
+    ezxml_root_t root;
+    size_t l, len = 0, max = EZXML_BUFSIZE, n = 1;
+    char *s, *t;
+
+    if (! (s = malloc(max))) return NULL;
+    while ((l = fread(s + len, 1, max - len, fp))) {
+        if ((len += l) < max) continue;
+        if (! (t = realloc(s, max *= 2))) { // grow geometrically, linear copying
+            free(s);
+            return NULL;
+        }
+        s = t;
+        n++;
+    }
 
-    if (! s) return NULL;
-    root = (ezxml_root_t)ezxml_parse_str(s, len);
+    if (! (root = (ezxml_root_t)ezxml_parse_str_opt(s, len, opt))) {
+        free(s);
+        return NULL;
+    }
     root->len = -1; // so we know to free s in ezxml_free()
+    root->stats.allocs += n; // the input buffer
     return &root->xml;
 }
 
+// Reads fd until end of file into a malloced buffer, size is a hint for its
+// size. n is set to the number of malloc() and realloc() calls.
+static char *ezxml_read_fd(int fd, size_t size, size_t *len, size_t *n)
+{
+    size_t max = (size) ? size + 1 : EZXML_BUFSIZE; // + 1 to see the end
+    ssize_t l;
+    char *s, *t;
+
+    *len = 0;
+    *n = 1;
+    if (! (s = malloc(max))) return NULL;
+    while ((l = read(fd, s + *len, max - *len)) > 0) {
+        if ((*len += l) < max) continue;
+        if (! (t = realloc(s, max *= 2))) break;
+        s = t;
+        (*n)++;
+    }
+    if (l) { // read error or out of memory
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
 // A wrapper for ezxml_parse_str() that accepts a file descriptor. First
 // attempts to mem map the file. Failing that, reads the file into memory.
 // Returns NULL on failure.
 ezxml_t ezxml_parse_fd(int fd)
+{
+    return ezxml_parse_fd_opt(fd, 0);
+}
+
+// same as ezxml_parse_fd() with parser options
+ezxml_t ezxml_parse_fd_opt(int fd, int opt)
 {
     ezxml_root_t root;
     struct stat st;
-    size_t l;
-    void *m;
+    size_t l, n;
+    char *m;
 
-    if (fd < 0) return NULL;
-    fstat(fd, &st);
+    if (fd < 0 || fstat(fd, &st)) return NULL;
+    if (! S_ISREG(st.st_mode)) st.st_size = 0; // size unknown
 
 #ifndef EZXML_NOMMAP
     l = (st.st_size + sysconf(_SC_PAGESIZE) - 1) & ~(sysconf(_SC_PAGESIZE) -1);
     if ((m = mmap(NULL, l, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) !=
         MAP_FAILED) {
         madvise(m, l, MADV_SEQUENTIAL); // optimize for sequential access
-        root = (ezxml_root_t)ezxml_parse_str(m, st.st_size);
+        if (! (root = (ezxml_root_t)ezxml_parse_str_opt(m, st.st_size, opt))) {
+            munmap(m, l);
+            return NULL;
+        }
         madvise(m, root->len = l, MADV_NORMAL); // put it back to normal
     }
-    else { // mmap failed, read file into memory
+    else { // mmap failed (or a pipe, socket, ...), read it into memory
 #endif // EZXML_NOMMAP
-        l = read(fd, m = malloc(st.st_size), st.st_size);
-        root = (ezxml_root_t)ezxml_parse_str(m, l);
+        if (! (m = ezxml_read_fd(fd, st.st_size, &l, &n))) return NULL;
+        if (! (root = (ezxml_root_t)ezxml_parse_str_opt(m, l, opt))) {
+            free(m);
+            return NULL;
+        }
         root->len = -1; // so we know to free s in ezxml_free()
+        root->stats.allocs += n; // the input buffer
 #ifndef EZXML_NOMMAP
     }
 #endif // EZXML_NOMMAP
@@ -654,144 +1152,989 @@ ezxml_t ezxml_parse_fd(int fd)
 
 // a wrapper for ezxml_parse_fd that accepts a file name
 ezxml_t ezxml_parse_file(const char *file)
+{
+    return ezxml_parse_file_opt(file, 0);
+}
+
+// same as ezxml_parse_file() with parser options
+ezxml_t ezxml_parse_file_opt(const char *file, int opt)
 {
     int fd = open(file, O_RDONLY, 0);
-    ezxml_t xml = ezxml_parse_fd(fd);
+    ezxml_t xml = ezxml_parse_fd_opt(fd, opt);
     
     if (fd >= 0) close(fd);
     return xml;
 }
 
-// Encodes ampersand sequences appending the results to *dst, reallocating *dst
-// if length excedes max. a is non-zero for attribute encoding. Returns *dst
-char *ezxml_ampencode(const char *s, size_t len, char **dst, size_t *dlen,
-                      size_t *max, short a)
+// what the push parser scans at mark, see struct ezxml_push
+enum { EZXML_P_TEXT, EZXML_P_LT, EZXML_P_PI, EZXML_P_COMMENT, EZXML_P_CDATA,
+       EZXML_P_DECL, EZXML_P_OPEN, EZXML_P_CLOSE };
+
+#define EZXML_P_NONE ((size_t)-1) // no pending subtree
+
+struct ezxml_push {
+    char *buf;            // unconsumed input, not null terminated
+    size_t len;           // bytes in buf
+    size_t max;           // size of buf
+    size_t pos;           // scanning resumes here
+    size_t mark;          // start of the markup being scanned
+    size_t sub;           // start of the pending subtree or EZXML_P_NONE
+    size_t lpos;          // new lines are counted up to here
+    int line;             // line number at lpos
+    int state;            // EZXML_P_...
+    char q;               // open quote inside a tag
+    char dtd;             // 1 inside, 2 after the internal subset of a DOCTYPE
+    int depth;            // current tag depth, 0 outside of the root tag
+    int target;           // depth of the subtrees returned
+    int opt;              // parser options of the subtrees
+    short root;           // non-zero once the root tag was seen
+    short eof;            // end of input
+    char *prolog;         // document type declaration, put before each subtree
+    size_t plen;          // length of prolog
+    int plines;           // new lines in prolog
+    char err[EZXML_ERRL]; // error string
+};
+
+// counts the lines of the input up to buffer position i, returns the line
+static int ezxml_push_line(ezxml_push_t p, size_t i)
 {
-    const char *e;
-    
-    for (e = s + len; s != e; s++) {
-        while (*dlen + 10 > *max) *dst = realloc(*dst, *max += EZXML_BUFSIZE);
+    for (; p->lpos < i; p->lpos++) if (p->buf[p->lpos] == '\n') p->line++;
+    return p->line;
+}
 
-        switch (*s) {
-        case '\0': return *dst;
-        case '&': *dlen += sprintf(*dst + *dlen, "&amp;"); break;
-        case '<': *dlen += sprintf(*dst + *dlen, "&lt;"); break;
-        case '>': *dlen += sprintf(*dst + *dlen, "&gt;"); break;
-        case '"': *dlen += sprintf(*dst + *dlen, (a) ? "&quot;" : "\""); break;
-        case '\n': *dlen += sprintf(*dst + *dlen, (a) ? "&#xA;" : "\n"); break;
-        case '\t': *dlen += sprintf(*dst + *dlen, (a) ? "&#x9;" : "\t"); break;
-        case '\r': *dlen += sprintf(*dst + *dlen, "&#xD;"); break;
-        default: (*dst)[(*dlen)++] = *s;
+// sets an error string for buffer position i if there is none yet, returns -1
+static int ezxml_push_err(ezxml_push_t p, size_t i, const char *err)
+{
+    if (! *p->err)
+        snprintf(p->err, EZXML_ERRL, "[error near line %d]: %s",
+                 ezxml_push_line(p, i), err);
+    return -1;
+}
+
+// 1 if the n characters at s start with m, 0 if not, -1 if n is too short to
+// tell
+static int ezxml_push_is(const char *s, size_t n, const char *m)
+{
+    size_t l = strlen(m);
+
+    if (memcmp(s, m, (n < l) ? n : l)) return 0;
+    return (n < l) ? -1 : 1;
+}
+
+// searches the buffer for m from the current position. Returns non-zero and
+// moves past m if found, otherwise remembers where to resume
+static int ezxml_push_find(ezxml_push_t p, const char *m)
+{
+    char *s = p->buf + p->pos, *e = p->buf + p->len, *t;
+    size_t l = strlen(m);
+
+    while ((t = memchr(s, *m, e - s))) {
+        if ((size_t)(e - t) < l) break; // might be completed by more input
+        if (! memcmp(t, m, l)) {
+            p->pos = t + l - p->buf;
+            return 1;
         }
+        s = t + 1;
     }
-    return *dst;
+    p->pos = ((t) ? t : e) - p->buf;
+    return 0;
 }
 
-// Recursively converts each tag to xml appending it to *s. Reallocates *s if
-// its length excedes max. start is the location of the previous tag in the
-// parent tag's character content. Returns *s.
-char *ezxml_toxml_r(ezxml_t xml, char **s, size_t *len, size_t *max,
-                    size_t start, char ***attr)
+// parses the completed subtree at sub as a document of its own
+static ezxml_t ezxml_push_sub(ezxml_push_t p)
 {
-    int i, j;
-    char *txt = (xml->parent) ? xml->parent->txt : "";
-    size_t off = 0;
+    ezxml_root_t root;
+    size_t n = p->pos - p->sub;
+    int line = ezxml_push_line(p, p->sub) - 1 - p->plines, l, i = 0;
+    char *m, err[EZXML_ERRL];
+
+    m = malloc(p->plen + n);
+    if (m) {
+        if (p->plen) memcpy(m, p->prolog, p->plen);
+        memcpy(m + p->plen, p->buf + p->sub, n);
+    }
+    p->sub = EZXML_P_NONE;
+    p->mark = p->pos;
+    if (! m || ! (root = (ezxml_root_t)ezxml_parse_str_opt(m, p->plen + n,
+                                                           p->opt))) {
+        free(m);
+        ezxml_push_err(p, p->pos, "out of memory");
+        return NULL;
+    }
+    root->len = -1; // so we know to free s in ezxml_free()
+    root->stats.allocs++; // the copy of the subtree
+
+    // error lines are counted from the start of the subtree, make them
+    // lines of the whole input
+    if (sscanf(root->err, "[error near line %d]:%n", &l, &i) == 1 && i) {
+        snprintf(err, EZXML_ERRL, "[error near line %d]:%s", l + line,
+                 root->err + i);
+        strcpy(root->err, err);
+    }
+    return &root->xml;
+}
 
-    // parent character content up to this tag
-    *s = ezxml_ampencode(txt + start, xml->off - start, s, len, max, 0);
+// Creates a push parser returning the tags at the given depth, 1 for the
+// children of the root tag. Returns NULL on failure.
+ezxml_push_t ezxml_push_new(int depth, int opt)
+{
+    ezxml_push_t p;
 
-    while (*len + strlen(xml->name) + 4 > *max) // reallocate s
-        *s = realloc(*s, *max += EZXML_BUFSIZE);
+    if (depth < 0 || ! (p = calloc(1, sizeof(struct ezxml_push)))) return NULL;
+    if (! (p->buf = malloc(p->max = EZXML_BUFSIZE))) {
+        free(p);
+        return NULL;
+    }
+    p->sub = EZXML_P_NONE;
+    p->line = 1;
+    p->target = depth;
+    p->opt = opt;
+    return p;
+}
 
-    *len += sprintf(*s + *len, "<%s", xml->name); // open tag
-    for (i = 0; xml->attr[i]; i += 2) { // tag attributes
-        if (ezxml_attr(xml, xml->attr[i]) != xml->attr[i + 1]) continue;
-        while (*len + strlen(xml->attr[i]) + 7 > *max) // reallocate s
-            *s = realloc(*s, *max += EZXML_BUFSIZE);
+// Appends len bytes of input, len 0 marks the end of input. Returns 0 on
+// success, -1 on failure.
+int ezxml_push_feed(ezxml_push_t p, const char *s, size_t len)
+{
+    size_t keep;
+    char *t;
+
+    if (*p->err) return -1;
+    if (p->eof) return ezxml_push_err(p, p->len, "input after end of input");
+    if (! len) return (p->eof = 1) - 1;
+    if (memchr(s, '\0', len)) // UTF-16 documents are not supported either
+        return ezxml_push_err(p, p->len, "null character in input");
+
+    if (p->len + len > p->max) { // drop what was consumed before growing
+        keep = (p->sub < p->mark) ? p->sub : p->mark;
+        ezxml_push_line(p, keep);
+        memmove(p->buf, p->buf + keep, p->len -= keep);
+        p->pos -= keep;
+        p->mark -= keep;
+        p->lpos -= keep;
+        if (p->sub != EZXML_P_NONE) p->sub -= keep;
+    }
+    for (keep = p->max; p->len + len > keep; keep *= 2);
+    if (keep != p->max) {
+        if (! (t = realloc(p->buf, keep)))
+            return ezxml_push_err(p, p->len, "out of memory");
+        p->buf = t;
+        p->max = keep;
+    }
+    memcpy(p->buf + p->len, s, len);
+    p->len += len;
+    return 0;
+}
 
-        *len += sprintf(*s + *len, " %s=\"", xml->attr[i]);
-        ezxml_ampencode(xml->attr[i + 1], -1, s, len, max, 1);
-        *len += sprintf(*s + *len, "\"");
+// Returns the next complete tag at the depth given to ezxml_push_new() as a
+// document of its own, or NULL if more input is needed.
+ezxml_t ezxml_push_next(ezxml_push_t p)
+{
+    char *s = p->buf, *e = p->buf + p->len, *t;
+    size_t n;
+    int r;
+
+    while (! *p->err) {
+        switch (p->state) {
+        case EZXML_P_TEXT: // character content, look for the next tag
+            if (! (t = memchr(s + p->pos, '<', p->len - p->pos))) {
+                p->pos = p->mark = p->len;
+                goto more;
+            }
+            p->mark = t - s;
+            p->pos = p->mark + 1;
+            p->state = EZXML_P_LT;
+            break;
+
+        case EZXML_P_LT: // tell the kind of markup
+            if (! (n = p->len - p->pos)) goto more;
+            t = s + p->pos;
+            if (*t == '?') p->state = EZXML_P_PI, p->pos++;
+            else if (*t == '/') p->state = EZXML_P_CLOSE, p->pos++;
+            else if (*t != '!') p->state = EZXML_P_OPEN, p->q = 0;
+            else if ((r = ezxml_push_is(t, n, "!--")) < 0 && ! p->eof) goto more;
+            else if (r > 0) p->state = EZXML_P_COMMENT, p->pos += 3;
+            else if ((r = ezxml_push_is(t, n, "![CDATA[")) < 0 && ! p->eof)
+                goto more;
+            else if (r > 0) p->state = EZXML_P_CDATA, p->pos += 8;
+            else p->state = EZXML_P_DECL, p->dtd = 0;
+            break;
+
+        case EZXML_P_PI:
+        case EZXML_P_COMMENT:
+        case EZXML_P_CDATA:
+            if (! ezxml_push_find(p, (p->state == EZXML_P_PI) ? "?>" :
+                                  (p->state == EZXML_P_COMMENT) ? "-->" : "]]>"))
+                goto more;
+            p->state = EZXML_P_TEXT;
+            break;
+
+        case EZXML_P_DECL: // ends like in ezxml_parse_str(), after the
+                           // internal subset if there is one
+            for (t = s + p->pos; t < e; t++) {
+                if (*t == '>' && p->dtd != 1) break;
+                else if (*t == '[') p->dtd = 1;
+                else if (*t == ']') p->dtd = 2;
+                else if (p->dtd == 2 && ! strchr(EZXML_WS, *t)) p->dtd = 1;
+            }
+            if ((p->pos = t - s) == p->len) goto more;
+            p->pos++;
+            if (! p->root && ezxml_push_is(s + p->mark, p->pos - p->mark,
+                                           "<!DOCTYPE") > 0) {
+                if (! (t = realloc(p->prolog, n = p->pos - p->mark))) {
+                    ezxml_push_err(p, p->mark, "out of memory");
+                    break;
+                }
+                memcpy(p->prolog = t, s + p->mark, p->plen = n);
+                for (p->plines = 0; n--; ) if (*t++ == '\n') p->plines++;
+            }
+            p->state = EZXML_P_TEXT;
+            break;
+
+        case EZXML_P_OPEN: // find the end of the tag outside of quotes
+            for (t = s + p->pos; (t = ezxml_scan(t, e, (! p->q) ? "\"'>" :
+                 (p->q == '"') ? "\"" : "'")) < e && *t != '>'; t++)
+                p->q = (p->q) ? 0 : *t;
+            if ((p->pos = t - s) == p->len) goto more;
+            p->pos++;
+            p->state = EZXML_P_TEXT;
+            if (p->root && ! p->depth) {
+                ezxml_push_err(p, p->mark, "markup outside of root element");
+                break;
+            }
+            p->root = 1;
+            if (p->depth == p->target) p->sub = p->mark;
+            if (t[-1] != '/') p->depth++;
+            else if (p->depth == p->target) return ezxml_push_sub(p);
+            break;
+
+        case EZXML_P_CLOSE:
+            if (! ezxml_push_find(p, ">")) goto more;
+            p->state = EZXML_P_TEXT;
+            if (! p->depth) ezxml_push_err(p, p->mark, "unexpected closing tag");
+            else if (--p->depth == p->target) return ezxml_push_sub(p);
+            break;
+        }
     }
+    return NULL;
 
-    for (i = 0; attr[i] && strcmp(attr[i][0], xml->name); i++);
-    for (j = 1; attr[i] && attr[i][j]; j += 3) { // default attributes
-        if (! attr[i][j + 1] || ezxml_attr(xml, attr[i][j]) != attr[i][j + 1])
-            continue; // skip duplicates and non-values
-        while (*len + strlen(attr[i][j]) + 7 > *max) // reallocate s
-            *s = realloc(*s, *max += EZXML_BUFSIZE);
+more:
+    if (! p->eof) return NULL;
+    if (p->state == EZXML_P_PI) ezxml_push_err(p, p->mark, "unclosed <?");
+    else if (p->state == EZXML_P_COMMENT) ezxml_push_err(p, p->mark, "unclosed <!--");
+    else if (p->state == EZXML_P_CDATA)
+        ezxml_push_err(p, p->mark, "unclosed <![CDATA[");
+    else if (p->state != EZXML_P_TEXT) ezxml_push_err(p, p->mark, "missing >");
+    else if (p->depth) ezxml_push_err(p, p->len, "unclosed tag");
+    else if (! p->root) ezxml_push_err(p, p->len, "root tag missing");
+    return NULL;
+}
+
+// returns the error string of the push parser, empty if there is none
+const char *ezxml_push_error(ezxml_push_t p)
+{
+    return (p) ? p->err : "";
+}
+
+// frees the push parser, documents returned by it are not affected
+void ezxml_push_free(ezxml_push_t p)
+{
+    if (! p) return;
+    free(p->prolog);
+    free(p->buf);
+    free(p);
+}
+
+struct ezxml_vtag {       // tag of a read-only document, views into it
+    const char *name;     // tag name, not null terminated
+    size_t nlen;          // length of name
+    const char *a;        // raw attributes
+    const char *ae;       // end of raw attributes
+    const char *cs;       // raw character content including sub tags
+    const char *ce;       // end of raw character content
+    const char *end;      // just past the closing tag
+    ezxml_vtag_t child;   // first sub tag, NULL if none
+    ezxml_vtag_t ordered; // next tag, same section and depth
+    ezxml_vtag_t parent;  // parent tag, NULL if root tag
+    char *txt;            // decoded character content, NULL until read
+    char **attr;          // decoded attributes, NULL until read
+};
+
+typedef struct ezxml_vblock *ezxml_vblock_t;
+struct ezxml_vblock { // tags of a read-only document
+    ezxml_vblock_t next;  // previously filled block
+    size_t n;             // tags used
+    size_t max;           // tags available
+    struct ezxml_vtag tag[];
+};
+
+struct ezxml_view {
+    const char *s;        // start of the document
+    const char *e;        // end of the document
+    void *m;              // mapping, malloced copy or NULL if owned by caller
+    size_t len;           // length of mapping, -1 for malloc
+    ezxml_vblock_t tags;  // tag storage, most recent block first
+    ezxml_vtag_t root;    // root tag
+    char err[EZXML_ERRL]; // error string
+};
 
-        *len += sprintf(*s + *len, " %s=\"", attr[i][j]);
-        ezxml_ampencode(attr[i][j + 1], -1, s, len, max, 1);
-        *len += sprintf(*s + *len, "\"");
+// sets the error string of a read-only document if there is none yet, returns
+// the document. Tags still open end at s, the markup before s is complete.
+static ezxml_view_t ezxml_verr(ezxml_view_t v, const char *s, const char *err,
+                               ...)
+{
+    va_list ap;
+    int line = 1;
+    const char *t;
+    char fmt[EZXML_ERRL];
+    ezxml_vblock_t b;
+    ezxml_vtag_t tag;
+    size_t i;
+
+    if (*v->err) return v;
+    for (b = v->tags; b; b = b->next) {
+        for (i = 0; i < b->n; i++) {
+            tag = &b->tag[i];
+            if (! tag->cs) tag->cs = s;
+            if (! tag->ce) tag->ce = s;
+            if (! tag->end) tag->end = s;
+        }
     }
-    *len += sprintf(*s + *len, ">");
+    for (t = v->s; t < s; t++) if (*t == '\n') line++;
+    snprintf(fmt, EZXML_ERRL, "[error near line %d]: %s", line, err);
 
-    *s = (xml->child) ? ezxml_toxml_r(xml->child, s, len, max, 0, attr) //child
-                      : ezxml_ampencode(xml->txt, -1, s, len, max, 0);  //data
-    
-    while (*len + strlen(xml->name) + 4 > *max) // reallocate s
-        *s = realloc(*s, *max += EZXML_BUFSIZE);
+    va_start(ap, err);
+    vsnprintf(v->err, EZXML_ERRL, fmt, ap);
+    va_end(ap);
 
-    *len += sprintf(*s + *len, "</%s>", xml->name); // close tag
+    return v;
+}
+
+// returns the first occurrence of m in [s, e), or NULL if there is none
+static const char *ezxml_vfind(const char *s, const char *e, const char *m)
+{
+    size_t l = strlen(m);
 
-    while (txt[off] && off < xml->off) off++; // make sure off is within bounds
-    return (xml->ordered) ? ezxml_toxml_r(xml->ordered, s, len, max, off, attr)
-                          : ezxml_ampencode(txt + off, -1, s, len, max, 0);
+    for (; (s = memchr(s, *m, e - s)) && (size_t)(e - s) >= l; s++)
+        if (! memcmp(s, m, l)) return s;
+    return NULL;
 }
 
-// Converts an ezxml structure back to xml. Returns a string of xml data that
-// must be freed.
-char *ezxml_toxml(ezxml_t xml)
+// skips a declaration starting at the '!' at s, including an internal subset,
+// returns just past its '>' or NULL if it is not closed
+static const char *ezxml_vdecl(const char *s, const char *e)
 {
-    ezxml_t p = (xml) ? xml->parent : NULL, o = (xml) ? xml->ordered : NULL;
-    ezxml_root_t root = (ezxml_root_t)xml;
-    size_t len = 0, max = EZXML_BUFSIZE;
-    char *s = strcpy(malloc(max), ""), *t, *n;
-    int i, j, k;
+    char q;
 
-    if (! xml || ! xml->name) return realloc(s, len + 1);
-    while (root->xml.parent) root = (ezxml_root_t)root->xml.parent; // root tag
+    for (q = 0; s < e && (*s != '>' || q == 1); s++)
+        q = (*s == '[') ? 1 : (*s == ']') ? 2 :
+            (q == 2 && ! strchr(EZXML_WS, *s)) ? 1 : q;
+    return (s < e) ? s + 1 : NULL;
+}
 
-    for (i = 0; ! p && root->pi[i]; i++) { // pre-root processing instructions
-        for (k = 2; root->pi[i][k - 1]; k++);
-        for (j = 1; (n = root->pi[i][j]); j++) {
-            if (root->pi[i][k][j - 1] == '>') continue; // not pre-root
-            while (len + strlen(t = root->pi[i][0]) + strlen(n) + 7 > max)
-                s = realloc(s, max += EZXML_BUFSIZE);
-            len += sprintf(s + len, "<?%s%s%s?>\n", t, *n ? " " : "", n);
+// non-zero if the l characters at s start with m
+static int ezxml_vis(const char *s, size_t l, const char *m)
+{
+    size_t n = strlen(m);
+
+    return l >= n && ! memcmp(s, m, n);
+}
+
+// Decodes [s, e) of a read-only document to w like ezxml_decode() does in
+// place, for t '&' (character content), 'c' (cdata) or ' ' (attributes).
+// Entities declared in a DTD are not expanded. Returns the end of the output,
+// which is never longer than the input.
+static char *ezxml_vdecode(char *w, const char *s, const char *e, char t)
+{
+    static const char *ent[] = { "lt;", "<", "gt;", ">", "quot;", "\"",
+                                 "apos;", "'", "amp;", "&", NULL };
+    const char *r;
+    long b, c, d;
+
+    while (s < e) {
+        if (*s == '\r') { // \r\n and \r become \n
+            *(w++) = (t == ' ') ? ' ' : '\n';
+            s += (s + 1 < e && s[1] == '\n') ? 2 : 1;
+        }
+        else if (t == 'c' || *s != '&') { // no decoding needed
+            *(w++) = (t == ' ' && isspace((unsigned char)*s)) ? ' ' : *s;
+            s++;
+        }
+        else if (s + 2 < e && s[1] == '#') { // character reference
+            b = (s[2] == 'x') ? 16 : 10;
+            for (c = 0, r = s + ((b == 16) ? 3 : 2); r < e && c <= 0x10FFFF &&
+                 ((b == 10) ? isdigit((unsigned char)*r)
+                            : isxdigit((unsigned char)*r)); r++)
+                c = c * b + ((*r <= '9') ? *r - '0' : (*r | 0x20) - 'a' + 10);
+            if (! c || c > 0x10FFFF || r == e || *r != ';') { // not a reference
+                *(w++) = *(s++);
+                continue;
+            }
+
+            if (c < 0x80) *(w++) = c; // US-ASCII subset
+            else { // multi-byte UTF-8 sequence
+                for (b = 0, d = c; d; d /= 2) b++; // number of bits in c
+                b = (b - 2) / 5; // number of bytes in payload
+                *(w++) = (0xFF << (7 - b)) | (c >> (6 * b)); // head
+                while (b) *(w++) = 0x80 | ((c >> (6 * --b)) & 0x3F); // payload
+            }
+            s = r + 1;
+        }
+        else { // entity reference
+            for (b = 0; ent[b] && ! ezxml_vis(s + 1, e - s - 1, ent[b]);
+                 b += 2); // find entity in entity list
+            if (! ent[b]) *(w++) = *(s++); // not a known entity
+            else {
+                *(w++) = *ent[b + 1];
+                s += strlen(ent[b]) + 1;
+            }
         }
     }
+    return w;
+}
 
-    xml->parent = xml->ordered = NULL;
-    s = ezxml_toxml_r(xml, &s, &len, &max, 0, root->attr);
-    xml->parent = p;
-    xml->ordered = o;
+// adds a tag to a read-only document
+static ezxml_vtag_t ezxml_vtag(ezxml_view_t v)
+{
+    ezxml_vblock_t b = v->tags;
+    size_t max;
+
+    if (! b || b->n == b->max) { // blocks double in size, tags never move
+        max = (b) ? b->max * 2 : 64;
+        if (! (b = malloc(sizeof(struct ezxml_vblock) +
+                          max * sizeof(struct ezxml_vtag)))) return NULL;
+        b->next = v->tags;
+        b->n = 0;
+        b->max = max;
+        v->tags = b;
+    }
+    return memset(&b->tag[b->n++], 0, sizeof(struct ezxml_vtag));
+}
+
+// builds the tag tree of a read-only document, sets an error string on failure
+static ezxml_view_t ezxml_vparse(ezxml_view_t v)
+{
+    const char *s = v->s, *e = v->e, *n;
+    ezxml_vtag_t cur = NULL, prev = NULL, tag;
+    char q;
+
+    if (e - s >= 2 && (unsigned char)*s >= 0xFE) // byte order mark
+        return ezxml_verr(v, s, "UTF-16 is not supported");
+
+    while (s < e && (s = memchr(s, '<', e - s))) {
+        n = s++;
+        if (ezxml_vis(s, e - s, "?")) { // processing instruction
+            if (! (s = ezxml_vfind(s, e, "?>")))
+                return ezxml_verr(v, n, "unclosed <?");
+            s += 2;
+        }
+        else if (ezxml_vis(s, e - s, "!--")) { // comment
+            if (! (s = ezxml_vfind(s + 3, e, "-->")))
+                return ezxml_verr(v, n, "unclosed <!--");
+            s += 3;
+        }
+        else if (ezxml_vis(s, e - s, "![CDATA[")) { // cdata section
+            if (! (s = ezxml_vfind(s, e, "]]>")))
+                return ezxml_verr(v, n, "unclosed <![CDATA[");
+            s += 3;
+        }
+        else if (*s == '!') { // DOCTYPE, ends after the internal subset
+            if (! (s = ezxml_vdecl(s, e)))
+                return ezxml_verr(v, n, "unclosed <!DOCTYPE");
+        }
+        else if (*s == '/') { // closing tag
+            for (n = ++s; s < e && ! strchr(EZXML_WS ">", *s); s++);
+            if (! cur || (size_t)(s - n) != cur->nlen ||
+                memcmp(n, cur->name, cur->nlen))
+                return ezxml_verr(v, n - 2, "unexpected closing tag </%.*s>",
+                                  (int)(s - n), n);
+            cur->ce = n - 2;
+            if (! (s = memchr(s, '>', e - s)))
+                return ezxml_verr(v, n, "missing >");
+            cur->end = ++s;
+            prev = cur;
+            cur = cur->parent;
+        }
+        else { // opening tag
+            if (! cur && v->root)
+                return ezxml_verr(v, n, "markup outside of root element");
+            if (! (tag = ezxml_vtag(v)))
+                return ezxml_verr(v, n, "out of memory");
+            for (tag->name = s; s < e && ! strchr(EZXML_WS "/>", *s); s++);
+            tag->nlen = s - tag->name;
+            for (tag->a = s, q = 0; (s = ezxml_scan((char *)s, (char *)e,
+                 (! q) ? "\"'>" : (q == '"') ? "\"" : "'")) < e && *s &&
+                 *s != '>'; s++)
+                q = (q) ? 0 : *s; // quotes may hold '>'
+            if (s == e || ! *s) {
+                if (q) return ezxml_verr(v, n, "missing %c", q);
+                return ezxml_verr(v, n, "missing >");
+            }
+
+            tag->parent = cur;
+            if (prev) prev->ordered = tag;
+            else if (cur) cur->child = tag;
+            else v->root = tag;
+            prev = NULL;
+            if (s[-1] == '/' && s - 1 >= tag->a) { // self closing tag
+                tag->ae = s - 1;
+                tag->cs = tag->ce = tag->end = ++s;
+                prev = tag;
+            }
+            else {
+                tag->ae = s;
+                tag->cs = ++s;
+                cur = tag;
+            }
+        }
+    }
+
+    if (cur) return ezxml_verr(v, e, "unclosed tag <%.*s>", (int)cur->nlen,
+                               cur->name);
+    if (! v->root) return ezxml_verr(v, e, "root tag missing");
+    return v;
+}
+
+// Parses len bytes at s as a read-only document, s is not modified and must
+// stay valid until the document is freed. Returns NULL on failure.
+ezxml_view_t ezxml_view_str(const char *s, size_t len)
+{
+    ezxml_view_t v = calloc(1, sizeof(struct ezxml_view));
 
-    for (i = 0; ! p && root->pi[i]; i++) { // post-root processing instructions
+    if (! v) return NULL;
+    v->e = (v->s = s) + len;
+    return ezxml_vparse(v);
+}
+
+// A read-only document from a file descriptor. The file is mapped read-only
+// and shared, falling back to reading it into memory. Returns NULL on
+// failure.
+ezxml_view_t ezxml_view_fd(int fd)
+{
+    ezxml_view_t v;
+    struct stat st;
+    size_t l, n;
+    char *m;
+
+    if (fd < 0 || fstat(fd, &st)) return NULL;
+    if (! S_ISREG(st.st_mode)) st.st_size = 0; // size unknown
+
+#ifndef EZXML_NOMMAP
+    if (st.st_size && (m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd,
+                                0)) != MAP_FAILED) {
+        if (! (v = ezxml_view_str(m, st.st_size))) {
+            munmap(m, st.st_size);
+            return NULL;
+        }
+        v->len = st.st_size;
+    }
+    else { // mmap failed (or a pipe, socket, ...), read it into memory
+#endif // EZXML_NOMMAP
+        if (! (m = ezxml_read_fd(fd, st.st_size, &l, &n))) return NULL;
+        if (! (v = ezxml_view_str(m, l))) {
+            free(m);
+            return NULL;
+        }
+        v->len = -1; // so we know to free m in ezxml_view_free()
+#ifndef EZXML_NOMMAP
+    }
+#endif // EZXML_NOMMAP
+    v->m = m;
+    return v;
+}
+
+// a wrapper for ezxml_view_fd() that accepts a file name
+ezxml_view_t ezxml_view_file(const char *file)
+{
+    int fd = open(file, O_RDONLY, 0);
+    ezxml_view_t v = ezxml_view_fd(fd);
+
+    if (fd >= 0) close(fd);
+    return v;
+}
+
+// returns the root tag of a read-only document, NULL if there is none
+ezxml_vtag_t ezxml_view_root(ezxml_view_t view)
+{
+    return (view) ? view->root : NULL;
+}
+
+// returns the error string of a read-only document, empty if there is none
+const char *ezxml_view_error(ezxml_view_t view)
+{
+    return (view) ? view->err : "";
+}
+
+// frees a read-only document, its tags and their decoded strings
+void ezxml_view_free(ezxml_view_t view)
+{
+    ezxml_vblock_t b;
+    size_t i;
+
+    if (! view) return;
+    while ((b = view->tags)) {
+        for (i = 0; i < b->n; i++) {
+            free(b->tag[i].txt);
+            free(b->tag[i].attr);
+        }
+        view->tags = b->next;
+        free(b);
+    }
+#ifndef EZXML_NOMMAP
+    if (view->len != (size_t)-1 && view->m) munmap(view->m, view->len);
+#endif // EZXML_NOMMAP
+    if (view->len == (size_t)-1) free(view->m);
+    free(view);
+}
+
+// returns the name of a read-only tag, not null terminated, len is set to its
+// length
+const char *ezxml_vname(ezxml_vtag_t xml, size_t *len)
+{
+    *len = (xml) ? xml->nlen : 0;
+    return (xml) ? xml->name : NULL;
+}
+
+// returns the raw character content of a read-only tag including its sub tags,
+// not null terminated, len is set to its length
+const char *ezxml_vraw(ezxml_vtag_t xml, size_t *len)
+{
+    *len = (xml) ? xml->ce - xml->cs : 0;
+    return (xml) ? xml->cs : NULL;
+}
+
+// returns the first sub tag with the given name, any sub tag if name is NULL
+ezxml_vtag_t ezxml_vchild(ezxml_vtag_t xml, const char *name)
+{
+    for (xml = (xml) ? xml->child : NULL; xml && name &&
+         ! (xml->nlen == strlen(name) && ! memcmp(xml->name, name, xml->nlen));
+         xml = xml->ordered);
+    return xml;
+}
+
+// returns the next tag of the same name in the same section and depth
+ezxml_vtag_t ezxml_vnext(ezxml_vtag_t xml)
+{
+    ezxml_vtag_t n;
+
+    for (n = (xml) ? xml->ordered : NULL; n && ! (n->nlen == xml->nlen &&
+         ! memcmp(n->name, xml->name, n->nlen)); n = n->ordered);
+    return n;
+}
+
+// returns the next tag in the same section and depth in document order
+ezxml_vtag_t ezxml_vordered(ezxml_vtag_t xml)
+{
+    return (xml) ? xml->ordered : NULL;
+}
+
+// Returns the character content of a read-only tag, decoded on first access,
+// "" if there is none. Content of sub tags, comments and processing
+// instructions is left out, cdata sections are included.
+const char *ezxml_vtxt(ezxml_vtag_t xml)
+{
+    ezxml_vtag_t c;
+    const char *s, *e, *t;
+    char *w;
+
+    if (! xml || xml->cs == xml->ce) return "";
+    if (xml->txt) return xml->txt;
+    if (! (w = xml->txt = malloc(xml->ce - xml->cs + 1))) return "";
+
+    for (s = xml->cs, c = xml->child; ; s = c->end, c = c->ordered) {
+        e = (c) ? c->name - 1 : xml->ce; // up to the next sub tag
+        while (s < e) {
+            if (! (t = memchr(s, '<', e - s))) t = e;
+            w = ezxml_vdecode(w, s, t, '&');
+            if ((s = t) == e) break;
+            if (ezxml_vis(s, e - s, "<![CDATA[")) {
+                t = ezxml_vfind(s, e, "]]>");
+                w = ezxml_vdecode(w, s + 9, t, 'c');
+                s = t + 3;
+            }
+            else if (ezxml_vis(s, e - s, "<!--"))
+                s = ezxml_vfind(s + 4, e, "-->") + 3;
+            else if (s[1] == '?') s = ezxml_vfind(s, e, "?>") + 2;
+            else s = ezxml_vdecl(s + 1, e); // declaration
+        }
+        if (! c) break;
+    }
+    *w = '\0';
+    return xml->txt;
+}
+
+// Returns the value of the requested attribute of a read-only tag or NULL if
+// not found. All attributes of the tag are decoded on first access.
+const char *ezxml_vattr(ezxml_vtag_t xml, const char *attr)
+{
+    const char *s, *e, *n, *v;
+    char *w, q;
+    int i = 0;
+
+    if (! xml) return NULL;
+    if (! xml->attr) { // { name, value, name, value, ... NULL }, one malloc
+        s = xml->a;
+        e = xml->ae;
+        i = ((e - s) / 4 + 1) * 2 + 1; // an attribute takes at least 4 chars
+        if (! (xml->attr = malloc(i * sizeof(char *) + (e - s) + 1)))
+            return NULL;
+        w = (char *)(xml->attr + i);
+        for (i = 0; ; i += 2) {
+            while (s < e && isspace((unsigned char)*s)) s++;
+            for (n = s; s < e && ! strchr(EZXML_WS "=", *s); s++);
+            v = s;
+            while (s < e && isspace((unsigned char)*s)) s++;
+            if (s == n || s == e || *(s++) != '=') break;
+            while (s < e && isspace((unsigned char)*s)) s++;
+            if (s == e || (*s != '"' && *s != '\'')) break;
+            q = *(s++);
+            xml->attr[i] = memcpy(w, n, v - n);
+            w += v - n;
+            *(w++) = '\0';
+            if (! (v = memchr(s, q, e - s))) break;
+            xml->attr[i + 1] = w;
+            w = ezxml_vdecode(w, s, v, ' ');
+            *(w++) = '\0';
+            s = v + 1;
+        }
+        xml->attr[i] = NULL;
+    }
+    for (i = 0; xml->attr[i] && strcmp(attr, xml->attr[i]); i += 2);
+    return (xml->attr[i]) ? xml->attr[i + 1] : NULL;
+}
+
+// Output of the serializer. Without a buffer or file descriptor only the
+// length is counted, so ezxml_toxml() can allocate exactly once.
+typedef struct ezxml_out {
+    char *buf;            // destination, NULL if none
+    size_t size;          // size of buf
+    size_t len;           // length of the output so far, also beyond size
+    int fd;               // destination of writev(), -1 if none
+    struct iovec *iov;    // pending pieces for fd, pointing into the tree
+    int iovcnt;           // number of pending pieces
+    int err;              // errno of the first failed write
+} *ezxml_out_t;
+
+// writes the pending pieces of o to its file descriptor
+static void ezxml_flush(ezxml_out_t o)
+{
+    struct iovec *v = o->iov;
+    int n = o->iovcnt;
+    ssize_t w;
+
+    while (n && ! o->err) {
+        if ((w = writev(o->fd, v, n)) < 0) {
+            if (errno != EINTR) o->err = errno;
+            continue;
+        }
+        for (; n && (size_t)w >= v->iov_len; n--, v++) w -= v->iov_len;
+        if (n) { // partial write
+            v->iov_base = (char *)v->iov_base + w;
+            v->iov_len -= w;
+        }
+    }
+    o->iovcnt = 0;
+}
+
+// appends n bytes of s to the output, s must live until o is flushed
+static void ezxml_put(ezxml_out_t o, const char *s, size_t n)
+{
+    if (! n) return;
+    if (o->fd >= 0) {
+        if (o->iovcnt == EZXML_IOV) ezxml_flush(o);
+        o->iov[o->iovcnt].iov_base = (void *)s;
+        o->iov[o->iovcnt++].iov_len = n;
+    }
+    else if (o->len < o->size)
+        memcpy(o->buf + o->len, s, (n < o->size - o->len) ? n : o->size - o->len);
+    o->len += n;
+}
+
+#define ezxml_puts(o, s) ezxml_put(o, s, strlen(s))
+
+// Encodes ampersand sequences of at most len bytes of s, up to its terminating
+// NUL, and appends the result to the output. Runs of characters that need no
+// encoding are appended in one piece. a is non-zero for attribute encoding.
+static void ezxml_ampencode(ezxml_out_t o, const char *s, size_t len, short a)
+{
+    const char *run = s, *e;
+
+    for (; len && *s; s++, len--) {
+        switch (*s) {
+        case '&': e = "&amp;"; break;
+        case '<': e = "&lt;"; break;
+        case '>': e = "&gt;"; break;
+        case '"': e = (a) ? "&quot;" : NULL; break;
+        case '\n': e = (a) ? "&#xA;" : NULL; break;
+        case '\t': e = (a) ? "&#x9;" : NULL; break;
+        case '\r': e = "&#xD;"; break;
+        default: e = NULL;
+        }
+        if (! e) continue;
+        ezxml_put(o, run, s - run);
+        ezxml_puts(o, e);
+        run = s + 1;
+    }
+    ezxml_put(o, run, s - run);
+}
+
+// appends a tag attribute to the output
+static void ezxml_put_attr(ezxml_out_t o, const char *name, const char *value)
+{
+    ezxml_put(o, " ", 1);
+    ezxml_puts(o, name);
+    ezxml_put(o, "=\"", 2);
+    ezxml_ampencode(o, value, -1, 1);
+    ezxml_put(o, "\"", 1);
+}
+
+// Converts xml and the tags following it in the parent tag's character
+// content to xml, recursing into sub tags only. start is the location of the
+// previous tag in the parent tag's character content.
+static void ezxml_toxml_r(ezxml_t xml, ezxml_out_t o, size_t start,
+                          char ***attr)
+{
+    const char *txt = (xml->parent) ? xml->parent->txt : "";
+    size_t tlen = strlen(txt), off;
+    int i, j;
+
+    for (; xml; xml = xml->ordered, start = off) {
+        off = (xml->off < tlen) ? xml->off : tlen; // within bounds
+        if (off < start) off = start;
+        ezxml_ampencode(o, txt + start, off - start, 0); // content up to tag
+
+        ezxml_put(o, "<", 1); // open tag
+        ezxml_puts(o, xml->name);
+        for (i = 0; xml->attr[i]; i += 2) // tag attributes
+            if (ezxml_attr(xml, xml->attr[i]) == xml->attr[i + 1])
+                ezxml_put_attr(o, xml->attr[i], xml->attr[i + 1]);
+
+        for (i = 0; attr[i] && strcmp(attr[i][0], xml->name); i++);
+        for (j = 1; attr[i] && attr[i][j]; j += 3) // default attributes
+            if (attr[i][j + 1] && ezxml_attr(xml, attr[i][j]) == attr[i][j + 1])
+                ezxml_put_attr(o, attr[i][j], attr[i][j + 1]); // not duplicate
+        ezxml_put(o, ">", 1);
+
+        if (xml->child) ezxml_toxml_r(xml->child, o, 0, attr); // child
+        else ezxml_ampencode(o, xml->txt, -1, 0); // data
+
+        ezxml_put(o, "</", 2); // close tag
+        ezxml_puts(o, xml->name);
+        ezxml_put(o, ">", 1);
+    }
+    ezxml_ampencode(o, txt + start, -1, 0); // rest of the parent's content
+}
+
+// appends the processing instructions of root before (c is '<') or after (c
+// is '>') the root tag to the output
+static void ezxml_put_pi(ezxml_out_t o, ezxml_root_t root, char c)
+{
+    int i, j, k;
+
+    for (i = 0; root->pi[i]; i++) {
         for (k = 2; root->pi[i][k - 1]; k++);
-        for (j = 1; (n = root->pi[i][j]); j++) {
-            if (root->pi[i][k][j - 1] == '<') continue; // not post-root
-            while (len + strlen(t = root->pi[i][0]) + strlen(n) + 7 > max)
-                s = realloc(s, max += EZXML_BUFSIZE);
-            len += sprintf(s + len, "\n<?%s%s%s?>", t, *n ? " " : "", n);
+        for (j = 1; root->pi[i][j]; j++) {
+            if (root->pi[i][k][j - 1] != c) continue;
+            ezxml_put(o, (c == '<') ? "<?" : "\n<?", (c == '<') ? 2 : 3);
+            ezxml_puts(o, root->pi[i][0]);
+            if (*root->pi[i][j]) ezxml_put(o, " ", 1);
+            ezxml_puts(o, root->pi[i][j]);
+            ezxml_put(o, (c == '<') ? "?>\n" : "?>", (c == '<') ? 3 : 2);
         }
     }
-    return realloc(s, len + 1);
+}
+
+// converts xml to the output, processing instructions are only included for
+// the root tag
+static void ezxml_toxml_o(ezxml_t xml, ezxml_out_t o)
+{
+    ezxml_t p, n;
+    ezxml_root_t root = (ezxml_root_t)xml;
+
+    if (! xml || ! xml->name) return;
+    p = xml->parent;
+    n = xml->ordered;
+    while (root->xml.parent) root = (ezxml_root_t)root->xml.parent; // root tag
+
+    if (! p) ezxml_put_pi(o, root, '<'); // pre-root processing instructions
+    xml->parent = xml->ordered = NULL;
+    ezxml_toxml_r(xml, o, 0, root->attr);
+    xml->parent = p;
+    xml->ordered = n;
+    if (! p) ezxml_put_pi(o, root, '>'); // post-root processing instructions
+}
+
+// Converts an ezxml structure back to xml. Returns a string of xml data that
+// must be freed. The length is measured first, so the string is allocated
+// once and exactly.
+char *ezxml_toxml(ezxml_t xml)
+{
+    struct ezxml_out o = { NULL, 0, 0, -1, NULL, 0, 0 };
+    char *s;
+
+    ezxml_toxml_o(xml, &o); // measure
+    if (! (s = malloc(o.len + 1))) return NULL;
+    o.buf = s;
+    o.size = o.len;
+    o.len = 0;
+    ezxml_toxml_o(xml, &o); // write
+    s[o.len] = '\0';
+    return s;
+}
+
+// Converts xml into buf of size bytes like snprintf(). Returns the length of
+// the whole document, which is at least size if it was truncated.
+size_t ezxml_toxml_buf(ezxml_t xml, char *buf, size_t size)
+{
+    struct ezxml_out o = { buf, (size) ? size - 1 : 0, 0, -1, NULL, 0, 0 };
+
+    ezxml_toxml_o(xml, &o);
+    if (size) buf[(o.len < o.size) ? o.len : o.size] = '\0';
+    return o.len;
+}
+
+// Writes xml to the file descriptor fd without copying it, with writev() of
+// up to EZXML_IOV pieces pointing into the tree. Returns 0 on success, -1 with
+// errno set if a write failed.
+int ezxml_toxml_fd(ezxml_t xml, int fd)
+{
+    struct iovec iov[EZXML_IOV];
+    struct ezxml_out o = { NULL, 0, 0, fd, iov, 0, 0 };
+
+    ezxml_toxml_o(xml, &o);
+    ezxml_flush(&o);
+    if (! o.err) return 0;
+    errno = o.err;
+    return -1;
 }
 
 // free the memory allocated for the ezxml structure
 void ezxml_free(ezxml_t xml)
 {
     ezxml_root_t root = (ezxml_root_t)xml;
+    ezxml_block_t b, n;
+    ezxml_t c, o;
     int i, j;
     char **a, *s;
 
     if (! xml) return;
-    ezxml_free(xml->child);
-    ezxml_free(xml->ordered);
+    // an arena tree without malloced strings or tags is released at once
+    if (xml->parent || ! (xml->flags & EZXML_ARENA) || root->dirty) {
+        ezxml_free(xml->child);
+        for (c = xml->ordered; c; c = o) { // siblings in a loop, recursion
+            o = c->ordered;                // only goes as deep as the tree
+            c->ordered = NULL;
+            ezxml_free(c);
+        }
+    }
 
-    if (! xml->parent) { // free root tag allocations
+    if (! xml->parent && root->arena) { // everything else is in the arena
+        if (root->len == -1) free(root->m); // malloced xml data
+#ifndef EZXML_NOMMAP
+        else if (root->len) munmap(root->m, root->len); // mem mapped xml data
+#endif // EZXML_NOMMAP
+    }
+    else if (! xml->parent) { // free root tag allocations
         for (i = 10; root->ent[i]; i += 2) // 0 - 9 are default entites (<>&"')
             if ((s = root->ent[i + 1]) < root->s || s > root->e) free(s);
         free(root->ent); // free list of general entities
@@ -815,12 +2158,29 @@ void ezxml_free(ezxml_t xml)
         else if (root->len) munmap(root->m, root->len); // mem mapped xml data
 #endif // EZXML_NOMMAP
         if (root->u) free(root->u); // utf8 conversion
+        free(root->names); // interned tag names
     }
 
-    ezxml_free_attr(xml->attr); // tag attributes
+    if (! (xml->flags & EZXML_ARENA)) free(xml->index); // lookup index
+    ezxml_free_attr(xml->attr, xml->flags & EZXML_ARENA); // tag attributes
     if ((xml->flags & EZXML_TXTM)) free(xml->txt); // character content
     if ((xml->flags & EZXML_NAMEM)) free(xml->name); // tag name
-    free(xml);
+    if (! (xml->flags & EZXML_ARENA)) free(xml);
+    else if (! xml->parent) { // release the arena, the root tag is part of it
+        for (b = root->arena; b; b = n) {
+            n = b->next;
+            free(b);
+        }
+    }
+}
+
+// returns the allocation counters of the document
+struct ezxml_stats ezxml_alloc_stats(ezxml_t xml)
+{
+    static struct ezxml_stats none;
+
+    while (xml && xml->parent) xml = xml->parent; // find root tag
+    return (xml) ? ((ezxml_root_t)xml)->stats : none;
 }
 
 // return parser error message or empty string if none
@@ -833,23 +2193,19 @@ const char *ezxml_error(ezxml_t xml)
 // returns a new empty ezxml structure with the given root tag name
 ezxml_t ezxml_new(const char *name)
 {
-    static char *ent[] = { "lt;", "&#60;", "gt;", "&#62;", "quot;", "&#34;",
-                           "apos;", "&#39;", "amp;", "&#38;", NULL };
-    ezxml_root_t root = (ezxml_root_t)memset(malloc(sizeof(struct ezxml_root)), 
-                                             '\0', sizeof(struct ezxml_root));
-    root->xml.name = (char *)name;
-    root->cur = &root->xml;
-    strcpy(root->err, root->xml.txt = "");
-    root->ent = memcpy(malloc(sizeof(ent)), ent, sizeof(ent));
-    root->attr = root->pi = (char ***)(root->xml.attr = EZXML_NIL);
-    return &root->xml;
+    return &ezxml_new_root(name, 0, 0)->xml;
 }
 
 // inserts an existing tag into an ezxml structure
 ezxml_t ezxml_insert(ezxml_t xml, ezxml_t dest, size_t off)
 {
     ezxml_t cur, prev, head;
+    ezxml_root_t root;
 
+    if (! (xml->flags & EZXML_ARENA) && (root = ezxml_arena_root(dest)))
+        root->dirty = 1; // malloced tag in an arena tree
+
+    ezxml_unindex(dest);
     xml->next = xml->sibling = xml->ordered = NULL;
     xml->off = off;
     xml->parent = dest;
@@ -866,7 +2222,8 @@ ezxml_t ezxml_insert(ezxml_t xml, ezxml_t dest, size_t off)
             dest->child = xml;
         }
 
-        for (cur = head, prev = NULL; cur && strcmp(cur->name, xml->name);
+        for (cur = head, prev = NULL; cur &&
+             ! ezxml_same(cur->name, xml->name);
              prev = cur, cur = cur->sibling); // find tag type
         if (cur && cur->off <= off) { // not first of type
             while (cur->next && cur->next->off <= off) cur = cur->next;
@@ -874,7 +2231,8 @@ ezxml_t ezxml_insert(ezxml_t xml, ezxml_t dest, size_t off)
             cur->next = xml;
         }
         else { // first tag of this type
-            if (prev && cur) prev->sibling = cur->sibling; // remove old first
+            if (cur && prev) prev->sibling = cur->sibling; // remove old first
+            else if (cur) head = cur->sibling; // old first was the list head
             xml->next = cur; // old first tag is now next
             for (cur = head, prev = NULL; cur && cur->off <= off;
                  prev = cur, cur = cur->sibling); // new sibling insert point
@@ -891,16 +2249,7 @@ ezxml_t ezxml_insert(ezxml_t xml, ezxml_t dest, size_t off)
 // of the parent tag's character content. Returns the child tag.
 ezxml_t ezxml_add_child(ezxml_t xml, const char *name, size_t off)
 {
-    ezxml_t child;
-
-    if (! xml) return NULL;
-    child = (ezxml_t)memset(malloc(sizeof(struct ezxml)), '\0',
-                            sizeof(struct ezxml));
-    child->name = (char *)name;
-    child->attr = EZXML_NIL;
-    child->txt = "";
-
-    return ezxml_insert(child, xml, off);
+    return ezxml_add_tag(ezxml_arena_root(xml), xml, name, off, NULL);
 }
 
 // sets the character content for the given tag and returns the tag
@@ -917,22 +2266,25 @@ ezxml_t ezxml_set_txt(ezxml_t xml, const char *txt)
 // of NULL will remove the specified attribute. Returns the tag given.
 ezxml_t ezxml_set_attr(ezxml_t xml, const char *name, const char *value)
 {
+    ezxml_root_t root = ezxml_arena_root(xml); // lists of arena tags
     int l = 0, c;
 
     if (! xml) return NULL;
+    ezxml_unindex(xml);
     while (xml->attr[l] && strcmp(xml->attr[l], name)) l += 2;
     if (! xml->attr[l]) { // not found, add as new attribute
         if (! value) return xml; // nothing to do
         if (xml->attr == EZXML_NIL) { // first attribute
-            xml->attr = malloc(4 * sizeof(char *));
-            xml->attr[1] = strdup(""); // empty list of malloced names/vals
+            xml->attr = ezxml_alloc(root, 4 * sizeof(char *));
+            // empty list of malloced names/vals
+            xml->attr[1] = strcpy(ezxml_alloc(root, 1), "");
         }
-        else xml->attr = realloc(xml->attr, (l + 4) * sizeof(char *));
+        else xml->attr = ezxml_realloc(root, xml->attr, (l + 4) * sizeof(char *));
 
         xml->attr[l] = (char *)name; // set attribute name
         xml->attr[l + 2] = NULL; // null terminate attribute list
-        xml->attr[l + 3] = realloc(xml->attr[l + 1],
-                                   (c = strlen(xml->attr[l + 1])) + 2);
+        xml->attr[l + 3] = ezxml_realloc(root, xml->attr[l + 1],
+                                         (c = strlen(xml->attr[l + 1])) + 2);
         strcpy(xml->attr[l + 3] + c, " "); // set name/value as not malloced
         if (xml->flags & EZXML_DUP) xml->attr[l + 3][c] = EZXML_NAMEM;
     }
@@ -946,8 +2298,8 @@ ezxml_t ezxml_set_attr(ezxml_t xml, const char *name, const char *value)
     if (value) xml->attr[l + 1] = (char *)value; // set attribute value
     else { // remove attribute
         if (xml->attr[c + 1][l / 2] & EZXML_NAMEM) free(xml->attr[l]);
-        memmove(xml->attr + l, xml->attr + l + 2, (c - l + 2) * sizeof(char*));
-        xml->attr = realloc(xml->attr, (c + 2) * sizeof(char *));
+        memmove(xml->attr + l, xml->attr + l + 2, (c - l) * sizeof(char *));
+        xml->attr = ezxml_realloc(root, xml->attr, (c + 2) * sizeof(char *));
         memmove(xml->attr[c + 1] + (l / 2), xml->attr[c + 1] + (l / 2) + 1,
                 (c / 2) - (l / 2)); // fix list of which name/vals are malloced
     }
@@ -958,28 +2310,42 @@ ezxml_t ezxml_set_attr(ezxml_t xml, const char *name, const char *value)
 // sets a flag for the given tag and returns the tag
 ezxml_t ezxml_set_flag(ezxml_t xml, short flag)
 {
+    ezxml_root_t root;
+
     if (xml) xml->flags |= flag;
+    if ((flag & (EZXML_NAMEM | EZXML_TXTM | EZXML_DUP)) &&
+        (root = ezxml_arena_root(xml)))
+        root->dirty = 1; // ezxml_free() has to walk the tree to free them
     return xml;
 }
 
 // removes a tag along with its subtags without freeing its memory
 ezxml_t ezxml_cut(ezxml_t xml)
 {
-    ezxml_t cur;
+    ezxml_t cur, prev;
 
     if (! xml) return NULL; // nothing to do
     if (xml->next) xml->next->sibling = xml->sibling; // patch sibling list
 
     if (xml->parent) { // not root tag
+        ezxml_unindex(xml->parent);
         cur = xml->parent->child; // find head of subtag list
-        if (cur == xml) xml->parent->child = xml->ordered; // first subtag
+        if (cur == xml) { // first subtag, also head of the sibling list
+            cur = (xml->next) ? xml->next : xml->sibling; // list without xml
+            if ((xml->parent->child = xml->ordered) && xml->ordered != cur) {
+                for (prev = cur; prev->sibling != xml->ordered;
+                     prev = prev->sibling); // new first subtag heads the list
+                prev->sibling = xml->ordered->sibling;
+                xml->ordered->sibling = cur;
+            }
+        }
         else { // not first subtag
             while (cur->ordered != xml) cur = cur->ordered;
             cur->ordered = cur->ordered->ordered; // patch ordered list
 
             cur = xml->parent->child; // go back to head of subtag list
-            if (strcmp(cur->name, xml->name)) { // not in first sibling list
-                while (strcmp(cur->sibling->name, xml->name))
+            if (! ezxml_same(cur->name, xml->name)) { // not in first sibling list
+                while (! ezxml_same(cur->sibling->name, xml->name))
                     cur = cur->sibling;
                 if (cur->sibling == xml) { // first of a sibling list
                     cur->sibling = (xml->next) ? xml->next
@@ -996,19 +2362,351 @@ ezxml_t ezxml_cut(ezxml_t xml)
     return xml;
 }
 
-#ifdef EZXML_TEST // test harness
-int main(int argc, char **argv)
+#ifdef EZXML_BENCH // parse throughput benchmark
+#include <time.h>
+
+#define EZXML_BENCH_RUNS 10
+#define EZXML_BENCH_SWEEP (16 << 20) // bytes parsed per document of the sweep
+
+// tag dense document in the layout of config.xml, n sites of 100 receivers
+static char *ezxml_bench_tags(int n, size_t *len)
+{
+    size_t max = (size_t)n * 100 * 320 + 64;
+    char *s = malloc(max);
+    int i, j;
+
+    *len = sprintf(s, "<?xml version=\"1.0\"?>\n<fleet>\n");
+    for (i = 0; i < n; i++) {
+        *len += sprintf(s + *len, "  <site name=\"site%d\">\n", i);
+        for (j = 0; j < 100; j++)
+            *len += sprintf(s + *len, "    <receiver name=\"receiver%d\" "
+                "serial=\"%08x\">\n      <channelFreq><freq>161975000</freq>"
+                "<freq>162025000</freq></channelFreq>\n      <metamask>0"
+                "</metamask><afcRange>1500</afcRange><tcxoFreq>13000000"
+                "</tcxoFreq>\n    </receiver>\n", j, i * 100 + j);
+        *len += sprintf(s + *len, "  </site>\n");
+    }
+    *len += sprintf(s + *len, "</fleet>\n");
+    return s;
+}
+
+// text heavy document, n sections of 20 paragraphs with a few entities
+static char *ezxml_bench_text(int n, size_t *len)
+{
+    static const char *p = "Moitessier receives AIS messages on two channels "
+        "and forwards them together with GNSS sentences to the host, the "
+        "control program configures the receivers &amp; reads statistics. ";
+    size_t max = (size_t)n * 20 * (strlen(p) * 8 + 32) + 64;
+    char *s = malloc(max);
+    int i, j, k;
+
+    *len = sprintf(s, "<?xml version=\"1.0\"?>\n<doc>\n");
+    for (i = 0; i < n; i++) {
+        *len += sprintf(s + *len, "<section id=\"%d\" title=\"%.100s\">\n",
+                        i, p);
+        for (j = 0; j < 20; j++) {
+            *len += sprintf(s + *len, "<p>");
+            for (k = 0; k < 8; k++) *len += sprintf(s + *len, "%s", p);
+            *len += sprintf(s + *len, "</p>\n");
+        }
+        *len += sprintf(s + *len, "</section>\n");
+    }
+    *len += sprintf(s + *len, "</doc>\n");
+    return s;
+}
+
+// best parse time of EZXML_BENCH_RUNS runs in MB/s, each run parses a fresh copy
+static double ezxml_bench_run(const char *doc, size_t len)
+{
+    char *s = malloc(len);
+    struct timespec a, b;
+    double t, best = 0;
+    ezxml_t xml;
+    int i;
+
+    for (i = 0; i < EZXML_BENCH_RUNS; i++) {
+        memcpy(s, doc, len);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        xml = ezxml_parse_str(s, len);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        if (*ezxml_error(xml)) fprintf(stderr, "%s\n", ezxml_error(xml));
+        ezxml_free(xml);
+        t = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+        if (! i || t < best) best = t;
+    }
+    free(s);
+    return len / best / 1e6;
+}
+
+// Synthetic document of about size bytes, a flat list of records under the
+// root tag, each with text bytes of character content. Every ent-th character
+// of the content is an entity or character reference, none if ent is 0.
+static char *ezxml_bench_doc(size_t size, int text, int ent, size_t *len)
+{
+    static const char *ref[] = { "&amp;", "&lt;", "&#233;", "&quot;" };
+    char *s = malloc(size + text * 6 + 128); // references are up to 6 bytes
+    int i, k = 0;
+
+    *len = sprintf(s, "<?xml version=\"1.0\"?>\n<doc>\n");
+    for (i = 0; *len < size; i++) {
+        *len += sprintf(s + *len, "  <rec id=\"%d\">", i);
+        for (k = 0; k < text; k++) {
+            if (ent && (i * text + k) % ent == ent - 1)
+                *len += sprintf(s + *len, "%s", ref[(i + k) & 3]);
+            else s[(*len)++] = 'a' + k % 26;
+        }
+        *len += sprintf(s + *len, "</rec>\n");
+    }
+    *len += sprintf(s + *len, "</doc>\n");
+    return s;
+}
+
+// Parses doc with the option opt until about EZXML_BENCH_SWEEP bytes, at least
+// 3 times, returns the best time in MB/s and the allocations of one parse.
+static double ezxml_bench_opt(const char *doc, size_t len, int opt,
+                              struct ezxml_stats *st)
 {
+    char *s = malloc(len);
+    struct timespec a, b;
+    double t, best = 0;
     ezxml_t xml;
+    size_t i, n = EZXML_BENCH_SWEEP / len;
+
+    for (i = 0; i < n || i < 3; i++) {
+        memcpy(s, doc, len);
+        clock_gettime(CLOCK_MONOTONIC, &a);
+        xml = ezxml_parse_str_opt(s, len, opt);
+        clock_gettime(CLOCK_MONOTONIC, &b);
+        if (*ezxml_error(xml)) fprintf(stderr, "%s\n", ezxml_error(xml));
+        *st = ezxml_alloc_stats(xml);
+        ezxml_free(xml);
+        t = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+        if (! i || t < best) best = t;
+    }
+    free(s);
+    return len / best / 1e6;
+}
+
+// parse throughput and allocations from 1 KB to max bytes, for tag dense to
+// text heavy documents without and with entities
+static void ezxml_bench_sweep(size_t max)
+{
+    static const int text[] = { 8, 100, 1000 }, ent[] = { 0, 100, 10 };
+    static const int mul[] = { 1, 10, 100 };
+    struct ezxml_stats h, a;
+    size_t size, len;
+    double mh, ma;
     char *s;
+    int i, j, k;
+
+    printf("   size  text ent   heap MB/s     allocs  arena MB/s  allocs"
+           "   arena allocs\n");
+    for (k = 0; k < 6; k++) { // 1 KB, 10 KB, 100 KB, 1 MB, ... 100 MB
+        if ((size = (size_t)mul[k % 3] << ((k < 3) ? 10 : 20)) > max) break;
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < 3; j++) {
+                s = ezxml_bench_doc(size, text[i], ent[j], &len);
+                mh = ezxml_bench_opt(s, len, 0, &h);
+                ma = ezxml_bench_opt(s, len, EZXML_OPT_ARENA, &a);
+                printf("%6d%s %5d %3d %11.1f %10lu %11.1f %7lu %14lu\n",
+                       mul[k % 3], (k < 3) ? "K" : "M", text[i], ent[j], mh,
+                       (unsigned long)h.allocs, ma, (unsigned long)a.allocs,
+                       (unsigned long)a.arena_allocs);
+                free(s);
+            }
+        }
+    }
+}
+
+#define EZXML_BENCH_LOOKUPS 1000
+
+// flat document of n sub tags of the root: receivers (kind 0), tags of n
+// different names (kind 1), or a root tag with n attributes (kind 2)
+static char *ezxml_bench_wide(int n, int kind, size_t *len)
+{
+    char *s = malloc((size_t)n * 48 + 64);
     int i;
 
-    if (argc != 2) return fprintf(stderr, "usage: %s xmlfile\n", argv[0]);
+    *len = sprintf(s, "<fleet");
+    for (i = 0; kind == 2 && i < n; i++)
+        *len += sprintf(s + *len, " a%d=\"%d\"", i, i);
+    *len += sprintf(s + *len, ">");
+    for (i = 0; kind != 2 && i < n; i++) {
+        if (kind) *len += sprintf(s + *len, "<s%d>%d</s%d>", i, i, i);
+        else *len += sprintf(s + *len, "<receiver serial=\"%08x\"/>", i);
+    }
+    *len += sprintf(s + *len, "</fleet>");
+    return s;
+}
+
+static double ezxml_bench_now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
 
-    xml = ezxml_parse_file(argv[1]);
-    printf("%s\n", (s = ezxml_toxml(xml)));
+// EZXML_BENCH_LOOKUPS lookups at random positions of a document built by
+// ezxml_bench_wide(), walking the lists like before the index (linear) and
+// with ezxml_idx(), ezxml_child() or ezxml_attr(). Prints ns per lookup.
+static void ezxml_bench_lookup(int n, int kind)
+{
+    static const char *what[] = { "idx", "child", "attr" };
+    char (*names)[16] = malloc(EZXML_BENCH_LOOKUPS * sizeof(*names));
+    int *pos = malloc(EZXML_BENCH_LOOKUPS * sizeof(int)), i, j;
+    unsigned int r = 1;
+    double t[4];
+    size_t len, hits = 0;
+    ezxml_t xml, first, c;
+    char *s = ezxml_bench_wide(n, kind, &len);
+
+    xml = ezxml_parse_str(s, len);
+    first = (kind) ? NULL : ezxml_child(xml, "receiver");
+    for (i = 0; i < EZXML_BENCH_LOOKUPS; i++) {
+        r = r * 1103515245 + 12345;
+        sprintf(names[i], "%c%d", (kind == 1) ? 's' : 'a', pos[i] = (r >> 8) % n);
+    }
+
+    t[0] = ezxml_bench_now();
+    for (i = 0; i < EZXML_BENCH_LOOKUPS; i++) { // linear
+        if (kind == 0) for (c = first, j = pos[i]; c && j; j--) c = c->next;
+        else if (kind == 1)
+            for (c = xml->child; c && strcmp(names[i], c->name); c = c->sibling);
+        else {
+            for (j = 0; xml->attr[j] && strcmp(names[i], xml->attr[j]); j += 2);
+            c = (xml->attr[j]) ? xml : NULL;
+        }
+        hits += (c != NULL);
+    }
+    t[2] = t[1] = ezxml_bench_now();
+    for (i = 0; i < EZXML_BENCH_LOOKUPS; i++) { // first one builds the index
+        if (kind == 0) c = ezxml_idx(first, pos[i]);
+        else if (kind == 1) c = ezxml_child(xml, names[i]);
+        else c = (ezxml_attr(xml, names[i])) ? xml : NULL;
+        hits += (c != NULL);
+        if (! i) t[2] = ezxml_bench_now();
+    }
+    t[3] = ezxml_bench_now();
+
+    printf("%-6s %7d %10.0f %10.0f %10.0f%s\n", what[kind], n,
+           (t[1] - t[0]) * 1e9 / EZXML_BENCH_LOOKUPS,
+           (t[3] - t[2]) * 1e9 / (EZXML_BENCH_LOOKUPS - 1), (t[2] - t[1]) * 1e6,
+           (hits == 2 * EZXML_BENCH_LOOKUPS) ? "" : "  (lookups failed)");
+    ezxml_free(xml);
     free(s);
+    free(names);
+    free(pos);
+}
+
+int main(int argc, char **argv)
+{
+#if defined(EZXML_AVX2)
+    const char *scan = "avx2";
+#elif defined(EZXML_SSE2)
+    const char *scan = "sse2";
+#elif defined(EZXML_NEON)
+    const char *scan = "neon";
+#else
+    const char *scan = "scalar";
+#endif
+    struct stat st;
+    size_t len;
+    char *s;
+    int fd, i, n;
+
+    if (argc >= 2 && ! strcmp(argv[1], "-s")) { // sweep up to argv[2] MB
+        ezxml_bench_sweep((size_t)((argc > 2) ? atoi(argv[2]) : 100) << 20);
+        return 0;
+    }
+    if (argc == 2) { // a document given on the command line
+        if ((fd = open(argv[1], O_RDONLY, 0)) < 0 || fstat(fd, &st) ||
+            read(fd, s = malloc(st.st_size), st.st_size) != st.st_size)
+            return fprintf(stderr, "could not read %s\n", argv[1]);
+        close(fd);
+        printf("%-7s %-12s %8.1f MB/s\n", scan, argv[1],
+               ezxml_bench_run(s, st.st_size));
+        free(s);
+        return 0;
+    }
+
+    s = ezxml_bench_tags(100, &len);
+    printf("%-7s tags %6lu KB %8.1f MB/s\n", scan, (unsigned long)len / 1024,
+           ezxml_bench_run(s, len));
+    free(s);
+    s = ezxml_bench_text(100, &len);
+    printf("%-7s text %6lu KB %8.1f MB/s\n", scan, (unsigned long)len / 1024,
+           ezxml_bench_run(s, len));
+    free(s);
+
+    printf("lookup    tags  linear ns indexed ns   index us\n");
+    for (i = 0; i < 3; i++)
+        for (n = 10; n <= (i ? 10000 : 100000); n *= 10) // parsing n distinct
+            ezxml_bench_lookup(n, i);                   // names is quadratic
+    return 0;
+}
+#endif // EZXML_BENCH
+
+#ifdef EZXML_TEST // test harness
+// feeds the file to a push parser in small chunks, prints each tag returned
+static int ezxml_test_push(const char *file, int depth, int opt)
+{
+    ezxml_push_t p = ezxml_push_new(depth, opt);
+    FILE *fp = fopen(file, "r");
+    ezxml_t xml;
+    char buf[4096], *s;
+    size_t l = 1;
+    int n = 0, i;
+
+    if (! p || ! fp) return fprintf(stderr, "cannot open %s\n", file);
+    while (l && ! ezxml_push_feed(p, buf, l = fread(buf, 1, sizeof(buf), fp))) {
+        while ((xml = ezxml_push_next(p))) {
+            printf("%s\n", (s = ezxml_toxml(xml)));
+            free(s);
+            if (*ezxml_error(xml)) fprintf(stderr, "%s\n", ezxml_error(xml));
+            ezxml_free(xml);
+            n++;
+        }
+    }
+    i = fprintf(stderr, "%s", ezxml_push_error(p));
+    fprintf(stderr, "%s%d tags\n", (i) ? "\n" : "", n);
+    ezxml_push_free(p);
+    fclose(fp);
+    return (i) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    ezxml_t xml;
+    struct ezxml_stats st;
+    char *s;
+    int i, opt = 0, depth = -1, w = 0;
+
+    for (i = 1; i < argc - 1; i++) {
+        if (! strcmp(argv[i], "-a")) opt = EZXML_OPT_ARENA;
+        else if (! strcmp(argv[i], "-w")) w = 1; // ezxml_toxml_fd() to stdout
+        else if (! strcmp(argv[i], "-s") && i < argc - 2)
+            depth = atoi(argv[++i]);
+        else break;
+    }
+    if (i != argc - 1)
+        return fprintf(stderr, "usage: %s [-a] [-w] [-s depth] xmlfile\n", argv[0]);
+    if (depth >= 0) return ezxml_test_push(argv[i], depth, opt);
+
+    xml = ezxml_parse_file_opt(argv[i], opt);
+    st = ezxml_alloc_stats(xml);
+    if (w) {
+        if (ezxml_toxml_fd(xml, STDOUT_FILENO)) perror("ezxml_toxml_fd");
+        printf("\n");
+    }
+    else {
+        printf("%s\n", (s = ezxml_toxml(xml)));
+        free(s);
+    }
     i = fprintf(stderr, "%s", ezxml_error(xml));
+    fprintf(stderr, "%s%lu allocations, %lu from the arena (%lu bytes)\n",
+            (i) ? "\n" : "", (unsigned long)st.allocs,
+            (unsigned long)st.arena_allocs, (unsigned long)st.arena_bytes);
     ezxml_free(xml);
     return (i) ? 1 : 0;
 }
@@ -38,6 +38,9 @@ extern "C" {
 #define EZXML_NAMEM   0x80 // name is malloced
 #define EZXML_TXTM    0x40 // txt is malloced
 #define EZXML_DUP     0x20 // attribute name and value are strduped
+#define EZXML_ARENA   0x10 // tag is allocated from the arena of its document
+
+#define EZXML_OPT_ARENA 0x01 // parser option: allocate from one arena per document
 
 typedef struct ezxml *ezxml_t;
 struct ezxml {
@@ -51,6 +54,14 @@ struct ezxml {
     ezxml_t child;   // head of sub tag list, NULL if none
     ezxml_t parent;  // parent tag, NULL if current tag is root tag
     short flags;     // additional information
+    struct ezxml_index *index; // lookup index, NULL until needed
+};
+
+// allocation counters of one document, see ezxml_alloc_stats()
+struct ezxml_stats {
+    size_t allocs;       // malloc() and realloc() calls
+    size_t arena_allocs; // allocations served by the arena
+    size_t arena_bytes;  // bytes reserved by the arena blocks
 };
 
 // Given a string of xml data and its length, parses it and creates an ezxml
@@ -69,11 +80,101 @@ ezxml_t ezxml_parse_file(const char *file);
     
 // Wrapper for ezxml_parse_str() that accepts a file stream. Reads the entire
 // stream into memory and then parses it. For xml files, use ezxml_parse_file()
-// or ezxml_parse_fd()
+// or ezxml_parse_fd(), for streams too large to hold use ezxml_push_new()
 ezxml_t ezxml_parse_fp(FILE *fp);
 
-// returns the first child tag (one level deeper) with the given name or NULL
-// if not found
+// Variants of the above taking parser options. With EZXML_OPT_ARENA all tags,
+// attribute lists, decoded strings and the root of the document are taken
+// from a bump allocator and ezxml_free() of the root releases them at once.
+// Tags of such a document must not be moved to another document, a tag
+// removed with ezxml_remove() stays allocated until the root is freed.
+ezxml_t ezxml_parse_str_opt(char *s, size_t len, int opt);
+ezxml_t ezxml_parse_fd_opt(int fd, int opt);
+ezxml_t ezxml_parse_file_opt(const char *file, int opt);
+ezxml_t ezxml_parse_fp_opt(FILE *fp, int opt);
+
+// Push parser for documents too large to hold in memory at once. Input is
+// appended in chunks of any size with ezxml_push_feed(), a length of 0 marks
+// the end of input. After each call, ezxml_push_next() returns the tags at
+// the depth given to ezxml_push_new() (1 for the children of the root tag, 0
+// for the whole document) that are complete so far, each one as a document
+// of its own that the caller frees with ezxml_free(). Only the pending tag is
+// buffered, the tags above it are checked for balance, not for their names,
+// and the document type declaration is passed on to every tag returned.
+// Input must be UTF-8. Once ezxml_push_next() returned NULL at the end of
+// input, ezxml_push_error() tells whether the document was complete.
+typedef struct ezxml_push *ezxml_push_t;
+ezxml_push_t ezxml_push_new(int depth, int opt);
+int ezxml_push_feed(ezxml_push_t p, const char *s, size_t len);
+ezxml_t ezxml_push_next(ezxml_push_t p);
+const char *ezxml_push_error(ezxml_push_t p);
+void ezxml_push_free(ezxml_push_t p);
+
+// Read-only documents. ezxml_parse_fd() maps the file writable and private and
+// decodes it in place, so every page touched becomes a private copy. A read-
+// only document maps the file read-only and shared instead, several processes
+// reading the same file share its pages and nothing is ever written to it.
+// Tag names and raw content are views into the mapping, character content
+// and attribute values are decoded on first access and kept with the tag.
+// Entities declared in a DTD are not expanded, UTF-16 is not supported.
+// Truncating a mapped file while its document is in use raises SIGBUS.
+typedef struct ezxml_view *ezxml_view_t;
+typedef struct ezxml_vtag *ezxml_vtag_t;
+
+// Parses len bytes at s, which are not modified and must stay valid until
+// the document is freed. Like the other parse functions, check
+// ezxml_view_error() for syntax errors. The error messages and lines are not
+// always those of ezxml_parse_str(), which for instance reports an unclosed
+// document at its last tag rather than at its end. Returns NULL on failure.
+ezxml_view_t ezxml_view_str(const char *s, size_t len);
+
+// maps the file read-only, falling back to reading it into memory
+ezxml_view_t ezxml_view_fd(int fd);
+
+// a wrapper for ezxml_view_fd() that accepts a file name
+ezxml_view_t ezxml_view_file(const char *file);
+
+// returns the root tag of a read-only document, NULL if there is none
+ezxml_vtag_t ezxml_view_root(ezxml_view_t view);
+
+// returns the error string of a read-only document, empty if there is none
+const char *ezxml_view_error(ezxml_view_t view);
+
+// frees a read-only document, its tags and their decoded strings
+void ezxml_view_free(ezxml_view_t view);
+
+// returns the tag name, not null terminated, len is set to its length
+const char *ezxml_vname(ezxml_vtag_t xml, size_t *len);
+
+// returns the raw character content including sub tags, not null terminated,
+// len is set to its length
+const char *ezxml_vraw(ezxml_vtag_t xml, size_t *len);
+
+// returns the first sub tag with the given name, the first sub tag at all if
+// name is NULL, or NULL if not found
+ezxml_vtag_t ezxml_vchild(ezxml_vtag_t xml, const char *name);
+
+// returns the next tag of the same name in the same section and depth or NULL
+ezxml_vtag_t ezxml_vnext(ezxml_vtag_t xml);
+
+// returns the next tag in the same section and depth in document order
+ezxml_vtag_t ezxml_vordered(ezxml_vtag_t xml);
+
+// returns the decoded character content of the tag, "" if none
+const char *ezxml_vtxt(ezxml_vtag_t xml);
+
+// returns the decoded value of the requested attribute or NULL if not found
+const char *ezxml_vattr(ezxml_vtag_t xml, const char *attr);
+
+// Returns the allocation counters of the document the given tag belongs to.
+// Allocations are counted while parsing and for changes of arena documents.
+struct ezxml_stats ezxml_alloc_stats(ezxml_t xml);
+
+// Returns the first child tag (one level deeper) with the given name or NULL
+// if not found. A tag with many differently named children gets a hash index
+// of them on the first lookup that has to search beyond the first few, the
+// index is dropped when its children or attributes change. Tag names of a
+// parsed document are interned, tags of the same name share one string.
 ezxml_t ezxml_child(ezxml_t xml, const char *name);
 
 // returns the next tag of the same name in the same section and depth or NULL
@@ -81,7 +182,9 @@ ezxml_t ezxml_child(ezxml_t xml, const char *name);
 #define ezxml_next(xml) ((xml) ? xml->next : NULL)
 
 // Returns the Nth tag with the same name in the same section at the same depth
-// or NULL if not found. An index of 0 returns the tag given.
+// or NULL if not found. An index of 0 returns the tag given. For the first tag
+// of a long list, as returned by ezxml_child(), the index of the parent finds
+// it in constant time.
 ezxml_t ezxml_idx(ezxml_t xml, int idx);
 
 // returns the name of the given tag
@@ -90,7 +193,8 @@ ezxml_t ezxml_idx(ezxml_t xml, int idx);
 // returns the given tag's character content or empty string if none
 #define ezxml_txt(xml) ((xml) ? xml->txt : "")
 
-// returns the value of the requested tag attribute, or NULL if not found
+// returns the value of the requested tag attribute, or NULL if not found, the
+// attributes of a tag with many of them are indexed like its children
 const char *ezxml_attr(ezxml_t xml, const char *attr);
 
 // Traverses the ezxml sturcture to retrieve a specific subtag. Takes a
@@ -102,9 +206,19 @@ const char *ezxml_attr(ezxml_t xml, const char *attr);
 ezxml_t ezxml_get(ezxml_t xml, ...);
 
 // Converts an ezxml structure back to xml. Returns a string of xml data that
-// must be freed.
+// must be freed, or NULL if out of memory.
 char *ezxml_toxml(ezxml_t xml);
 
+// Converts an ezxml structure into buf of size bytes, truncating it like
+// snprintf(). Returns the length of the whole xml data, excluding the NUL.
+// ezxml_toxml_buf(xml, NULL, 0) measures it.
+size_t ezxml_toxml_buf(ezxml_t xml, char *buf, size_t size);
+
+// Writes an ezxml structure as xml to the file descriptor fd with writev(),
+// without building it in memory. Returns 0 on success, -1 with errno set on
+// a write error.
+int ezxml_toxml_fd(ezxml_t xml, int fd);
+
 // returns a NULL terminated array of processing instructions for the given
 // target
 const char **ezxml_pi(ezxml_t xml, const char *target);
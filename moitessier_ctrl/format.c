@@ -0,0 +1,187 @@
+/*
+    Machine readable output of the statistics and info commands (see
+    format.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "moitessier_ctrl.h"
+#include "format.h"
+
+int format_parse(const char *name)
+{
+    if(!strcmp(name, "text"))
+        return FORMAT_TEXT;
+    if(!strcmp(name, "json"))
+        return FORMAT_JSON;
+    if(!strcmp(name, "csv"))
+        return FORMAT_CSV;
+    if(!strcmp(name, "bin"))
+        return FORMAT_BINARY;
+    return -1;
+}
+
+static void binary_record(struct st_outBuf *ob, const void *data, uint32_t len)
+{
+    outbuf_append(ob, &len, sizeof(len));
+    outbuf_append(ob, data, len);
+}
+
+/* Appends a quoted string, the string fields of st_info are not necessarily
+   terminated. JSON and CSV (RFC 4180) only differ in how '"' is escaped,
+   non printable characters are dropped. */
+static void quoted(struct st_outBuf *ob, int format, const uint8_t *value, size_t size)
+{
+    size_t i;
+    char c;
+
+    outbuf_append(ob, "\"", 1);
+    for(i = 0; i < size && value[i]; i++)
+    {
+        c = (char)value[i];
+        if(c == '"')
+            outbuf_append(ob, (format == FORMAT_JSON) ? "\\\"" : "\"\"", 2);
+        else if(c == '\\' && format == FORMAT_JSON)
+            outbuf_append(ob, "\\\\", 2);
+        else if((unsigned char)c >= 0x20 && (unsigned char)c < 0x7f)
+            outbuf_append(ob, &c, 1);
+    }
+    outbuf_append(ob, "\"", 1);
+}
+
+void format_statistics(struct st_outBuf *ob, int format, const struct st_statistics *statistics)
+{
+    switch(format)
+    {
+        case FORMAT_JSON:
+            outbuf_printf(ob, "{\"spiCycles\":%llu,\"totalRxPayloadBytes\":%llu,\"fifoOverflows\":%llu,\"fifoBytesProcessed\":%llu,"
+                              "\"payloadCrcErrors\":%llu,\"headerCrcErrors\":%llu,\"keepAliveErrors\":%llu}\n",
+                          (unsigned long long)statistics->spiCycles, (unsigned long long)statistics->totalRxPayloadBytes,
+                          (unsigned long long)statistics->fifoOverflows, (unsigned long long)statistics->fifoBytesProcessed,
+                          (unsigned long long)statistics->payloadCrcErrors, (unsigned long long)statistics->headerCrcErrors,
+                          (unsigned long long)statistics->keepAliveErrors);
+            break;
+        case FORMAT_CSV:
+            outbuf_printf(ob, "spiCycles,totalRxPayloadBytes,fifoOverflows,fifoBytesProcessed,payloadCrcErrors,headerCrcErrors,keepAliveErrors\n"
+                              "%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                          (unsigned long long)statistics->spiCycles, (unsigned long long)statistics->totalRxPayloadBytes,
+                          (unsigned long long)statistics->fifoOverflows, (unsigned long long)statistics->fifoBytesProcessed,
+                          (unsigned long long)statistics->payloadCrcErrors, (unsigned long long)statistics->headerCrcErrors,
+                          (unsigned long long)statistics->keepAliveErrors);
+            break;
+        case FORMAT_BINARY:
+            binary_record(ob, statistics, sizeof(*statistics));
+            break;
+        default:
+            break;
+    }
+}
+
+static void info_json(struct st_outBuf *ob, const struct st_info *info)
+{
+    const struct st_receiverConfig *c;
+    int i;
+
+    outbuf_printf(ob, "{\"valid\":%s,\"mode\":", info->valid ? "true" : "false");
+    quoted(ob, FORMAT_JSON, &info->mode, 1);
+    outbuf_append(ob, ",\"hwId\":", 8);
+    quoted(ob, FORMAT_JSON, info->hwId, sizeof(info->hwId));
+    outbuf_append(ob, ",\"hwVer\":", 9);
+    quoted(ob, FORMAT_JSON, info->hwVer, sizeof(info->hwVer));
+    outbuf_append(ob, ",\"bootVer\":", 11);
+    quoted(ob, FORMAT_JSON, info->bootVer, sizeof(info->bootVer));
+    outbuf_append(ob, ",\"appVer\":", 10);
+    quoted(ob, FORMAT_JSON, info->appVer, sizeof(info->appVer));
+    outbuf_append(ob, ",\"gnssVer\":", 11);
+    quoted(ob, FORMAT_JSON, info->gnssVer, sizeof(info->gnssVer));
+    outbuf_printf(ob, ",\"functionality\":%u,\"systemErrors\":%u,\"serial\":\"%08x%08x%08x\",\"rcv\":[",
+                  (unsigned int)info->functionality, (unsigned int)info->systemErrors,
+                  (unsigned int)info->serial.h, (unsigned int)info->serial.m, (unsigned int)info->serial.l);
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        c = &info->rcv[i].config;
+        outbuf_printf(ob, "%s{\"channelFreq\":[%u,%u],\"tcxoFreq\":%u,\"metaDataMask\":%u,\"afcRange\":%u,\"afcRangeDefault\":%u,\"rng\":[%u,%u]}",
+                      i ? "," : "", (unsigned int)c->channelFreq[0], (unsigned int)c->channelFreq[1], (unsigned int)c->tcxoFreq,
+                      (unsigned int)c->metaDataMask, (unsigned int)c->afcRange, (unsigned int)c->afcRangeDefault,
+                      (unsigned int)info->rcv[i].rng[0], (unsigned int)info->rcv[i].rng[1]);
+    }
+    outbuf_printf(ob, "],\"simulator\":{\"enabled\":%u,\"interval\":%u,\"mmsi\":[%u,%u]},"
+                      "\"wpEEPROM\":%u,\"buttonPressed\":%u,\"gnssSysSupported\":%u}\n",
+                  (unsigned int)info->simulator.enabled, (unsigned int)info->simulator.interval,
+                  (unsigned int)info->simulator.mmsi[0], (unsigned int)info->simulator.mmsi[1],
+                  (unsigned int)info->wpEEPROM, (unsigned int)info->buttonPressed, (unsigned int)info->gnssSysSupported);
+}
+
+static void info_csv(struct st_outBuf *ob, const struct st_info *info)
+{
+    const struct st_receiverConfig *c;
+    int i;
+
+    outbuf_printf(ob, "valid,mode,hwId,hwVer,bootVer,appVer,gnssVer,functionality,systemErrors,serial");
+    for(i = 1; i <= NUM_RCV; i++)
+        outbuf_printf(ob, ",rcv%dChannelFreq1,rcv%dChannelFreq2,rcv%dTcxoFreq,rcv%dMetaDataMask,rcv%dAfcRange,rcv%dAfcRangeDefault,rcv%dRng1,rcv%dRng2",
+                      i, i, i, i, i, i, i, i);
+    outbuf_printf(ob, ",simulatorEnabled,simulatorInterval,simulatorMmsi1,simulatorMmsi2,wpEEPROM,buttonPressed,gnssSysSupported\n");
+
+    outbuf_printf(ob, "%u,", info->valid ? 1 : 0);
+    quoted(ob, FORMAT_CSV, &info->mode, 1);
+    outbuf_append(ob, ",", 1);
+    quoted(ob, FORMAT_CSV, info->hwId, sizeof(info->hwId));
+    outbuf_append(ob, ",", 1);
+    quoted(ob, FORMAT_CSV, info->hwVer, sizeof(info->hwVer));
+    outbuf_append(ob, ",", 1);
+    quoted(ob, FORMAT_CSV, info->bootVer, sizeof(info->bootVer));
+    outbuf_append(ob, ",", 1);
+    quoted(ob, FORMAT_CSV, info->appVer, sizeof(info->appVer));
+    outbuf_append(ob, ",", 1);
+    quoted(ob, FORMAT_CSV, info->gnssVer, sizeof(info->gnssVer));
+    outbuf_printf(ob, ",%u,%u,%08x%08x%08x",
+                  (unsigned int)info->functionality, (unsigned int)info->systemErrors,
+                  (unsigned int)info->serial.h, (unsigned int)info->serial.m, (unsigned int)info->serial.l);
+    for(i = 0; i < NUM_RCV; i++)
+    {
+        c = &info->rcv[i].config;
+        outbuf_printf(ob, ",%u,%u,%u,%u,%u,%u,%u,%u",
+                      (unsigned int)c->channelFreq[0], (unsigned int)c->channelFreq[1], (unsigned int)c->tcxoFreq,
+                      (unsigned int)c->metaDataMask, (unsigned int)c->afcRange, (unsigned int)c->afcRangeDefault,
+                      (unsigned int)info->rcv[i].rng[0], (unsigned int)info->rcv[i].rng[1]);
+    }
+    outbuf_printf(ob, ",%u,%u,%u,%u,%u,%u,%u\n",
+                  (unsigned int)info->simulator.enabled, (unsigned int)info->simulator.interval,
+                  (unsigned int)info->simulator.mmsi[0], (unsigned int)info->simulator.mmsi[1],
+                  (unsigned int)info->wpEEPROM, (unsigned int)info->buttonPressed, (unsigned int)info->gnssSysSupported);
+}
+
+void format_info(struct st_outBuf *ob, int format, const struct st_info *info)
+{
+    switch(format)
+    {
+        case FORMAT_JSON:
+            info_json(ob, info);
+            break;
+        case FORMAT_CSV:
+            info_csv(ob, info);
+            break;
+        case FORMAT_BINARY:
+            binary_record(ob, info, sizeof(*info));
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,40 @@
+/*
+    Machine readable output of the statistics and info commands.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "moitessier_ctrl.h"
+#include "outbuf.h"
+
+#define FORMAT_TEXT                 0       /* the human readable printf output */
+#define FORMAT_JSON                 1       /* one compact JSON object per line */
+#define FORMAT_CSV                  2       /* header line plus one record */
+#define FORMAT_BINARY               3       /* uint32_t length (host byte order) plus the raw IOCTL structure */
+
+/* "text", "json", "csv" or "bin", returns -1 if the name is unknown */
+int format_parse(const char *name);
+
+/* Append the structure in the given format (not FORMAT_TEXT). The CSV
+   columns only ever get appended to, so the header is stable. */
+void format_statistics(struct st_outBuf *ob, int format, const struct st_statistics *statistics);
+void format_info(struct st_outBuf *ob, int format, const struct st_info *info);
+
+#endif /* FORMAT_H */
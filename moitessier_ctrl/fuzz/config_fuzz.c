@@ -0,0 +1,77 @@
+/*
+    Fuzz target for the binding of config.xml (config_bind.c) of the Moitessier
+    HAT control program.
+
+    Every input is bound to struct st_configHAT. A configuration that binds
+    without error is written as config.xml again (config_write_xml() into a
+    pipe) and bound a second time, both bindings have to be equal. The error
+    messages of config_bind_xml() go to stdout, they are silenced while
+    fuzzing unless FUZZ_VERBOSE is set in the environment.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "config_bind.h"
+
+#define FUZZ_XML_MAX                4096    /* config.xml as written, fits into a pipe */
+
+/* writes configHAT as config.xml and binds it again into copy */
+static int fuzz_rebind(const struct st_configHAT *configHAT, struct st_configHAT *copy)
+{
+    char buf[FUZZ_XML_MAX];
+    ssize_t len;
+    int fd[2];
+
+    if(pipe(fd) != 0)
+        return 0;
+    len = (config_write_xml(fd[1], configHAT) == 0) ? read(fd[0], buf, sizeof(buf)) : -1;
+    close(fd[0]);
+    close(fd[1]);
+    if(len <= 0 || len == sizeof(buf))
+        abort();
+    return config_bind_xml("rebind", buf, len, copy);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static FILE *null;
+    struct st_configHAT configHAT;
+    struct st_configHAT copy;
+    char *s;
+    int rc;
+
+    if(!null && !getenv("FUZZ_VERBOSE"))
+        null = freopen("/dev/null", "w", stdout);
+
+    s = malloc(size);                   /* exactly size, so overreads are caught */
+    if(!s)
+        return 0;
+    memcpy(s, data, size);
+    memset(&configHAT, 0xA5, sizeof(configHAT));
+    rc = config_bind_xml("fuzz", s, size, &configHAT);
+    free(s);
+    if(rc == 0 && (fuzz_rebind(&configHAT, &copy) != 0 || memcmp(&configHAT, &copy, sizeof(copy))))
+        abort();
+    return 0;
+}
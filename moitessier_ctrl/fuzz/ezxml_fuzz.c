@@ -0,0 +1,152 @@
+/*
+    Fuzz target for the XML parser (ezxml) of the Moitessier HAT control program.
+
+    Every input is parsed with malloc() and with an arena, as a read-only
+    document and with the push parser fed in small chunks. The lookups of the
+    parsed tree are checked against its lists and the tree is written back
+    with all three serializer outputs. A lookup that disagrees with the lists
+    aborts, so it is reported like a crash.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ezxml.h"
+
+/* checks the index of every tag against the sibling, next and attribute lists */
+static void fuzz_walk(ezxml_t xml)
+{
+    ezxml_t sib;
+    ezxml_t tag;
+    int i;
+
+    for(sib = xml->child; sib; sib = sib->sibling)
+    {
+        if(ezxml_child(xml, sib->name) != sib)
+            abort();
+        for(tag = sib, i = 0; tag; tag = tag->next, i++)
+        {
+            if(ezxml_idx(sib, i) != tag || tag->parent != xml)
+                abort();
+            fuzz_walk(tag);
+        }
+        if(ezxml_idx(sib, i))
+            abort();
+    }
+    for(i = 0; xml->attr[i]; i += 2)
+    {
+        if(!ezxml_attr(xml, xml->attr[i]))
+            abort();
+    }
+}
+
+static void fuzz_tree(const uint8_t *data, size_t size, int opt)
+{
+    char *s;
+    char *out;
+    char buf[16];
+    ezxml_t xml;
+    size_t len;
+    int fd;
+
+    s = malloc(size);                   /* exactly size, so overreads are caught */
+    if(!s)
+        return;
+    memcpy(s, data, size);
+    xml = ezxml_parse_str_opt(s, size, opt);
+    if(xml)
+    {
+        fuzz_walk(xml);
+        out = ezxml_toxml(xml);
+        len = strlen(out);
+        if(ezxml_toxml_buf(xml, buf, sizeof(buf)) != len || strncmp(buf, out, sizeof(buf) - 1))
+            abort();
+        fd = open("/dev/null", O_WRONLY);
+        ezxml_toxml_fd(xml, fd);
+        close(fd);
+        ezxml_free(xml);
+        ezxml_free(ezxml_parse_str(out, len));     /* parse what was written */
+        free(out);
+    }
+    free(s);
+}
+
+static void fuzz_vwalk(ezxml_vtag_t xml)
+{
+    char name[64];
+    const char *n;
+    size_t len;
+
+    for(; xml; xml = ezxml_vordered(xml))
+    {
+        n = ezxml_vname(xml, &len);
+        snprintf(name, sizeof(name), "%.*s", (int)len, n);
+        ezxml_vraw(xml, &len);
+        ezxml_vtxt(xml);
+        ezxml_vattr(xml, name);
+        ezxml_vnext(xml);
+        fuzz_vwalk(ezxml_vchild(xml, NULL));
+    }
+}
+
+static void fuzz_push(const uint8_t *data, size_t size, int depth)
+{
+    ezxml_push_t p;
+    ezxml_t xml;
+    size_t chunk;
+    size_t i;
+
+    p = ezxml_push_new(depth, 0);
+    if(!p)
+        return;
+    chunk = (size) ? data[size - 1] % 61 + 1 : 1;
+    for(i = 0; i <= size; i += chunk)
+    {
+        if(i + chunk > size)            /* the rest, then the end of input */
+            chunk = (i < size) ? size - i : 0;
+        if(ezxml_push_feed(p, (const char *)data + i, chunk) != 0)
+            break;
+        while((xml = ezxml_push_next(p)))
+            ezxml_free(xml);
+        if(!chunk)
+            break;
+    }
+    ezxml_push_free(p);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    ezxml_view_t view;
+
+    fuzz_tree(data, size, 0);
+    fuzz_tree(data, size, EZXML_OPT_ARENA);
+
+    view = ezxml_view_str((const char *)data, size);
+    if(view)
+    {
+        fuzz_vwalk(ezxml_view_root(view));
+        ezxml_view_free(view);
+    }
+
+    fuzz_push(data, size, 1);
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+    Stand-alone driver for the fuzz targets of the Moitessier HAT control
+    program, for machines without libFuzzer.
+
+    Linked with one of the targets (ezxml_fuzz.c, config_fuzz.c) it calls
+    LLVMFuzzerTestOneInput() like libFuzzer does and takes a subset of its
+    arguments:
+
+        bin/ezxml_fuzz [-runs=N] [-seed=N] [-timeout=S] [FILE|DIR ...]
+
+    Every given file and every file in a given directory is run once, stdin if
+    there is none, which is how AFL runs a target (afl-fuzz ... -- bin/ezxml_fuzz @@).
+    With -runs=N, N inputs are then made by mutating these seeds: bytes are
+    replaced, XML tokens inserted and ranges deleted or repeated. An input that
+    crashes or runs longer than the timeout is written to crash-<RUN> or
+    timeout-<RUN> before the program dies.
+
+    Built with clang -fsanitize=fuzzer the targets are linked without this file
+    (see "make fuzz" in the Makefile).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __SANITIZE_ADDRESS__
+#include <sanitizer/common_interface_defs.h>
+#endif
+
+#define FUZZ_MAX_LEN                16384   /* longest mutated input, bounds the nesting depth */
+#define FUZZ_MAX_SEEDS              1024
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+/* tokens inserted by the mutator, the targets parse XML */
+static const char *fuzzTokens[] = {
+    "<", ">", "</", "/>", "<a>", "</a>", "=\"", "\"", "'", " ", "\n", "\r\n",
+    "&amp;", "&lt;", "&#", "&#x", ";", "&e;", "%e;", "<![CDATA[", "]]>",
+    "<!--", "-->", "<?", "?>", "<?xml version=\"1.0\"?>",
+    "<!DOCTYPE a [", "]>", "<!ENTITY e \"", "<!ENTITY % e \"", "<!ATTLIST a b CDATA \"",
+    "\xef\xbb\xbf", "\xff\xfe", "\xfe\xff", "\0"
+};
+
+static struct{
+    uint8_t     *data;                  /* input being run */
+    size_t      len;
+    uint32_t    run;
+    uint32_t    random;                 /* state of fuzzRandom() */
+} fuzz = { NULL, 0, 0, 2463534242u };
+
+/* xorshift32 */
+static uint32_t fuzzRandom(void)
+{
+    fuzz.random ^= fuzz.random << 13;
+    fuzz.random ^= fuzz.random >> 17;
+    fuzz.random ^= fuzz.random << 5;
+    return fuzz.random;
+}
+
+/* writes the input being run to <prefix>-<RUN>, async-signal-safe */
+static void fuzz_save(const char *prefix)
+{
+    char name[32];
+    char num[12];
+    int i = 11;
+    uint32_t n = fuzz.run;
+    int fd;
+
+    num[i] = '\0';
+    do
+    {
+        num[--i] = '0' + n % 10;
+        n /= 10;
+    } while(n);
+    strcpy(name, prefix);
+    strcat(name, num + i);
+
+    fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0)
+    {
+        write(fd, fuzz.data, fuzz.len);
+        close(fd);
+    }
+}
+
+static void fuzz_crash(void)
+{
+    fuzz_save("crash-");
+}
+
+static void fuzz_signal(int sig)
+{
+    fuzz_save((sig == SIGALRM) ? "timeout-" : "crash-");
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/* reads a whole file (stdin if fileName is NULL) into *data */
+static int fuzz_read(const char *fileName, uint8_t **data, size_t *len)
+{
+    size_t max = 4096;
+    ssize_t n;
+    int fd;
+
+    fd = (fileName) ? open(fileName, O_RDONLY) : STDIN_FILENO;
+    if(fd < 0)
+        return -1;
+    *data = malloc(max);
+    *len = 0;
+    while(*data && (n = read(fd, *data + *len, max - *len)) > 0)
+    {
+        *len += n;
+        if(*len == max)
+            *data = realloc(*data, max *= 2);
+    }
+    if(fileName)
+        close(fd);
+    return (*data) ? 0 : -1;
+}
+
+static void fuzz_run(uint8_t *data, size_t len, uint32_t timeout)
+{
+    fuzz.data = data;
+    fuzz.len = len;
+    alarm(timeout);
+    LLVMFuzzerTestOneInput(data, len);
+    alarm(0);
+    fuzz.run++;
+}
+
+/* one to four random mutations of seed into buf, returns the new length */
+static size_t fuzz_mutate(uint8_t *buf, const uint8_t *seed, size_t len)
+{
+    const char *t;
+    size_t pos;
+    size_t n;
+    int k;
+
+    memcpy(buf, seed, len);
+    for(k = 1 + fuzzRandom() % 4; k > 0; k--)
+    {
+        pos = (len) ? fuzzRandom() % (len + 1) : 0;
+        switch(fuzzRandom() % 4)
+        {
+            case 0:                         /* replace a byte */
+                if(pos < len)
+                    buf[pos] = fuzzRandom();
+                break;
+            case 1:                         /* insert a token */
+                t = fuzzTokens[fuzzRandom() % (sizeof(fuzzTokens) / sizeof(fuzzTokens[0]))];
+                n = (*t) ? strlen(t) : 1;
+                if(len + n > FUZZ_MAX_LEN)
+                    break;
+                memmove(buf + pos + n, buf + pos, len - pos);
+                memcpy(buf + pos, t, n);
+                len += n;
+                break;
+            case 2:                         /* delete a range */
+                n = fuzzRandom() % 16 + 1;
+                if(pos + n > len)
+                    n = len - pos;
+                memmove(buf + pos, buf + pos + n, len - pos - n);
+                len -= n;
+                break;
+            default:                        /* repeat a range */
+                n = fuzzRandom() % 64 + 1;
+                if(pos + n > len)
+                    n = len - pos;
+                if(!n || len + n > FUZZ_MAX_LEN)
+                    break;
+                memmove(buf + pos + n, buf + pos, len - pos);
+                len += n;
+                break;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t *seeds[FUZZ_MAX_SEEDS];
+    static size_t lens[FUZZ_MAX_SEEDS];
+    uint32_t numSeeds = 0;
+    uint32_t runs = 0;
+    uint32_t timeout = 10;
+    uint32_t i;
+    uint8_t *buf;
+    char path[4096];
+    struct dirent *e;
+    struct stat st;
+    DIR *dir;
+    int a;
+
+#ifdef __SANITIZE_ADDRESS__
+    __sanitizer_set_death_callback(fuzz_crash);     /* after the sanitizer's report */
+#else
+    (void)fuzz_crash;
+    signal(SIGSEGV, fuzz_signal);
+    signal(SIGBUS, fuzz_signal);
+    signal(SIGFPE, fuzz_signal);
+    signal(SIGILL, fuzz_signal);
+    signal(SIGABRT, fuzz_signal);
+#endif
+    signal(SIGALRM, fuzz_signal);
+
+    for(a = 1; a < argc; a++)
+    {
+        if(!strncmp(argv[a], "-runs=", 6))
+            runs = strtoul(argv[a] + 6, NULL, 10);
+        else if(!strncmp(argv[a], "-seed=", 6))
+            fuzz.random = strtoul(argv[a] + 6, NULL, 10) | 1;
+        else if(!strncmp(argv[a], "-timeout=", 9))
+            timeout = strtoul(argv[a] + 9, NULL, 10);
+        else if(argv[a][0] == '-')
+            fprintf(stderr, "WARNING: option %s ignored\n", argv[a]);
+        else if(stat(argv[a], &st) == 0 && S_ISDIR(st.st_mode) && (dir = opendir(argv[a])))
+        {
+            while((e = readdir(dir)) && numSeeds < FUZZ_MAX_SEEDS)
+            {
+                snprintf(path, sizeof(path), "%s/%s", argv[a], e->d_name);
+                if(stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_size <= FUZZ_MAX_LEN &&
+                   fuzz_read(path, &seeds[numSeeds], &lens[numSeeds]) == 0)
+                    numSeeds++;
+            }
+            closedir(dir);
+        }
+        else if(numSeeds < FUZZ_MAX_SEEDS && fuzz_read(argv[a], &seeds[numSeeds], &lens[numSeeds]) == 0)
+            numSeeds++;
+        else
+            fprintf(stderr, "WARNING: could not read %s\n", argv[a]);
+    }
+    if(!numSeeds && fuzz_read(NULL, &seeds[numSeeds], &lens[numSeeds]) == 0)
+        numSeeds++;
+
+    for(i = 0; i < numSeeds; i++)
+        fuzz_run(seeds[i], lens[i], timeout);
+    fprintf(stderr, "%u inputs run\n", numSeeds);
+    if(!runs)
+        return 0;
+
+    buf = malloc(FUZZ_MAX_LEN);
+    for(i = 0; i < runs; i++)
+    {
+        a = fuzzRandom() % numSeeds;
+        fuzz_run(buf, fuzz_mutate(buf, seeds[a], (lens[a] < FUZZ_MAX_LEN) ? lens[a] : FUZZ_MAX_LEN), timeout);
+        if((i + 1) % 100000 == 0)
+            fprintf(stderr, "%u mutations run\n", i + 1);
+    }
+    if(runs % 100000)
+        fprintf(stderr, "%u mutations run\n", runs);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+    Helper functions to communicate with the Moitessier HAT control device.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include "moitessier_ctrl.h"
+
+volatile sig_atomic_t stopRequested = 0;
+
+/* opens the control device, returns the file descriptor or -1 on error */
+int hat_open(const char *device)
+{
+    int fd;
+
+    fd = open(device, O_RDONLY);
+    if(fd < 0)
+        printf("error opening device %s\n", device);
+    return fd;
+}
+
+/* The driver copies its data into a buffer of IOCTL_BUF_SIZE bytes, so we never
+   pass a smaller structure directly. */
+int hat_get_statistics(int fd, struct st_statistics *statistics)
+{
+    unsigned char buf[IOCTL_BUF_SIZE];
+
+    memset(buf, 0, sizeof(buf));
+    if(ioctl(fd, IOCTL_GET_STATISTICS, &buf) < 0)
+        return -1;
+    memcpy(statistics, buf, sizeof(struct st_statistics));
+    return 0;
+}
+
+int hat_get_info(int fd, struct st_info *info)
+{
+    unsigned char buf[IOCTL_BUF_SIZE];
+
+    memset(buf, 0, sizeof(buf));
+    if(ioctl(fd, IOCTL_GET_INFO, &buf) < 0)
+        return -1;
+    memcpy(info, buf, sizeof(struct st_info));
+    return 0;
+}
+
+int hat_config(int fd, const struct st_configHAT *configHAT)
+{
+    unsigned char buf[IOCTL_BUF_SIZE];
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, configHAT, sizeof(struct st_configHAT));
+    if(ioctl(fd, IOCTL_CONFIG, &buf) < 0)
+        return -1;
+    return 0;
+}
+
+/* commands with a single byte parameter (IOCTL_GNSS, IOCTL_ID_EEPROM, IOCTL_GNSS_MSG_CONFIG) */
+static int hat_cmd_u8(int fd, int ioctlCmd, uint8_t param)
+{
+    unsigned char buf[IOCTL_BUF_SIZE];
+
+    memset(buf, 0, sizeof(buf));
+    buf[0] = param;
+    if(ioctl(fd, ioctlCmd, &buf) < 0)
+        return -1;
+    return 0;
+}
+
+int hat_gnss(int fd, bool enable)
+{
+    return hat_cmd_u8(fd, IOCTL_GNSS, enable ? 1 : 0);
+}
+
+int hat_gnss_msg_config(int fd, uint8_t mask)
+{
+    return hat_cmd_u8(fd, IOCTL_GNSS_MSG_CONFIG, mask);
+}
+
+/* monotonic time stamp in nanoseconds */
+uint64_t time_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* sleeps until the given CLOCK_MONOTONIC time stamp, returns -1 if interrupted by a signal */
+int sleep_until_ns(uint64_t deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+    if(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+        return -1;
+    return 0;
+}
+
+static void handle_stop(int sig)
+{
+    (void)sig;
+    stopRequested = 1;
+}
+
+/* installs handlers for SIGINT and SIGTERM that request a clean shutdown */
+void stop_on_signal(void)
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
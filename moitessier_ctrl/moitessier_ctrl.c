@@ -46,85 +46,24 @@
 #if HAVE_STROPTS_H
 #include <stropts.h>
 #endif /* HAVE_STROPTS_H */
-#include <stdint.h>
-#include <stdbool.h>
 #include "ezxml/ezxml.h"
-
-
-#define IOC_MAGIC 'N'
-#define IOCTL_CMDs                  8
-#define IOCTL_GET_STATISTICS        _IO(IOC_MAGIC,0)
-#define IOCTL_GET_INFO              _IO(IOC_MAGIC,1)
-#define IOCTL_RESET_HAT             _IO(IOC_MAGIC,2)
-#define IOCTL_RESET_STATISTICS      _IO(IOC_MAGIC,3)
-#define IOCTL_GNSS                  _IO(IOC_MAGIC,4)
-#define IOCTL_CONFIG                _IO(IOC_MAGIC,5)
-#define IOCTL_ID_EEPROM             _IO(IOC_MAGIC,6)
-#define IOCTL_GNSS_MSG_CONFIG       _IO(IOC_MAGIC,7)
-
-#define NUM_RCV_CHANNELS            2       /* number of receiver channels per receiver, should be 2 */
-#define NUM_RCV                     2       /* number of receivers, should be 2 */
-
-struct st_receiverConfig
-{
-    uint8_t         metaDataMask;                       
-    uint32_t        afcRange;                           
-    uint32_t        afcRangeDefault;                    
-    uint32_t        tcxoFreq;                           
-    uint32_t        channelFreq[NUM_RCV_CHANNELS];      
-};
-
-struct st_info_rcv{
-    struct st_receiverConfig    config;
-    uint8_t                     rng[NUM_RCV_CHANNELS];
-};
-
-struct st_info_serial{
-    uint32_t    h;      /* bits 95...64 */
-    uint32_t    m;      /* bits 63...32 */
-    uint32_t    l;      /* bits 31...0 */
-};
-
-struct st_simulator
-{
-    uint32_t mmsi[NUM_RCV_CHANNELS];
-    uint32_t enabled;
-    uint32_t interval;
-};
-
-struct st_info{
-    uint8_t                     mode;
-    uint8_t                     hwId[16];
-    uint8_t                     hwVer[8];
-    uint8_t                     bootVer[22];
-    uint8_t                     appVer[22];
-    uint32_t                    functionality;
-    uint32_t                    systemErrors;
-    struct st_info_serial       serial;
-    struct st_info_rcv          rcv[NUM_RCV];
-    struct st_simulator         simulator;
-    uint8_t                     wpEEPROM;
-    uint8_t                     buttonPressed;
-    uint8_t                     gnssVer[32];        
-    uint8_t                     gnssSysSupported;
-    bool                        valid;
-};
-
-struct st_statistics{
-    uint64_t                spiCycles;
-    uint64_t                totalRxPayloadBytes;
-    uint64_t                fifoOverflows;
-    uint64_t                fifoBytesProcessed;
-    uint64_t                payloadCrcErrors;
-    uint64_t                headerCrcErrors;
-    uint64_t                keepAliveErrors;
-};
-
-struct st_configHAT{
-    struct st_receiverConfig    rcv[NUM_RCV];
-    struct st_simulator         simulator;
-    uint8_t                     wpEEPROM;
-};
+#include "moitessier_ctrl.h"
+#include "stats_shm.h"
+#include "rates.h"
+#include "config.h"
+#include "batch.h"
+#include "exporter.h"
+#include "overflow_ctrl.h"
+#include "bench.h"
+#include "multi.h"
+#include "format.h"
+#include "reset.h"
+#include "calib.h"
+#include "temp.h"
+#include "tcxo_track.h"
+#include "recorder.h"
+#include "capacity.h"
+#include "watch.h"
 
 #define PATH_MAX        1024
 char* app_path(char * path, const char * argv0)
@@ -148,23 +87,221 @@ char* app_path(char * path, const char * argv0)
     return path;
 }
 
-int main (int argc,char** argv)
+/* Executes one of the IOCTL commands 0...7 and prints the result. paramv holds
+   the command parameters as given on the command line. For command 5 an
+   already loaded configuration can be passed in configHAT, otherwise the
+   configuration file given as first parameter is parsed. Returns the value
+   returned by the driver, which is negative on error. */
+int execute_ioctl_cmd(int fd, int cmd, int paramc, char **paramv, const struct st_configHAT *configHAT)
 {
-    int fd_moitessier;
-    int cmd = 0;
     int ioctlCmd = 0;
     int size;
-    unsigned char buf[1024];
+    unsigned char buf[IOCTL_BUF_SIZE];
     uint32_t params[255];
-    uint32_t i;
-    uint32_t k;
-    FILE *fd_param;
-    char* fileName;
-    ezxml_t xml;
-    
+    int i;
+    struct st_configHAT loadedConfig;
     struct st_info *info;
     struct st_statistics *statistics;
+    struct st_outBuf ob;
+    struct st_resetTimes times;
+    int format = FORMAT_TEXT;
+
+    memset(buf, 0, sizeof(buf));
+    memset(params, 0, sizeof(params));
+    for(i = 0; i < paramc && i < 255; i++)
+        params[i] = atoi(paramv[i]);
+
+    /* optional output format of the statistics and info commands */
+    if((cmd == 0 || cmd == 1) && paramc > 0)
+    {
+        format = format_parse(paramv[0]);
+        if(format < 0)
+        {
+            printf("ERROR: unknown output format \"%s\"\n", paramv[0]);
+            return -1;
+        }
+    }
+
+    switch(cmd)
+    {
+        case 0:
+            ioctlCmd = IOCTL_GET_STATISTICS;
+            break;
+        case 1:
+            ioctlCmd = IOCTL_GET_INFO;
+            break;
+        case 2:
+            ioctlCmd = IOCTL_RESET_HAT;
+            if(paramc < 1)
+                break;
+            /* wait until the HAT is ready again, optionally configure it right away */
+            if(!configHAT && paramc > 1)
+            {
+                if(config_load(paramv[1], &loadedConfig) != 0)
+                    return -1;
+                configHAT = &loadedConfig;
+            }
+            if(hat_reset_wait(fd, params[0], configHAT, &times) != 0)
+                return -1;
+            printf("reset to ready:\t\t\t %.3f ms (%u polls)\n", times.readyNs / 1e6, times.polls);
+            if(configHAT)
+                printf("reset to configured:\t\t %.3f ms\n", times.configNs / 1e6);
+            if(times.payloadNs)
+                printf("reset to first payload byte:\t %.3f ms\n", times.payloadNs / 1e6);
+            else
+                printf("reset to first payload byte:\t no payload within %u ms\n", params[0]);
+            return 0;
+        case 3: 
+            ioctlCmd = IOCTL_RESET_STATISTICS;
+            break;
+        case 4:
+            ioctlCmd = IOCTL_GNSS;
+            buf[0] = (char)params[0];
+            break;
+        case 5:
+            ioctlCmd = IOCTL_CONFIG;
+            if(!configHAT)
+            {
+                if(paramc < 1)
+                {
+                    printf("ERROR: missing configuration file\n");
+                    return -1;
+                }
+                if(config_load_xml(paramv[0], &loadedConfig) != 0)
+                    return -1;
+                configHAT = &loadedConfig;
+            }
+            memcpy(buf, configHAT, sizeof(struct st_configHAT));
+            break;
+        case 6:
+            ioctlCmd = IOCTL_ID_EEPROM;
+            buf[0] = (char)params[0];
+            break;
+        case 7:
+            ioctlCmd = IOCTL_GNSS_MSG_CONFIG;
+            buf[0] = (char)params[0];
+            break;
+        default:
+            printf("ERROR: command not supported\n");
+            return -1;
+    }
+    
+    size = ioctl(fd, ioctlCmd, &buf);
+
+    /* the whole record is built in one buffer and sent with a single write */
+    if(format != FORMAT_TEXT)
+    {
+        if(size < 0)
+        {
+            printf("ERROR: IOCTL failed\n");
+            return -1;
+        }
+        outbuf_init(&ob, 1024);
+        if(cmd == 0)
+            format_statistics(&ob, format, (struct st_statistics*)buf);
+        else
+            format_info(&ob, format, (struct st_info*)buf);
+        fflush(stdout);
+        if(outbuf_write(&ob, STDOUT_FILENO) != 0)
+            size = -1;
+        outbuf_free(&ob);
+        return size;
+    }
+
+    printf("size - %u\n", size);
+           
+    switch(cmd)
+    {
+        case 0:
+            statistics = (struct st_statistics*)buf;
+            printf("spiCycles - %lu\n", (long unsigned int)statistics->spiCycles);
+            printf("totalRxPayloadBytes - %lu\n", (long unsigned int)statistics->totalRxPayloadBytes);
+            printf("fifoOverflows - %lu\n", (long unsigned int)statistics->fifoOverflows);
+            printf("fifoBytesProcessed - %lu\n", (long unsigned int)statistics->fifoBytesProcessed);
+            printf("payloadCrcErrors - %lu\n", (long unsigned int)statistics->payloadCrcErrors);
+            printf("headerCrcErrors - %lu\n", (long unsigned int)statistics->headerCrcErrors);
+            printf("keepAliveErrors - %lu\n", (long unsigned int)statistics->keepAliveErrors);
+            break;
+        case 1:
+            info = (struct st_info*)buf;
+            if(info->valid)
+            {
+                printf("mode - %c\n", (char)info->mode);
+                printf("hardware ID - %s\n", (char*)info->hwId);
+                printf("hardware version - %s\n", (char*)info->hwVer);
+                printf("boot version - %s\n", (char*)info->bootVer);
+                printf("app version - %s\n", (char*)info->appVer);
+                printf("gnss version - %s\n", (char*)info->gnssVer);
+                printf("functionality - 0x%08x\n", (unsigned int)info->functionality);
+                printf("system errors - 0x%08x\n", (unsigned int)info->systemErrors);
+                printf("serial - %08x%08x%08x\n", (unsigned int)info->serial.h, (unsigned int)info->serial.m, (unsigned int)info->serial.l);
+                printf("receiver 1\n");
+                printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)info->rcv[0].config.channelFreq[0]);
+                printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)info->rcv[0].config.channelFreq[1]);
+                printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)info->rcv[0].config.tcxoFreq);
+                printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)info->rcv[0].config.metaDataMask);
+                printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)info->rcv[0].config.afcRange);
+                printf("\tdefault afc range [Hz]:\t\t %u\n", (unsigned int)info->rcv[0].config.afcRangeDefault);
+                printf("\trng:\t\t\t\t 0x%02x 0x%02x\n", (unsigned int)info->rcv[0].rng[0], (unsigned int)info->rcv[0].rng[1]);
+                printf("receiver 2\n");
+                printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)info->rcv[1].config.channelFreq[0]);
+                printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)info->rcv[1].config.channelFreq[1]);
+                printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)info->rcv[1].config.tcxoFreq);
+                printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)info->rcv[1].config.metaDataMask);
+                printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)info->rcv[1].config.afcRange);
+                printf("\tdefault afc range [Hz]:\t\t %u\n", (unsigned int)info->rcv[1].config.afcRangeDefault);
+                printf("\trng:\t\t\t\t 0x%02x 0x%02x\n", (unsigned int)info->rcv[1].rng[0], (unsigned int)info->rcv[1].rng[1]);
+                printf("simulator\n");
+                printf("\tenabled:\t\t\t %u\n", (unsigned int)info->simulator.enabled);
+                printf("\tinterval:\t\t\t %u\n", (unsigned int)info->simulator.interval);
+                printf("\tmmsi:\t\t\t\t %09u %09u\n", (unsigned int)info->simulator.mmsi[0], (unsigned int)info->simulator.mmsi[1]);
+                printf("misc\n");
+                printf("\twrite protection ID EEPROM:\t %u\n", (unsigned int)info->wpEEPROM);
+                printf("\twrite button pressed:\t\t %u\n", (unsigned int)info->buttonPressed);
+                printf("\tgnss satellite systems:\t\t %u\n", (unsigned int)info->gnssSysSupported);
+                
+                if(info->systemErrors)
+                    printf("\n\n***** SYSTEM ERRORS HAVE OCCURRED *****\n\n");
+            }
+            else
+            {
+                printf("Data is not valid yet!!!\n");
+            }
+            break;
+        case 2:
+            break;
+        case 3:
+            printf("statistics reset\n");
+            break;
+        case 4:
+            printf("GNSS enabled = %u\n", params[0]);
+            break;
+        case 5:
+            printf("configuration set\n");
+            config_print(configHAT);
+            break;
+        case 7:
+            printf("GNSS message configuration = %u\n", (uint8_t)params[0]);
+            break;
+        default:
+            break;
+    }
+    return size;
+}
+
+int main (int argc,char** argv)
+{
+    int fd_moitessier;
+    int cmd = 0;
+    int rc;
+    char buf[PATH_MAX];
+    uint32_t params[255];
+    int i;
     struct st_configHAT configHAT;
+    struct st_ovfCtrlParams ovfParams;
+    struct st_calibParams calibParams;
+    struct st_tcxoTrackParams trackParams;
+    struct st_capacityParams capacityParams;
     
     app_path(buf, argv[0]);
     char *temp;
@@ -177,7 +314,9 @@ int main (int argc,char** argv)
         printf("Usage: %s <DEVICE> <CMD_NR> <PARAM> <PARAM> ... <PARAM>\n", argv[0]);
         printf("\tRead HAT statistics:\t\t\t %s /dev/moitessier.ctrl 0\n", argv[0]);
         printf("\tGet HAT info:\t\t\t\t %s /dev/moitessier.ctrl 1\n", argv[0]);
+        printf("\tMachine readable statistics/info:\t %s /dev/moitessier.ctrl 0|1 json|csv|bin\n", argv[0]);
         printf("\tReset HAT:\t\t\t\t %s /dev/moitessier.ctrl 2\n", argv[0]);
+        printf("\tReset HAT and wait until ready:\t\t %s /dev/moitessier.ctrl 2 <TIMEOUT_MS> %s/config.xml\n", argv[0], buf);
         printf("\tReset HAT statistics:\t\t\t %s /dev/moitessier.ctrl 3\n", argv[0]);
         printf("\tEnable GNSS:\t\t\t\t %s /dev/moitessier.ctrl 4 1\n", argv[0]);
         printf("\tDisable GNSS:\t\t\t\t %s /dev/moitessier.ctrl 4 0\n", argv[0]);
@@ -186,215 +325,180 @@ int main (int argc,char** argv)
         printf("\tDisable ID EEPROM write protection:\t %s /dev/moitessier.ctrl 6 0\n", argv[0]);
         printf("\tEnable all GNSS sentences:\t\t %s /dev/moitessier.ctrl 7 255\n", argv[0]);
         printf("\tEnable only GNSS RMC sentence:\t\t %s /dev/moitessier.ctrl 7 1\n", argv[0]);
+        printf("\tPublish statistics to shared memory:\t %s /dev/moitessier.ctrl 8 <INTERVAL_MS> <SHM_NAME>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: 1000 ms, %s)\n", STATS_SHM_DEFAULT_NAME);
+        printf("\tMonitor statistics rates:\t\t %s /dev/moitessier.ctrl 9 <INTERVAL_MS>\n", argv[0]);
+        printf("\tRun commands from file/stdin:\t\t %s /dev/moitessier.ctrl 10 <FILE>\n", argv[0]);
+        printf("\tCompile configuration blob:\t\t %s - 11 %s/config.xml config.bin\n", argv[0], buf);
+        printf("\tConfigure HAT if changed:\t\t %s /dev/moitessier.ctrl 12 config.bin|config.xml <FORCE>\n", argv[0]);
+        printf("\tReconfigure HAT on file changes:\t %s /dev/moitessier.ctrl 22 %s/config.xml\n", argv[0], buf);
+        printf("\tDump running configuration:\t\t %s /dev/moitessier.ctrl 23 <OUT_XML|->\n", argv[0]);
+        printf("\t\t\t\t\t\t (default: -, written to stdout)\n");
+        printf("\tOpenMetrics exporter:\t\t\t %s /dev/moitessier.ctrl 13 <[IP:]PORT|unix:PATH> <INTERVAL_MS>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: %s, 1000 ms)\n", EXPORTER_DEFAULT_LISTEN);
+        printf("\tFIFO overflow mitigation:\t\t %s /dev/moitessier.ctrl 14 <INTERVAL_MS> <FULL_GNSS_MASK> <ALLOW_GNSS_OFF>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: 1000 ms, 255, 1), restores GNSS on with the full mask on exit\n");
+        printf("\tIOCTL latency benchmark:\t\t %s /dev/moitessier.ctrl 15 <ITERATIONS> <CMD_LIST>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: 10000, %s), 4 enables GNSS, 7 enables all NMEA messages, 2 resets the HAT\n", BENCH_DEFAULT_CMDS);
+        printf("\tDrive several HATs:\t\t\t %s '/dev/moitessier*.ctrl' 16 <INTERVAL_MS,...> <CONFIG|-> <[IP:]PORT|unix:PATH|->\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: 1000 ms, -, -), devices are a comma separated list of paths or globs\n");
+        printf("\tCalibrate tcxoFreq/afcRange:\t\t %s /dev/moitessier.ctrl 17 <OUT_XML> <DWELL_MS> <TCXO_RANGE_HZ> <RESOLUTION_HZ>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: -, 10000 ms, 300 Hz, 5 Hz)\n");
+        printf("\tTemperature compensated tcxoFreq:\t %s /dev/moitessier.ctrl 18 <CONFIG|-> <SENSOR> <THRESHOLD_HZ> <PROBE_DWELL_S> <MODEL_FILE>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: -, %s, 10 Hz, 120 s, -), SENSOR is si7020:<I2C_BUS>, ms5607:<I2C_BUS> or thermal:<PATH>\n", TEMP_DEFAULT_SENSOR);
+        printf("\tRecord statistics history:\t\t %s /dev/moitessier.ctrl 19 <FILE> <SIZE_MB> <INTERVAL_MS>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: -, %u MB, 1000 ms)\n", REC_DEFAULT_SIZE_MB);
+        printf("\tDump recorded rates as CSV:\t\t %s - 20 <FILE> <FROM_UNIX_TIME> <TO_UNIX_TIME>\n", argv[0]);
+        printf("\tCapacity benchmark (simulator):\t\t %s /dev/moitessier.ctrl 21 <MAX_INTERVAL_MS> <MIN_INTERVAL_MS> <DWELL_MS>\n", argv[0]);
+        printf("\t\t\t\t\t\t (defaults: 1000 ms, 1 ms, 10000 ms)\n");
         return -1;
     }
     
-    memset(buf, 0, sizeof(buf));
-    
-    fd_moitessier = open(argv[1], O_RDONLY);
     cmd = atoi(argv[2]);
-    for(i = 0; i < (argc - 3); i++)
+    for(i = 0; i < (argc - 3) && i < 255; i++)
         params[i] = atoi(argv[i + 3]);
+
+    /* commands that do not need the device */
+    switch(cmd)
+    {
+        case CMD_CONFIG_COMPILE:
+            if(argc < 5)
+            {
+                printf("ERROR: missing parameters\n");
+                return -1;
+            }
+            if(config_load_xml(argv[3], &configHAT) != 0 || config_save_blob(argv[4], &configHAT) != 0)
+                return -1;
+            printf("configuration \"%s\" compiled to \"%s\"\n", argv[3], argv[4]);
+            return 0;
+        case CMD_RECORD_DUMP:
+            if(argc < 4)
+            {
+                printf("ERROR: missing recording file\n");
+                return -1;
+            }
+            return recorder_dump(argv[3], (argc > 4) ? strtoull(argv[4], NULL, 10) : 0, (argc > 5) ? strtoull(argv[5], NULL, 10) : 0);
+        case CMD_MULTI:
+            return run_multi(argv[1], (argc > 3) ? argv[3] : NULL,
+                             (argc > 4 && strcmp(argv[4], "-")) ? argv[4] : NULL,
+                             (argc > 5 && strcmp(argv[5], "-")) ? argv[5] : NULL);
+        default:
+            break;
+    }
     
-    if(fd_moitessier)
+    fd_moitessier = open(argv[1], O_RDONLY);
+    if(fd_moitessier < 0)
     {
-        if(cmd < 0 || cmd >= IOCTL_CMDs)
-        {
-            printf("ERROR: command not supported\n");
-            close(fd_moitessier);
-            return -1;            
-        }
-        
-        printf("opening device %s\n", argv[1]);
-        
-        switch(cmd)
-        {
-            case 0:
-                ioctlCmd = IOCTL_GET_STATISTICS;
-                break;
-            case 1:
-                ioctlCmd = IOCTL_GET_INFO;
-                break;
-            case 2:
-                ioctlCmd = IOCTL_RESET_HAT;
-                break;
-            case 3: 
-                ioctlCmd = IOCTL_RESET_STATISTICS;
-                break;
-            case 4:
-                ioctlCmd = IOCTL_GNSS;
-                buf[0] = (char)params[0];
-                break;
-            case 5:
-                ioctlCmd = IOCTL_CONFIG;
-                fileName = argv[3];
-                fd_param = fopen(fileName, "r");
-                if(!fd_param)
-                {
-                    printf("ERROR: could not open file \"%s\"\n", fileName);
-                    return -1;
-                }   
-                i = 0;
-
-                /* the AFC default range is not used, so we set it to 0 */
-                configHAT.rcv[0].afcRangeDefault = 0;
-                configHAT.rcv[1].afcRangeDefault = 0;
+        printf("error opening device %s\n", argv[1]);
+        return -1;
+    }
 
-                xml = ezxml_parse_file(fileName);
-                
-                for(i = 0; i < NUM_RCV; i++)
-                {
-                    for(k = 0; k < NUM_RCV_CHANNELS; k++)
-                    {
-                        configHAT.rcv[i].channelFreq[k] = (uint32_t)atoi(ezxml_get(xml, "receiver", i, "channelFreq", 0, "freq", k, "", -1)->txt);
-                        printf("%u\n", configHAT.rcv[i].channelFreq[k]);
-                    }
-                    configHAT.rcv[i].metaDataMask = (uint8_t)atoi(ezxml_get(xml, "receiver", i, "metamask", -1)->txt);
-                    printf("%u\n", configHAT.rcv[i].metaDataMask);
-                    configHAT.rcv[i].afcRange = (uint32_t)atoi(ezxml_get(xml, "receiver", i, "afcRange", -1)->txt);
-                    printf("%u\n", configHAT.rcv[i].afcRange);
-                    configHAT.rcv[i].tcxoFreq = (uint32_t)atoi(ezxml_get(xml, "receiver", i, "tcxoFreq", -1)->txt);    
-                    printf("%u\n", configHAT.rcv[i].tcxoFreq);
-                }
-                configHAT.simulator.enabled = (uint8_t)atoi(ezxml_get(xml, "simulator", 0, "enabled", -1)->txt);
-                //printf("%u\n", configHAT.simulator.enabled);
-                configHAT.simulator.interval = (uint32_t)atoi(ezxml_get(xml, "simulator", 0, "interval", -1)->txt);
-                //printf("%u\n", configHAT.simulator.interval);
-                configHAT.simulator.mmsi[0] = (uint32_t)atoi(ezxml_get(xml, "simulator", 0, "mmsi", 0, "id", 0, "", -1)->txt);
-                //printf("%u\n", configHAT.simulator.mmsi[0]);
-                configHAT.simulator.mmsi[1] = (uint32_t)atoi(ezxml_get(xml, "simulator", 0, "mmsi", 0, "id", 1, "", -1)->txt);
-                //printf("%u\n", configHAT.simulator.mmsi[1]);
-                configHAT.wpEEPROM = (uint8_t)atoi(ezxml_get(xml, "misc", 0, "eepromWpEnabled", -1)->txt);
-                //printf("%u\n", configHAT.wpEEPROM);
-                
-                //printf("%s\n", ezxml_get(xml, "misc", 0, "eepromWpEnabled", -1)->txt);
-                //printf("%s\n", ezxml_get(f1, "receiver", 1, "afcRange", -1)->txt);
-                //printf("%s\n", ezxml_get(f1, "team", 0, "driver", 1, "name", -1)->txt);
+    /* keep machine readable output clean */
+    if(!((cmd == 0 || cmd == 1) && argc > 3 && strcmp(argv[3], "text")) &&
+       !(cmd == CMD_CONFIG_DUMP && (argc < 4 || !strcmp(argv[3], "-"))))
+        printf("opening device %s\n", argv[1]);
 
-                //printf("%s\n", ezxml_child(f1, "receiver")->attr[0]);
-                
-                
-                ezxml_free(xml);                
-                fclose(fd_param);
-                
-                memset(buf, 0, sizeof(buf));
-                memcpy(buf, &configHAT, sizeof(struct st_configHAT));
-                break;
-            case 6:
-                ioctlCmd = IOCTL_ID_EEPROM;
-                buf[0] = (char)params[0];
-                break;
-            case 7:
-                ioctlCmd = IOCTL_GNSS_MSG_CONFIG;
-                buf[0] = (char)params[0];
-                break;
-            default:
-                break;
-        }
-        
-        size = ioctl(fd_moitessier, ioctlCmd, &buf);
-        printf("size - %u\n", size);
-               
-        switch(cmd)
-        {
-            case 0:
-                statistics = (struct st_statistics*)buf;
-                printf("spiCycles - %lu\n", (long unsigned int)statistics->spiCycles);
-                printf("totalRxPayloadBytes - %lu\n", (long unsigned int)statistics->totalRxPayloadBytes);
-                printf("fifoOverflows - %lu\n", (long unsigned int)statistics->fifoOverflows);
-                printf("fifoBytesProcessed - %lu\n", (long unsigned int)statistics->fifoBytesProcessed);
-                printf("payloadCrcErrors - %lu\n", (long unsigned int)statistics->payloadCrcErrors);
-                printf("headerCrcErrors - %lu\n", (long unsigned int)statistics->headerCrcErrors);
-                printf("keepAliveErrors - %lu\n", (long unsigned int)statistics->keepAliveErrors);
-                break;
-            case 1:
-                info = (struct st_info*)buf;
-                if(info->valid)
-                {
-                    printf("mode - %c\n", (char)info->mode);
-                    printf("hardware ID - %s\n", (char*)info->hwId);
-                    printf("hardware version - %s\n", (char*)info->hwVer);
-                    printf("boot version - %s\n", (char*)info->bootVer);
-                    printf("app version - %s\n", (char*)info->appVer);
-                    printf("gnss version - %s\n", (char*)info->gnssVer);
-                    printf("functionality - 0x%08x\n", (unsigned int)info->functionality);
-                    printf("system errors - 0x%08x\n", (unsigned int)info->systemErrors);
-                    printf("serial - %08x%08x%08x\n", (unsigned int)info->serial.h, (unsigned int)info->serial.m, (unsigned int)info->serial.l);
-                    printf("receiver 1\n");
-                    printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)info->rcv[0].config.channelFreq[0]);
-                    printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)info->rcv[0].config.channelFreq[1]);
-                    printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)info->rcv[0].config.tcxoFreq);
-                    printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)info->rcv[0].config.metaDataMask);
-                    printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)info->rcv[0].config.afcRange);
-                    printf("\tdefault afc range [Hz]:\t\t %u\n", (unsigned int)info->rcv[0].config.afcRangeDefault);
-                    printf("\trng:\t\t\t\t 0x%02x 0x%02x\n", (unsigned int)info->rcv[0].rng[0], (unsigned int)info->rcv[0].rng[1]);
-                    printf("receiver 2\n");
-                    printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)info->rcv[1].config.channelFreq[0]);
-                    printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)info->rcv[1].config.channelFreq[1]);
-                    printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)info->rcv[1].config.tcxoFreq);
-                    printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)info->rcv[1].config.metaDataMask);
-                    printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)info->rcv[1].config.afcRange);
-                    printf("\tdefault afc range [Hz]:\t\t %u\n", (unsigned int)info->rcv[1].config.afcRangeDefault);
-                    printf("\trng:\t\t\t\t 0x%02x 0x%02x\n", (unsigned int)info->rcv[1].rng[0], (unsigned int)info->rcv[1].rng[1]);
-                    printf("simulator\n");
-                    printf("\tenabled:\t\t\t %u\n", (unsigned int)info->simulator.enabled);
-                    printf("\tinterval:\t\t\t %u\n", (unsigned int)info->simulator.interval);
-                    printf("\tmmsi:\t\t\t\t %09u %09u\n", (unsigned int)info->simulator.mmsi[0], (unsigned int)info->simulator.mmsi[1]);
-                    printf("misc\n");
-                    printf("\twrite protection ID EEPROM:\t %u\n", (unsigned int)info->wpEEPROM);
-                    printf("\twrite button pressed:\t\t %u\n", (unsigned int)info->buttonPressed);
-                    printf("\tgnss satellite systems:\t\t %u\n", (unsigned int)info->gnssSysSupported);
-                    
-                    if(info->systemErrors)
-                        printf("\n\n***** SYSTEM ERRORS HAVE OCCURRED *****\n\n");
-                }
-                else
-                {
-                    printf("Data is not valid yet!!!\n");
-                }
-                break;
-            case 2:
-                break;
-            case 3:
-                printf("statistics reset\n");
-                break;
-            case 4:
-                printf("GNSS enabled = %u\n", params[0]);
+    switch(cmd)
+    {
+        case CMD_DAEMON:
+            rc = run_daemon(fd_moitessier, (argc > 3) ? params[0] : 1000, (argc > 4) ? argv[4] : STATS_SHM_DEFAULT_NAME);
+            break;
+        case CMD_RATES:
+            rc = run_rate_monitor(fd_moitessier, (argc > 3) ? params[0] : 1000);
+            break;
+        case CMD_BATCH:
+            rc = run_batch(fd_moitessier, (argc > 3) ? argv[3] : NULL);
+            break;
+        case CMD_CONFIG_PUSH:
+            if(argc < 4)
+            {
+                printf("ERROR: missing configuration file\n");
+                rc = -1;
                 break;
-            case 5:
+            }
+            rc = config_load(argv[3], &configHAT);
+            if(rc == 0)
+                rc = config_push(fd_moitessier, &configHAT, (argc > 4) ? (params[1] != 0) : false);
+            if(rc == 0)
+                printf("configuration unchanged, not pushed\n");
+            else if(rc == 1)
+            {
                 printf("configuration set\n");
-                printf("receiver 1\n");
-                printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)configHAT.rcv[0].channelFreq[0]);
-                printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)configHAT.rcv[0].channelFreq[1]);
-                printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)configHAT.rcv[0].tcxoFreq);
-                printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)configHAT.rcv[0].metaDataMask);
-                printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)configHAT.rcv[0].afcRange);
-                printf("receiver 2\n");
-                printf("\tchannel frequency 1 [Hz]:\t %u\n", (unsigned int)configHAT.rcv[1].channelFreq[0]);
-                printf("\tchannel frequency 2 [Hz]:\t %u\n", (unsigned int)configHAT.rcv[1].channelFreq[1]);
-                printf("\ttcxo frequency [Hz]:\t\t %u\n", (unsigned int)configHAT.rcv[1].tcxoFreq);
-                printf("\tmeta data mask:\t\t\t 0x%02x\n", (unsigned int)configHAT.rcv[1].metaDataMask);
-                printf("\tafc range [Hz]:\t\t\t %u\n", (unsigned int)configHAT.rcv[1].afcRange);
-                printf("simulator\n");
-                printf("\tenabled:\t\t\t %u\n", (unsigned int)configHAT.simulator.enabled);
-                printf("\tinterval:\t\t\t %u\n", (unsigned int)configHAT.simulator.interval);
-                printf("\tmmsi:\t\t\t\t %09u %09u\n", (unsigned int)configHAT.simulator.mmsi[0], (unsigned int)configHAT.simulator.mmsi[1]);
-                printf("misc\n");
-                printf("\twrite protection ID EEPROM:\t %u\n", (unsigned int)configHAT.wpEEPROM);
-                
+                config_print(&configHAT);
+                rc = 0;
+            }
+            break;
+        case CMD_EXPORTER:
+            rc = run_exporter(fd_moitessier, (argc > 3) ? argv[3] : EXPORTER_DEFAULT_LISTEN, (argc > 4) ? params[1] : 1000);
+            break;
+        case CMD_OVERFLOW_CTRL:
+            ovfParams.intervalMs = (argc > 3) ? params[0] : 1000;
+            ovfParams.fullMask = (argc > 4) ? (uint8_t)params[1] : 255;
+            ovfParams.allowGnssOff = (argc > 5) ? (params[2] != 0) : true;
+            rc = run_overflow_ctrl(fd_moitessier, &ovfParams);
+            break;
+        case CMD_CALIBRATE:
+            if(argc < 4)
+            {
+                printf("ERROR: missing output file\n");
+                rc = -1;
                 break;
-            case 7:
-                printf("GNSS message configuration = %u\n", (uint8_t)params[0]);
+            }
+            calibParams.outFile = argv[3];
+            calibParams.dwellMs = (argc > 4) ? params[1] : 10000;
+            calibParams.tcxoRangeHz = (argc > 5) ? params[2] : 300;
+            calibParams.tcxoResolutionHz = (argc > 6) ? params[3] : 5;
+            rc = run_calibration(fd_moitessier, &calibParams);
+            break;
+        case CMD_TCXO_TRACK:
+            trackParams.configFile = (argc > 3 && strcmp(argv[3], "-")) ? argv[3] : NULL;
+            trackParams.sensor = (argc > 4) ? argv[4] : TEMP_DEFAULT_SENSOR;
+            trackParams.thresholdHz = (argc > 5) ? params[2] : 10;
+            trackParams.probeDwellSec = (argc > 6) ? params[3] : 120;
+            trackParams.modelFile = (argc > 7 && strcmp(argv[7], "-")) ? argv[7] : NULL;
+            rc = run_tcxo_track(fd_moitessier, &trackParams);
+            break;
+        case CMD_RECORD:
+            if(argc < 4)
+            {
+                printf("ERROR: missing recording file\n");
+                rc = -1;
                 break;
-            default:
+            }
+            rc = run_recorder(fd_moitessier, argv[3], (argc > 4) ? params[1] : REC_DEFAULT_SIZE_MB, (argc > 5) ? params[2] : 1000);
+            break;
+        case CMD_CONFIG_WATCH:
+            if(argc < 4)
+            {
+                printf("ERROR: missing configuration file\n");
+                rc = -1;
                 break;
-        }  
-    }
-    else
-    {
-        printf("error opening device %s\n", argv[1]);
-        return -1;
+            }
+            rc = run_config_watch(fd_moitessier, argv[3]);
+            break;
+        case CMD_CONFIG_DUMP:
+            rc = config_dump(fd_moitessier, (argc > 3 && strcmp(argv[3], "-")) ? argv[3] : NULL);
+            break;
+        case CMD_CAPACITY:
+            capacityParams.maxIntervalMs = (argc > 3) ? params[0] : 1000;
+            capacityParams.minIntervalMs = (argc > 4) ? params[1] : 1;
+            capacityParams.dwellMs = (argc > 5) ? params[2] : 10000;
+            rc = run_capacity(fd_moitessier, &capacityParams);
+            break;
+        case CMD_BENCH:
+            rc = run_ioctl_bench(fd_moitessier, (argc > 3) ? params[0] : 10000, (argc > 4) ? argv[4] : BENCH_DEFAULT_CMDS);
+            break;
+        default:
+            if(cmd < 0 || cmd >= IOCTL_CMDs)
+            {
+                printf("ERROR: command not supported\n");
+                rc = -1;
+            }
+            else
+                rc = (execute_ioctl_cmd(fd_moitessier, cmd, argc - 3, argv + 3, NULL) < 0) ? -1 : 0;
+            break;
     }
+
     close(fd_moitessier);
-    return 0;
-}       
+    return rc;
+}
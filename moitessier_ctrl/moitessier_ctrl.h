@@ -0,0 +1,143 @@
+/*
+    Definitions shared between the modules of the Moitessier HAT control
+    program (IOCTL commands and the data structures exchanged with the
+    kernel driver).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MOITESSIER_CTRL_H
+#define MOITESSIER_CTRL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+
+#define IOC_MAGIC 'N'
+#define IOCTL_CMDs                  8
+#define IOCTL_GET_STATISTICS        _IO(IOC_MAGIC,0)
+#define IOCTL_GET_INFO              _IO(IOC_MAGIC,1)
+#define IOCTL_RESET_HAT             _IO(IOC_MAGIC,2)
+#define IOCTL_RESET_STATISTICS      _IO(IOC_MAGIC,3)
+#define IOCTL_GNSS                  _IO(IOC_MAGIC,4)
+#define IOCTL_CONFIG                _IO(IOC_MAGIC,5)
+#define IOCTL_ID_EEPROM             _IO(IOC_MAGIC,6)
+#define IOCTL_GNSS_MSG_CONFIG       _IO(IOC_MAGIC,7)
+
+#define IOCTL_BUF_SIZE              1024    /* size of the buffer handed to the driver */
+
+#define NUM_RCV_CHANNELS            2       /* number of receiver channels per receiver, should be 2 */
+#define NUM_RCV                     2       /* number of receivers, should be 2 */
+
+/* commands implemented by this program on top of the IOCTL commands 0...7 */
+#define CMD_DAEMON                  8       /* poll statistics and publish them in shared memory */
+#define CMD_RATES                   9       /* print counter rates */
+#define CMD_BATCH                   10      /* execute commands read from a file or stdin */
+#define CMD_CONFIG_COMPILE          11      /* compile config.xml into a binary configuration blob */
+#define CMD_CONFIG_PUSH             12      /* configure the HAT only if the configuration changed */
+#define CMD_EXPORTER                13      /* serve info and statistics in OpenMetrics format */
+#define CMD_OVERFLOW_CTRL           14      /* reduce GNSS output while the FIFO overflows */
+#define CMD_BENCH                   15      /* measure the IOCTL round trip latency */
+#define CMD_MULTI                   16      /* drive several devices from one process */
+#define CMD_CALIBRATE               17      /* search the best tcxoFreq/afcRange */
+#define CMD_TCXO_TRACK              18      /* temperature compensated tcxoFreq */
+#define CMD_RECORD                  19      /* record the statistics history to a ring file */
+#define CMD_RECORD_DUMP             20      /* print a time range of a recording as rates */
+#define CMD_CAPACITY                21      /* sweep the AIS simulator to find the capacity of the HAT */
+#define CMD_CONFIG_WATCH            22      /* apply the configuration whenever the file changes */
+#define CMD_CONFIG_DUMP             23      /* write the running configuration as config.xml */
+
+struct st_receiverConfig
+{
+    uint8_t         metaDataMask;
+    uint32_t        afcRange;
+    uint32_t        afcRangeDefault;
+    uint32_t        tcxoFreq;
+    uint32_t        channelFreq[NUM_RCV_CHANNELS];
+};
+
+struct st_info_rcv{
+    struct st_receiverConfig    config;
+    uint8_t                     rng[NUM_RCV_CHANNELS];
+};
+
+struct st_info_serial{
+    uint32_t    h;      /* bits 95...64 */
+    uint32_t    m;      /* bits 63...32 */
+    uint32_t    l;      /* bits 31...0 */
+};
+
+struct st_simulator
+{
+    uint32_t mmsi[NUM_RCV_CHANNELS];
+    uint32_t enabled;
+    uint32_t interval;
+};
+
+struct st_info{
+    uint8_t                     mode;
+    uint8_t                     hwId[16];
+    uint8_t                     hwVer[8];
+    uint8_t                     bootVer[22];
+    uint8_t                     appVer[22];
+    uint32_t                    functionality;
+    uint32_t                    systemErrors;
+    struct st_info_serial       serial;
+    struct st_info_rcv          rcv[NUM_RCV];
+    struct st_simulator         simulator;
+    uint8_t                     wpEEPROM;
+    uint8_t                     buttonPressed;
+    uint8_t                     gnssVer[32];
+    uint8_t                     gnssSysSupported;
+    bool                        valid;
+};
+
+struct st_statistics{
+    uint64_t                spiCycles;
+    uint64_t                totalRxPayloadBytes;
+    uint64_t                fifoOverflows;
+    uint64_t                fifoBytesProcessed;
+    uint64_t                payloadCrcErrors;
+    uint64_t                headerCrcErrors;
+    uint64_t                keepAliveErrors;
+};
+
+struct st_configHAT{
+    struct st_receiverConfig    rcv[NUM_RCV];
+    struct st_simulator         simulator;
+    uint8_t                     wpEEPROM;
+};
+
+/* moitessier_ctrl.c - executes IOCTL command 0...7 and prints the result, returns < 0 on error */
+int execute_ioctl_cmd(int fd, int cmd, int paramc, char **paramv, const struct st_configHAT *configHAT);
+
+/* hat.c - thin wrappers around the IOCTL interface, return 0 on success, -1 on error */
+int hat_open(const char *device);
+int hat_get_statistics(int fd, struct st_statistics *statistics);
+int hat_get_info(int fd, struct st_info *info);
+int hat_config(int fd, const struct st_configHAT *configHAT);
+int hat_gnss(int fd, bool enable);
+int hat_gnss_msg_config(int fd, uint8_t mask);
+uint64_t time_now_ns(void);
+int sleep_until_ns(uint64_t deadline);
+
+/* set by SIGINT/SIGTERM once stop_on_signal() was called, long running modes poll it */
+extern volatile sig_atomic_t stopRequested;
+void stop_on_signal(void);
+
+#endif /* MOITESSIER_CTRL_H */
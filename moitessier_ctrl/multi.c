@@ -0,0 +1,342 @@
+/*
+    Multi device mode of the Moitessier HAT control program (see multi.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <glob.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "moitessier_ctrl.h"
+#include "rates.h"
+#include "config.h"
+#include "exporter.h"
+#include "multi.h"
+
+#define MULTI_LISTEN_TAG            0xFFFFFFFFu     /* epoll tag of the exporter socket */
+
+struct st_multiDevice{
+    char                    path[256];
+    int                     fd;
+    int                     timerFd;
+    uint32_t                intervalMs;
+    char                    serial[256];    /* the path until the HAT reported valid info */
+    char                    labels[1056];   /* escaped serial and path */
+    bool                    infoValid;
+    bool                    configPending;
+    uint64_t                polls;
+    uint64_t                missedPolls;    /* timer expirations we were too late for */
+    struct st_statistics    statistics;
+    struct st_info          info;
+    struct st_rateEngine    *re;
+    struct st_exportSource  src;
+};
+
+struct st_multi{
+    struct st_multiDevice   dev[MULTI_MAX_DEVICES];
+    int                     numDevices;
+    const struct st_configHAT *configHAT;
+    bool                    dirty;          /* exporter response must be rebuilt */
+};
+
+/* expands the comma separated list of paths and glob patterns */
+static int add_devices(struct st_multi *m, const char *devices)
+{
+    char *list;
+    char *item;
+    char *save;
+    glob_t g;
+    size_t i;
+    int j;
+
+    list = strdup(devices);
+    if(list == NULL)
+        return -1;
+
+    for(item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save))
+    {
+        if(glob(item, GLOB_NOCHECK, NULL, &g) != 0)
+            continue;
+        for(i = 0; i < g.gl_pathc; i++)
+        {
+            for(j = 0; j < m->numDevices && strcmp(m->dev[j].path, g.gl_pathv[i]); j++);
+            if(j < m->numDevices)
+                continue;
+            if(m->numDevices == MULTI_MAX_DEVICES)
+            {
+                printf("ERROR: too many devices, maximum is %d\n", MULTI_MAX_DEVICES);
+                globfree(&g);
+                free(list);
+                return -1;
+            }
+            snprintf(m->dev[m->numDevices++].path, sizeof(m->dev[0].path), "%s", g.gl_pathv[i]);
+        }
+        globfree(&g);
+    }
+
+    free(list);
+    return 0;
+}
+
+static void set_labels(struct st_multiDevice *d)
+{
+    struct st_outBuf lb;
+
+    /* escaped like every exported label, in a buffer of its own as d->serial
+       and d->path live next to d->labels */
+    outbuf_init(&lb, sizeof(d->labels));
+    exporter_label(&lb, "serial", (const uint8_t*)d->serial, sizeof(d->serial));
+    exporter_label(&lb, ",device", (const uint8_t*)d->path, sizeof(d->path));
+    snprintf(d->labels, sizeof(d->labels), "%s", lb.error ? "" : lb.data);
+    outbuf_free(&lb);
+}
+
+static int start_device(struct st_multiDevice *d, uint32_t intervalMs)
+{
+    struct itimerspec its;
+
+    d->fd = hat_open(d->path);
+    if(d->fd < 0)
+        return -1;
+
+    d->re = malloc(sizeof(struct st_rateEngine));
+    d->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(d->re == NULL || d->timerFd < 0)
+    {
+        printf("ERROR: could not set up device %s\n", d->path);
+        return -1;
+    }
+
+    /* first poll right away, then every intervalMs */
+    d->intervalMs = intervalMs;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_nsec = 1;
+    its.it_interval.tv_sec = intervalMs / 1000;
+    its.it_interval.tv_nsec = (long)(intervalMs % 1000) * 1000000L;
+    if(timerfd_settime(d->timerFd, 0, &its, NULL) != 0)
+    {
+        printf("ERROR: could not start timer of device %s\n", d->path);
+        return -1;
+    }
+
+    rates_init(d->re);
+    snprintf(d->serial, sizeof(d->serial), "%s", d->path);
+    set_labels(d);
+    d->src.statistics = &d->statistics;
+    d->src.info = &d->info;
+    d->src.rates = &d->re->rates;
+    d->src.labels = d->labels;
+    return 0;
+}
+
+static void stop_device(struct st_multiDevice *d)
+{
+    if(d->timerFd >= 0)
+        close(d->timerFd);
+    if(d->fd >= 0)
+        close(d->fd);
+    free(d->re);
+}
+
+static void poll_device(struct st_multi *m, struct st_multiDevice *d)
+{
+    const struct st_rates *r = &d->re->rates;
+    uint64_t expirations;
+    int rc;
+
+    if(read(d->timerFd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+    d->polls++;
+    d->missedPolls += expirations - 1;
+
+    if(hat_get_statistics(d->fd, &d->statistics) == 0)
+        rates_update(d->re, time_now_ns(), &d->statistics);
+    else
+        d->src.ioctlErrors++;
+
+    if(hat_get_info(d->fd, &d->info) == 0)
+    {
+        /* the HAT came up (start up or after a reset), it runs its default configuration */
+        if(d->info.valid && !d->infoValid)
+        {
+            snprintf(d->serial, sizeof(d->serial), "%08x%08x%08x",
+                     (unsigned int)d->info.serial.h, (unsigned int)d->info.serial.m, (unsigned int)d->info.serial.l);
+            set_labels(d);
+            d->configPending = (m->configHAT != NULL);
+        }
+        d->infoValid = d->info.valid;
+    }
+    else
+        d->src.ioctlErrors++;
+
+    if(d->configPending && d->infoValid)
+    {
+        rc = config_push(d->fd, m->configHAT, false);
+        if(rc >= 0)
+        {
+            printf("[%s] configuration %s\n", d->serial, rc ? "set" : "unchanged");
+            d->configPending = false;
+        }
+        else
+            printf("[%s] ERROR: configuring HAT failed\n", d->serial);
+    }
+
+    if(r->samples)
+        printf("[%s] payload %.1f B/s, fifo overflows %.3f 1/s, crc errors %.3f 1/kB (10 s), ioctl errors %llu, missed polls %llu\n",
+               d->serial, r->window[1][RATE_RX_PAYLOAD_BYTES], r->window[1][RATE_FIFO_OVERFLOWS], r->crcErrorsPerKB[1],
+               (unsigned long long)d->src.ioctlErrors, (unsigned long long)d->missedPolls);
+    fflush(stdout);
+    m->dirty = true;
+}
+
+int run_multi(const char *devices, const char *intervals, const char *configFile, const char *address)
+{
+    static struct st_multi m;
+    static struct st_configHAT configHAT;
+    struct st_exportSource src[MULTI_MAX_DEVICES];
+    struct epoll_event events[MULTI_MAX_DEVICES + 1];
+    struct epoll_event ev;
+    struct st_outBuf body;
+    struct st_outBuf response;
+    size_t headerLen = 0;
+    const char *p = intervals;
+    char *end;
+    uint32_t intervalMs = 1000;
+    int listenFd = -1;
+    int epollFd;
+    int rc = -1;
+    int n;
+    int i;
+    int j;
+
+    memset(&m, 0, sizeof(m));
+    for(i = 0; i < MULTI_MAX_DEVICES; i++)
+    {
+        m.dev[i].fd = -1;
+        m.dev[i].timerFd = -1;
+    }
+    if(add_devices(&m, devices) != 0 || m.numDevices == 0)
+    {
+        printf("ERROR: no devices given\n");
+        return -1;
+    }
+
+    if(configFile)
+    {
+        if(config_load(configFile, &configHAT) != 0)
+            return -1;
+        m.configHAT = &configHAT;
+    }
+
+    outbuf_init(&body, 16384);
+    outbuf_init(&response, 16384);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollFd < 0)
+    {
+        printf("ERROR: epoll_create1 failed: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    for(i = 0; i < m.numDevices; i++)
+    {
+        /* the last interval of the list applies to all remaining devices */
+        if(p && *p)
+        {
+            intervalMs = (uint32_t)strtoul(p, &end, 10);
+            p = (*end == ',') ? end + 1 : end;
+        }
+        if(intervalMs == 0)
+        {
+            printf("ERROR: polling interval must be greater than 0\n");
+            goto cleanup;
+        }
+        if(start_device(&m.dev[i], intervalMs) != 0)
+            goto cleanup;
+
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, m.dev[i].timerFd, &ev) != 0)
+        {
+            printf("ERROR: epoll_ctl failed: %s\n", strerror(errno));
+            goto cleanup;
+        }
+        printf("device %s, polling every %u ms\n", m.dev[i].path, intervalMs);
+    }
+
+    if(address)
+    {
+        listenFd = exporter_listen(address);
+        if(listenFd < 0)
+            goto cleanup;
+        ev.events = EPOLLIN;
+        ev.data.u32 = MULTI_LISTEN_TAG;
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) != 0)
+        {
+            printf("ERROR: epoll_ctl failed: %s\n", strerror(errno));
+            goto cleanup;
+        }
+        printf("serving OpenMetrics on \"%s\"\n", address);
+    }
+    fflush(stdout);
+
+    stop_on_signal();
+    while(!stopRequested)
+    {
+        n = epoll_wait(epollFd, events, MULTI_MAX_DEVICES + 1, -1);
+        for(i = 0; i < n; i++)
+        {
+            if(events[i].data.u32 != MULTI_LISTEN_TAG)
+            {
+                poll_device(&m, &m.dev[events[i].data.u32]);
+                continue;
+            }
+
+            /* the exposition is only rebuilt if somebody asks for it */
+            if(m.dirty)
+            {
+                for(j = 0; j < m.numDevices; j++)
+                    src[j] = m.dev[j].src;
+                outbuf_reset(&body);
+                exporter_format(&body, src, m.numDevices);
+                headerLen = exporter_response(&response, &body);
+                m.dirty = false;
+            }
+            exporter_serve(listenFd, &response, headerLen);
+        }
+    }
+    rc = 0;
+
+cleanup:
+    for(i = 0; i < m.numDevices; i++)
+        stop_device(&m.dev[i]);
+    if(listenFd >= 0)
+    {
+        close(listenFd);
+        if(!strncmp(address, "unix:", 5))
+            unlink(address + 5);
+    }
+    if(epollFd >= 0)
+        close(epollFd);
+    outbuf_free(&body);
+    outbuf_free(&response);
+    return rc;
+}
@@ -0,0 +1,44 @@
+/*
+    Multi device mode of the Moitessier HAT control program.
+
+    One process drives several control devices from a single epoll loop.
+    Every device has its own timerfd (polling interval), statistics, rate
+    engine and configuration state. Results are tagged with the serial
+    number of the HAT.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef MULTI_H
+#define MULTI_H
+
+#include <stdint.h>
+#include "moitessier_ctrl.h"
+
+#define MULTI_MAX_DEVICES           16
+
+/* Runs until SIGINT/SIGTERM is received.
+    devices     comma separated list of device paths or glob patterns,
+                e.g. "/dev/moitessier*.ctrl"
+    intervals   comma separated polling intervals [ms], the last one is used
+                for all remaining devices
+    configFile  config.xml or blob pushed to every HAT on start up and after
+                a reset, NULL to leave the configuration alone
+    address     exporter address (see exporter.h), NULL to disable */
+int run_multi(const char *devices, const char *intervals, const char *configFile, const char *address);
+
+#endif /* MULTI_H */
@@ -0,0 +1,130 @@
+/*
+    Growable output buffer (see outbuf.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "outbuf.h"
+
+void outbuf_init(struct st_outBuf *ob, size_t size)
+{
+    ob->data = malloc(size);
+    ob->size = ob->data ? size : 0;
+    ob->len = 0;
+    ob->error = ob->data ? 0 : 1;
+}
+
+void outbuf_free(struct st_outBuf *ob)
+{
+    free(ob->data);
+    ob->data = NULL;
+    ob->size = 0;
+    ob->len = 0;
+}
+
+void outbuf_reset(struct st_outBuf *ob)
+{
+    ob->len = 0;
+    ob->error = ob->data ? 0 : 1;
+}
+
+/* makes room for at least len more bytes plus a terminating zero */
+static int outbuf_reserve(struct st_outBuf *ob, size_t len)
+{
+    size_t size = ob->size ? ob->size : 256;
+    char *data;
+
+    if(ob->error)
+        return -1;
+    if(ob->len + len + 1 <= ob->size)
+        return 0;
+    while(ob->len + len + 1 > size)
+        size *= 2;
+    data = realloc(ob->data, size);
+    if(!data)
+    {
+        ob->error = 1;
+        return -1;
+    }
+    ob->data = data;
+    ob->size = size;
+    return 0;
+}
+
+void outbuf_append(struct st_outBuf *ob, const void *data, size_t len)
+{
+    if(outbuf_reserve(ob, len) != 0)
+        return;
+    memcpy(ob->data + ob->len, data, len);
+    ob->len += len;
+    ob->data[ob->len] = '\0';
+}
+
+void outbuf_printf(struct st_outBuf *ob, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if(ob->error)
+        return;
+
+    va_start(ap, fmt);
+    n = vsnprintf(ob->data + ob->len, ob->size - ob->len, fmt, ap);
+    va_end(ap);
+    if(n < 0)
+    {
+        ob->error = 1;
+        return;
+    }
+    if(ob->len + n + 1 > ob->size)
+    {
+        /* did not fit, grow and format again */
+        if(outbuf_reserve(ob, n) != 0)
+            return;
+        va_start(ap, fmt);
+        vsnprintf(ob->data + ob->len, ob->size - ob->len, fmt, ap);
+        va_end(ap);
+    }
+    ob->len += n;
+}
+
+int outbuf_write(const struct st_outBuf *ob, int fd)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    if(ob->error)
+        return -1;
+    while(done < ob->len)
+    {
+        n = write(fd, ob->data + done, ob->len - done);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
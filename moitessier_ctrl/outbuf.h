@@ -0,0 +1,42 @@
+/*
+    Growable output buffer. Output is formatted into the buffer and written
+    with a single system call.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+
+struct st_outBuf{
+    char    *data;
+    size_t  len;
+    size_t  size;
+    int     error;          /* set if an allocation failed, further output is dropped */
+};
+
+void outbuf_init(struct st_outBuf *ob, size_t size);
+void outbuf_free(struct st_outBuf *ob);
+void outbuf_reset(struct st_outBuf *ob);
+void outbuf_append(struct st_outBuf *ob, const void *data, size_t len);
+void outbuf_printf(struct st_outBuf *ob, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+/* writes the whole buffer to fd, returns 0 on success, -1 on error */
+int outbuf_write(const struct st_outBuf *ob, int fd);
+
+#endif /* OUTBUF_H */
@@ -0,0 +1,232 @@
+/*
+    FIFO overflow mitigation of the Moitessier HAT control program (see
+    overflow_ctrl.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "moitessier_ctrl.h"
+#include "overflow_ctrl.h"
+
+/* one step of the GNSS output ladder */
+struct st_ovfLevel{
+    uint8_t     mask;
+    bool        gnssOn;
+};
+
+struct st_ovfCtrl{
+    struct st_ovfLevel  levels[OVF_CTRL_MAX_LEVELS];
+    int                 numLevels;
+    int                 level;
+    bool                gnssOn;
+    uint64_t            lastChange;         /* [ns] */
+    uint64_t            lastOverflow;       /* [ns] */
+    bool                lastWasIncrease;
+    uint32_t            quietSec;
+};
+
+/* Builds the ladder: the full mask, then the highest sentence bit is removed
+   step by step until only the lowest one (RMC if enabled) is left, and
+   finally GNSS is switched off. */
+static void build_levels(struct st_ovfCtrl *ctrl, const struct st_ovfCtrlParams *params)
+{
+    uint8_t mask = params->fullMask;
+    int bit;
+
+    ctrl->numLevels = 0;
+    ctrl->levels[ctrl->numLevels].mask = mask;
+    ctrl->levels[ctrl->numLevels++].gnssOn = true;
+    while(mask & (mask - 1))
+    {
+        for(bit = 7; !(mask & (1 << bit)); bit--);
+        mask &= ~(1 << bit);
+        ctrl->levels[ctrl->numLevels].mask = mask;
+        ctrl->levels[ctrl->numLevels++].gnssOn = true;
+    }
+    if(params->allowGnssOff || mask == 0)
+    {
+        ctrl->levels[ctrl->numLevels].mask = mask;
+        ctrl->levels[ctrl->numLevels++].gnssOn = false;
+    }
+}
+
+static int apply_level(int fd, struct st_ovfCtrl *ctrl, int level)
+{
+    const struct st_ovfLevel *l = &ctrl->levels[level];
+
+    if(!l->gnssOn)
+    {
+        if(hat_gnss(fd, false) != 0)
+            return -1;
+        ctrl->gnssOn = false;
+    }
+    else
+    {
+        if(!ctrl->gnssOn && hat_gnss(fd, true) != 0)
+            return -1;
+        ctrl->gnssOn = true;
+        if(hat_gnss_msg_config(fd, l->mask) != 0)
+            return -1;
+    }
+    ctrl->level = level;
+    return 0;
+}
+
+static void log_decision(const struct st_ovfCtrl *ctrl, int from, int to, const char *reason,
+                         uint64_t dOverflows, uint64_t dBytes, double dt, const struct st_statistics *statistics)
+{
+    char stamp[32];
+    time_t t = time(NULL);
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+    printf("%s level %d->%d (mask 0x%02x gnss %s -> mask 0x%02x gnss %s): %s, fifoOverflows +%llu fifoBytesProcessed +%llu in %.2f s (totals %llu/%llu), quiet time %u s\n",
+           stamp, from, to,
+           (unsigned int)ctrl->levels[from].mask, ctrl->levels[from].gnssOn ? "on" : "off",
+           (unsigned int)ctrl->levels[to].mask, ctrl->levels[to].gnssOn ? "on" : "off",
+           reason, (unsigned long long)dOverflows, (unsigned long long)dBytes, dt,
+           (unsigned long long)statistics->fifoOverflows, (unsigned long long)statistics->fifoBytesProcessed,
+           ctrl->quietSec);
+    fflush(stdout);
+}
+
+int run_overflow_ctrl(int fd, const struct st_ovfCtrlParams *params)
+{
+    struct st_ovfCtrl ctrl;
+    struct st_statistics last;
+    struct st_statistics statistics;
+    uint64_t interval;
+    uint64_t deadline;
+    uint64_t now;
+    uint64_t lastSample;
+    uint64_t dOverflows;
+    uint64_t dBytes;
+    bool reset;
+    int from;
+
+    if(params->intervalMs == 0)
+    {
+        printf("ERROR: polling interval must be greater than 0\n");
+        return -1;
+    }
+
+    memset(&ctrl, 0, sizeof(ctrl));
+    build_levels(&ctrl, params);
+    ctrl.quietSec = OVF_CTRL_QUIET_SEC;
+
+    /* we do not know what is running, so start with the full GNSS output */
+    if(apply_level(fd, &ctrl, 0) != 0 || hat_get_statistics(fd, &last) != 0)
+    {
+        printf("ERROR: communication with the HAT failed\n");
+        return -1;
+    }
+
+    stop_on_signal();
+    now = time_now_ns();
+    ctrl.lastChange = now;
+    ctrl.lastOverflow = now;
+    lastSample = now;
+    printf("overflow mitigation started, %d levels, full GNSS message mask 0x%02x\n", ctrl.numLevels, (unsigned int)params->fullMask);
+    fflush(stdout);
+
+    interval = (uint64_t)params->intervalMs * 1000000ULL;
+    deadline = now;
+
+    while(!stopRequested)
+    {
+        deadline += interval;
+        if(deadline < time_now_ns())
+            deadline = time_now_ns() + interval;
+        if(sleep_until_ns(deadline) != 0)
+            continue;
+
+        if(hat_get_statistics(fd, &statistics) != 0)
+        {
+            printf("ERROR: reading statistics failed\n");
+            continue;
+        }
+        now = time_now_ns();
+
+        /* statistics have been reset, the counters start from 0 again */
+        reset = statistics.fifoOverflows < last.fifoOverflows || statistics.fifoBytesProcessed < last.fifoBytesProcessed;
+        dOverflows = reset ? statistics.fifoOverflows : statistics.fifoOverflows - last.fifoOverflows;
+        dBytes = reset ? statistics.fifoBytesProcessed : statistics.fifoBytesProcessed - last.fifoBytesProcessed;
+
+        from = ctrl.level;
+        if(dOverflows)
+        {
+            /* overflows shortly after an increase: the last step was too early, wait longer next time */
+            if(ctrl.lastWasIncrease && now - ctrl.lastChange < (uint64_t)ctrl.quietSec * 1000000000ULL)
+            {
+                ctrl.quietSec *= 2;
+                if(ctrl.quietSec > OVF_CTRL_QUIET_MAX_SEC)
+                    ctrl.quietSec = OVF_CTRL_QUIET_MAX_SEC;
+            }
+            ctrl.lastOverflow = now;
+
+            if(ctrl.level < ctrl.numLevels - 1 &&
+               (ctrl.lastWasIncrease || now - ctrl.lastChange >= (uint64_t)OVF_CTRL_HOLD_SEC * 1000000000ULL))
+            {
+                if(apply_level(fd, &ctrl, ctrl.level + 1) == 0)
+                {
+                    ctrl.lastChange = now;
+                    ctrl.lastWasIncrease = false;
+                    log_decision(&ctrl, from, ctrl.level, "overflow, reducing GNSS output", dOverflows, dBytes, (double)(now - lastSample) / 1e9, &statistics);
+                }
+                else
+                    printf("ERROR: changing GNSS output failed\n");
+            }
+        }
+        else if(ctrl.level > 0 &&
+                now - ctrl.lastOverflow >= (uint64_t)ctrl.quietSec * 1000000000ULL &&
+                now - ctrl.lastChange >= (uint64_t)ctrl.quietSec * 1000000000ULL)
+        {
+            /* the previous increase survived a full quiet time, relax the quiet time again */
+            if(ctrl.lastWasIncrease && ctrl.quietSec > OVF_CTRL_QUIET_SEC)
+                ctrl.quietSec /= 2;
+
+            if(apply_level(fd, &ctrl, ctrl.level - 1) == 0)
+            {
+                ctrl.lastChange = now;
+                ctrl.lastWasIncrease = true;
+                log_decision(&ctrl, from, ctrl.level, "no overflows, increasing GNSS output", dOverflows, dBytes, (double)(now - lastSample) / 1e9, &statistics);
+            }
+            else
+                printf("ERROR: changing GNSS output failed\n");
+        }
+
+        last = statistics;
+        lastSample = now;
+    }
+
+    /* do not leave the GNSS output reduced or switched off behind us */
+    if(ctrl.level != 0)
+    {
+        from = ctrl.level;
+        if(apply_level(fd, &ctrl, 0) != 0)
+        {
+            printf("ERROR: restoring the full GNSS output failed\n");
+            return -1;
+        }
+        printf("overflow mitigation stopped, level %d->0 (mask 0x%02x gnss on)\n", from, (unsigned int)params->fullMask);
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+    FIFO overflow mitigation of the Moitessier HAT control program.
+
+    GNSS sentences and AIS messages share the FIFO of the HAT. If the FIFO
+    overflows, AIS messages are lost. The controller watches the FIFO
+    counters and reduces the GNSS output step by step while overflows occur.
+    After a quiet period the GNSS output is increased again (hysteresis).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef OVERFLOW_CTRL_H
+#define OVERFLOW_CTRL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define OVF_CTRL_MAX_LEVELS         10
+#define OVF_CTRL_QUIET_SEC          60      /* overflow free time before the GNSS output is increased */
+#define OVF_CTRL_QUIET_MAX_SEC      3600    /* upper limit of the quiet time after repeated relapses */
+#define OVF_CTRL_HOLD_SEC           5       /* minimum time between two reductions */
+
+struct st_ovfCtrlParams{
+    uint32_t    intervalMs;
+    uint8_t     fullMask;       /* GNSS message mask used without overflows */
+    bool        allowGnssOff;   /* switch GNSS off as last step */
+};
+
+/* Runs the controller until SIGINT/SIGTERM is received. Every decision is
+   logged with the counter deltas that triggered it. On exit GNSS is switched
+   on again with the full message mask. */
+int run_overflow_ctrl(int fd, const struct st_ovfCtrlParams *params);
+
+#endif /* OVERFLOW_CTRL_H */
@@ -0,0 +1,214 @@
+/*
+    Rate engine for the HAT statistics counters (see rates.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "moitessier_ctrl.h"
+#include "rates.h"
+
+const char *rateCounterNames[RATE_COUNTERS] = {
+    "spiCycles",
+    "totalRxPayloadBytes",
+    "fifoOverflows",
+    "fifoBytesProcessed",
+    "payloadCrcErrors",
+    "headerCrcErrors",
+    "keepAliveErrors"
+};
+
+const uint32_t rateWindowSec[RATE_WINDOWS] = {1, 10, 60};
+
+/* struct st_statistics only holds uint64_t counters, so it can be indexed */
+static inline uint64_t counter(const struct st_statistics *statistics, int i)
+{
+    return ((const uint64_t*)statistics)[i];
+}
+
+void rates_init(struct st_rateEngine *re)
+{
+    memset(re, 0, sizeof(*re));
+}
+
+/* removes the oldest sample from window w */
+static void window_evict(struct st_rateEngine *re, int w)
+{
+    struct st_rateSample *sample = &re->ring[re->tail[w]];
+    int c;
+
+    for(c = 0; c < RATE_COUNTERS; c++)
+        re->sum[w][c] -= sample->delta[c];
+    re->tail[w] = (re->tail[w] + 1) % RATE_RING_SIZE;
+    re->count[w]--;
+}
+
+void rates_update(struct st_rateEngine *re, uint64_t timestampNs, const struct st_statistics *statistics)
+{
+    struct st_rates *r = &re->rates;
+    struct st_rateSample *sample;
+    uint64_t value;
+    uint64_t span;
+    uint64_t windowStart;
+    bool reset = false;
+    double dt;
+    double alpha;
+    int w;
+    int c;
+
+    if(!re->haveLast)
+    {
+        /* first sample, there is nothing to compare with yet */
+        re->last = *statistics;
+        re->haveLast = true;
+        r->timestampNs = timestampNs;
+        return;
+    }
+    if(timestampNs <= r->timestampNs)
+        return;
+
+    /* Counters only decrease if they have been reset (IOCTL_RESET_STATISTICS or
+       a HAT reset). The new values are then the increments since the reset. */
+    for(c = 0; c < RATE_COUNTERS; c++)
+    {
+        if(counter(statistics, c) < counter(&re->last, c))
+        {
+            reset = true;
+            break;
+        }
+    }
+    if(reset)
+        r->counterResets++;
+
+    /* the slot we are about to overwrite is still part of a window if the ring is full */
+    for(w = 0; w < RATE_WINDOWS; w++)
+    {
+        if(re->count[w] == RATE_RING_SIZE)
+            window_evict(re, w);
+    }
+
+    sample = &re->ring[re->head];
+    sample->timestampNs = timestampNs;
+    sample->dtNs = timestampNs - r->timestampNs;
+    dt = (double)sample->dtNs / 1e9;
+
+    for(c = 0; c < RATE_COUNTERS; c++)
+    {
+        value = counter(statistics, c);
+        sample->delta[c] = reset ? value : value - counter(&re->last, c);
+        r->instant[c] = (double)sample->delta[c] / dt;
+    }
+
+    re->head = (re->head + 1) % RATE_RING_SIZE;
+
+    for(w = 0; w < RATE_WINDOWS; w++)
+    {
+        for(c = 0; c < RATE_COUNTERS; c++)
+            re->sum[w][c] += sample->delta[c];
+        re->count[w]++;
+
+        /* Drop samples whose interval started before the window. The newest
+           sample is always kept, even if it is longer than the window. */
+        windowStart = (uint64_t)rateWindowSec[w] * 1000000000ULL;
+        windowStart = (timestampNs > windowStart) ? timestampNs - windowStart : 0;
+        while(re->count[w] > 1)
+        {
+            struct st_rateSample *old = &re->ring[re->tail[w]];
+
+            if(old->timestampNs - old->dtNs >= windowStart)
+                break;
+            window_evict(re, w);
+        }
+
+        span = timestampNs - (re->ring[re->tail[w]].timestampNs - re->ring[re->tail[w]].dtNs);
+        r->windowSpanSec[w] = (double)span / 1e9;
+        for(c = 0; c < RATE_COUNTERS; c++)
+            r->window[w][c] = (double)re->sum[w][c] / r->windowSpanSec[w];
+
+        alpha = 1.0 - exp(-dt / (double)rateWindowSec[w]);
+        for(c = 0; c < RATE_COUNTERS; c++)
+        {
+            if(r->samples == 0)
+                r->ewma[w][c] = r->instant[c];
+            else
+                r->ewma[w][c] += alpha * (r->instant[c] - r->ewma[w][c]);
+        }
+
+        if(re->sum[w][RATE_RX_PAYLOAD_BYTES])
+            r->crcErrorsPerKB[w] = 1000.0 * (double)(re->sum[w][RATE_PAYLOAD_CRC_ERRORS] + re->sum[w][RATE_HEADER_CRC_ERRORS]) / (double)re->sum[w][RATE_RX_PAYLOAD_BYTES];
+        else
+            r->crcErrorsPerKB[w] = 0;
+    }
+
+    r->samples++;
+    r->timestampNs = timestampNs;
+    re->last = *statistics;
+}
+
+/* Polls the statistics and prints the rates of the most interesting counters
+   once per interval until SIGINT/SIGTERM is received. */
+int run_rate_monitor(int fd, uint32_t intervalMs)
+{
+    static struct st_rateEngine re;
+    struct st_statistics statistics;
+    const struct st_rates *r = &re.rates;
+    uint64_t interval;
+    uint64_t deadline;
+
+    if(intervalMs == 0)
+    {
+        printf("ERROR: polling interval must be greater than 0\n");
+        return -1;
+    }
+
+    rates_init(&re);
+    stop_on_signal();
+    interval = (uint64_t)intervalMs * 1000000ULL;
+    deadline = time_now_ns();
+
+    printf("%-8s %-30s %-30s %-24s %s\n", "", "payload [B/s] 1s/10s/60s", "fifo overflows [1/s]", "crc errors [1/kB]", "resets");
+    while(!stopRequested)
+    {
+        if(hat_get_statistics(fd, &statistics) != 0)
+        {
+            printf("ERROR: reading statistics failed\n");
+            return -1;
+        }
+        rates_update(&re, time_now_ns(), &statistics);
+
+        if(r->samples)
+        {
+            printf("instant  %-30.1f %-30.3f\n", r->instant[RATE_RX_PAYLOAD_BYTES], r->instant[RATE_FIFO_OVERFLOWS]);
+            printf("window   %9.1f %9.1f %9.1f  %9.3f %9.3f %9.3f  %7.3f %7.3f %7.3f  %u\n",
+                   r->window[0][RATE_RX_PAYLOAD_BYTES], r->window[1][RATE_RX_PAYLOAD_BYTES], r->window[2][RATE_RX_PAYLOAD_BYTES],
+                   r->window[0][RATE_FIFO_OVERFLOWS], r->window[1][RATE_FIFO_OVERFLOWS], r->window[2][RATE_FIFO_OVERFLOWS],
+                   r->crcErrorsPerKB[0], r->crcErrorsPerKB[1], r->crcErrorsPerKB[2], r->counterResets);
+            printf("ewma     %9.1f %9.1f %9.1f  %9.3f %9.3f %9.3f\n",
+                   r->ewma[0][RATE_RX_PAYLOAD_BYTES], r->ewma[1][RATE_RX_PAYLOAD_BYTES], r->ewma[2][RATE_RX_PAYLOAD_BYTES],
+                   r->ewma[0][RATE_FIFO_OVERFLOWS], r->ewma[1][RATE_FIFO_OVERFLOWS], r->ewma[2][RATE_FIFO_OVERFLOWS]);
+            fflush(stdout);
+        }
+
+        deadline += interval;
+        if(deadline < time_now_ns())
+            deadline = time_now_ns() + interval;
+        sleep_until_ns(deadline);
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+    Rate engine for the HAT statistics counters.
+
+    The counters of struct st_statistics are monotonic. The rate engine keeps
+    the timestamped deltas of consecutive snapshots in a fixed-size ring and
+    derives instantaneous rates, sliding window rates and EWMA rates over
+    1 s, 10 s and 60 s. Every update does a constant (amortized) amount of
+    work, regardless of the window length.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef RATES_H
+#define RATES_H
+
+#include <stdint.h>
+#include "moitessier_ctrl.h"
+
+/* number of uint64_t counters in struct st_statistics, in declaration order */
+#define RATE_COUNTERS               7
+#define RATE_SPI_CYCLES             0
+#define RATE_RX_PAYLOAD_BYTES       1
+#define RATE_FIFO_OVERFLOWS         2
+#define RATE_FIFO_BYTES_PROCESSED   3
+#define RATE_PAYLOAD_CRC_ERRORS     4
+#define RATE_HEADER_CRC_ERRORS      5
+#define RATE_KEEP_ALIVE_ERRORS      6
+
+#define RATE_WINDOWS                3       /* 1 s, 10 s, 60 s */
+#define RATE_RING_SIZE              1024    /* must hold 60 s of samples, i.e. >= 60 ms polling interval */
+
+extern const char *rateCounterNames[RATE_COUNTERS];
+extern const uint32_t rateWindowSec[RATE_WINDOWS];
+
+struct st_rateSample{
+    uint64_t    timestampNs;
+    uint64_t    dtNs;                           /* time since the previous sample */
+    uint64_t    delta[RATE_COUNTERS];
+};
+
+struct st_rates{
+    uint64_t    timestampNs;
+    uint32_t    samples;                        /* samples seen since rates_init() */
+    uint32_t    counterResets;                  /* detected counter resets (e.g. IOCTL_RESET_STATISTICS) */
+    double      instant[RATE_COUNTERS];         /* [1/s] between the last two snapshots */
+    double      window[RATE_WINDOWS][RATE_COUNTERS];    /* [1/s] sliding window */
+    double      windowSpanSec[RATE_WINDOWS];    /* time actually covered by each window */
+    double      ewma[RATE_WINDOWS][RATE_COUNTERS];      /* [1/s] exponentially weighted, tau = window */
+    double      crcErrorsPerKB[RATE_WINDOWS];   /* (payload + header CRC errors) per 1000 payload bytes */
+};
+
+struct st_rateEngine{
+    struct st_statistics    last;
+    bool                    haveLast;
+    uint32_t                head;               /* next ring slot to write */
+    uint32_t                tail[RATE_WINDOWS]; /* oldest sample inside each window */
+    uint32_t                count[RATE_WINDOWS];
+    uint64_t                sum[RATE_WINDOWS][RATE_COUNTERS];
+    struct st_rateSample    ring[RATE_RING_SIZE];
+    struct st_rates         rates;
+};
+
+void rates_init(struct st_rateEngine *re);
+/* feeds a new statistics snapshot taken at timestampNs (CLOCK_MONOTONIC) */
+void rates_update(struct st_rateEngine *re, uint64_t timestampNs, const struct st_statistics *statistics);
+
+int run_rate_monitor(int fd, uint32_t intervalMs);
+
+#endif /* RATES_H */
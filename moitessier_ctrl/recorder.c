@@ -0,0 +1,464 @@
+/*
+    Statistics recorder of the Moitessier HAT control program (see
+    recorder.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "moitessier_ctrl.h"
+#include "recorder.h"
+
+#define REC_PAGE_SIZE               4096
+#define REC_MAX_RECORD              (REC_COUNTERS + 1) * 10     /* varints of 64 bit values take up to 10 bytes */
+#define REC_CAPACITY                (REC_BLOCK_SIZE - sizeof(struct st_recBlock))
+#define REC_CLOCK_STEP_MS           1000    /* wall clock step (NTP, fake-hwclock) that starts a new block */
+
+static const char *counterNames[REC_COUNTERS] = {
+    "spiCycles", "totalRxPayloadBytes", "fifoOverflows", "fifoBytesProcessed",
+    "payloadCrcErrors", "headerCrcErrors", "keepAliveErrors"
+};
+
+struct st_recFile{
+    int                     fd;
+    uint8_t                 *map;
+    size_t                  size;
+    struct st_recHeader     *header;
+    struct st_recIndex      *index;
+};
+
+/* decodes the records of one block */
+struct st_recCursor{
+    const uint8_t           *p;
+    const uint8_t           *end;
+    uint32_t                left;           /* records not returned yet */
+    bool                    key;            /* the next record is the key record */
+    uint64_t                ms;
+    uint64_t                counters[REC_COUNTERS];
+};
+
+static uint64_t realtime_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static uint64_t zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t* put_varint(uint8_t *p, uint64_t v)
+{
+    while(v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+/* returns NULL if the varint runs past end */
+static const uint8_t* get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while(p < end && shift < 64)
+    {
+        *v |= (uint64_t)(*p & 0x7F) << shift;
+        if(!(*p++ & 0x80))
+            return p;
+        shift += 7;
+    }
+    return NULL;
+}
+
+static struct st_recBlock* block_of(const struct st_recFile *rf, uint64_t seq)
+{
+    return (struct st_recBlock*)(rf->map + rf->header->dataOffset + (seq % rf->header->numBlocks) * rf->header->blockSize);
+}
+
+static void cursor_init(struct st_recCursor *c, const struct st_recBlock *block)
+{
+    c->p = (const uint8_t*)(block + 1);
+    c->end = c->p + ((block->used <= REC_CAPACITY) ? block->used : 0);
+    c->left = block->records;
+    c->key = true;
+    c->ms = block->startMs;
+    memcpy(c->counters, block->counters, sizeof(c->counters));
+}
+
+/* advances to the next record, returns -1 at the end of the block */
+static int cursor_next(struct st_recCursor *c)
+{
+    uint64_t v;
+    int i;
+
+    if(c->left == 0)
+        return -1;
+    c->left--;
+    if(c->key)
+    {
+        c->key = false;
+        return 0;
+    }
+    if(!(c->p = get_varint(c->p, c->end, &v)))
+        return -1;
+    c->ms += unzigzag(v);
+    for(i = 0; i < REC_COUNTERS; i++)
+    {
+        if(!(c->p = get_varint(c->p, c->end, &v)))
+            return -1;
+        c->counters[i] += unzigzag(v);
+    }
+    return 0;
+}
+
+static void rec_close(struct st_recFile *rf)
+{
+    if(rf->map && rf->map != MAP_FAILED)
+    {
+        msync(rf->map, rf->size, MS_SYNC);
+        munmap(rf->map, rf->size);
+    }
+    if(rf->fd >= 0)
+        close(rf->fd);
+}
+
+/* maps the ring file, it is created if writable is set and it does not exist yet */
+static int rec_open(struct st_recFile *rf, const char *fileName, bool writable, uint32_t sizeMB, uint32_t intervalMs)
+{
+    struct stat st;
+    uint64_t total;
+    uint64_t n;
+
+    memset(rf, 0, sizeof(*rf));
+    rf->fd = open(fileName, writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+    if(rf->fd < 0 || fstat(rf->fd, &st) != 0)
+    {
+        printf("ERROR: could not open \"%s\": %s\n", fileName, strerror(errno));
+        rec_close(rf);
+        return -1;
+    }
+
+    if(st.st_size == 0 && writable)
+    {
+        /* header and index are rounded up to full pages, the rest are blocks */
+        total = (uint64_t)sizeMB * 1024 * 1024;
+        n = (total - REC_PAGE_SIZE) / (REC_BLOCK_SIZE + sizeof(struct st_recIndex));
+        if(total < 4 * REC_BLOCK_SIZE || n < 2 || ftruncate(rf->fd, (off_t)total) != 0)
+        {
+            printf("ERROR: could not create \"%s\" with %u MB\n", fileName, sizeMB);
+            rec_close(rf);
+            return -1;
+        }
+        st.st_size = (off_t)total;
+    }
+    else
+        n = 0;
+
+    rf->size = (size_t)st.st_size;
+    rf->map = mmap(NULL, rf->size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, rf->fd, 0);
+    if(rf->map == MAP_FAILED)
+    {
+        printf("ERROR: could not map \"%s\": %s\n", fileName, strerror(errno));
+        rec_close(rf);
+        return -1;
+    }
+    rf->header = (struct st_recHeader*)rf->map;
+    rf->index = (struct st_recIndex*)(rf->header + 1);
+
+    if(n)
+    {
+        rf->header->magic = REC_MAGIC;
+        rf->header->version = REC_VERSION;
+        rf->header->blockSize = REC_BLOCK_SIZE;
+        rf->header->numBlocks = (uint32_t)n;
+        rf->header->dataOffset = (sizeof(struct st_recHeader) + n * sizeof(struct st_recIndex) + REC_PAGE_SIZE - 1) / REC_PAGE_SIZE * REC_PAGE_SIZE;
+        rf->header->nextSeq = 1;
+        rf->header->intervalMs = intervalMs;
+    }
+
+    if(rf->size < sizeof(struct st_recHeader) || rf->header->magic != REC_MAGIC || rf->header->version != REC_VERSION ||
+       rf->header->blockSize != REC_BLOCK_SIZE || rf->header->numBlocks == 0 ||
+       rf->header->dataOffset < sizeof(struct st_recHeader) + (uint64_t)rf->header->numBlocks * sizeof(struct st_recIndex) ||
+       rf->header->dataOffset + (uint64_t)rf->header->numBlocks * rf->header->blockSize > rf->size)
+    {
+        printf("ERROR: \"%s\" is not a statistics recording\n", fileName);
+        rec_close(rf);
+        return -1;
+    }
+    return 0;
+}
+
+int run_recorder(int fd, const char *fileName, uint32_t sizeMB, uint32_t intervalMs)
+{
+    struct st_recFile rf;
+    struct st_recBlock *block = NULL;
+    const struct st_recIndex *prevIndex;
+    struct st_recCursor c;
+    struct st_statistics statistics;
+    const uint64_t *counters = (const uint64_t*)&statistics;
+    uint64_t last[REC_COUNTERS];
+    uint64_t lastMs = 0;
+    uint64_t baseMs = 0;
+    uint64_t baseMonoMs = 0;
+    uint64_t wallMs;
+    uint64_t monoMs;
+    uint64_t records = 0;
+    uint64_t runSeq;
+    uint64_t interval;
+    uint64_t deadline;
+    uint64_t ms;
+    uint8_t rec[REC_MAX_RECORD];
+    uint8_t *p;
+    int i;
+
+    if(intervalMs == 0)
+    {
+        printf("ERROR: polling interval must be greater than 0\n");
+        return -1;
+    }
+    if(rec_open(&rf, fileName, true, sizeMB, intervalMs) != 0)
+        return -1;
+
+    /* continue the newest block, we need its last record for the deltas */
+    if(rf.header->nextSeq > 1)
+    {
+        block = block_of(&rf, rf.header->nextSeq - 1);
+        if(block->seq != rf.header->nextSeq - 1)
+            block = NULL;
+        else
+        {
+            cursor_init(&c, block);
+            while(cursor_next(&c) == 0);
+            if(c.left || c.p != c.end)
+                block = NULL;   /* damaged, start a new one */
+            lastMs = c.ms;
+            baseMs = realtime_ms();
+            baseMonoMs = time_now_ns() / 1000000ULL;
+            memcpy(last, c.counters, sizeof(last));
+        }
+    }
+
+    stop_on_signal();
+    printf("recording statistics to \"%s\" every %u ms, %u blocks of %u bytes\n",
+           fileName, intervalMs, (unsigned int)rf.header->numBlocks, (unsigned int)rf.header->blockSize);
+    fflush(stdout);
+
+    interval = (uint64_t)intervalMs * 1000000ULL;
+    deadline = time_now_ns();
+    while(!stopRequested)
+    {
+        if(hat_get_statistics(fd, &statistics) == 0)
+        {
+            /* the times of a block are CLOCK_MONOTONIC based on the wall clock at its
+               start, so they never go back within a block. The Pi has no RTC, when the
+               wall clock is stepped a new block starts with the new time. */
+            wallMs = realtime_ms();
+            monoMs = time_now_ns() / 1000000ULL;
+            ms = baseMs + (monoMs - baseMonoMs);
+            if(block && (wallMs + REC_CLOCK_STEP_MS < ms || wallMs > ms + REC_CLOCK_STEP_MS || ms < lastMs))
+                block = NULL;
+            if(!block)
+            {
+                baseMs = ms = wallMs;
+                baseMonoMs = monoMs;
+            }
+            p = rec;
+            if(block)
+            {
+                p = put_varint(p, zigzag((int64_t)(ms - lastMs)));
+                for(i = 0; i < REC_COUNTERS; i++)
+                    p = put_varint(p, zigzag((int64_t)(counters[i] - last[i])));
+            }
+
+            if(block && block->used + (p - rec) <= REC_CAPACITY)
+            {
+                /* the record is complete before it is accounted, readers never see a partial one */
+                memcpy((uint8_t*)(block + 1) + block->used, rec, p - rec);
+                block->used += (uint32_t)(p - rec);
+                block->lastMs = ms;
+                block->records++;
+            }
+            else
+            {
+                /* new block with a key record, it replaces the oldest one. It continues
+                   the run of its predecessor unless the wall clock went back. */
+                prevIndex = &rf.index[(rf.header->nextSeq - 1) % rf.header->numBlocks];
+                block = block_of(&rf, rf.header->nextSeq - 1);
+                if(rf.header->nextSeq > 1 && block->seq == rf.header->nextSeq - 1 && prevIndex->seq == block->seq &&
+                   ms >= block->lastMs)
+                    runSeq = prevIndex->runSeq;
+                else
+                    runSeq = rf.header->nextSeq;
+                block = block_of(&rf, rf.header->nextSeq);
+                block->seq = 0;
+                block->startMs = ms;
+                block->lastMs = ms;
+                memcpy(block->counters, counters, sizeof(block->counters));
+                block->used = 0;
+                block->records = 1;
+                block->seq = rf.header->nextSeq;
+                rf.index[block->seq % rf.header->numBlocks].startMs = ms;
+                rf.index[block->seq % rf.header->numBlocks].runSeq = runSeq;
+                rf.index[block->seq % rf.header->numBlocks].seq = block->seq;
+                rf.header->nextSeq++;
+            }
+            lastMs = ms;
+            memcpy(last, counters, sizeof(last));
+            records++;
+        }
+        else
+            printf("ERROR: reading statistics failed\n");
+
+        deadline += interval;
+        if(deadline < time_now_ns())
+            deadline = time_now_ns() + interval;
+        sleep_until_ns(deadline);
+    }
+
+    rec_close(&rf);
+    printf("recorder stopped after %llu records\n", (unsigned long long)records);
+    return 0;
+}
+
+int recorder_dump(const char *fileName, uint64_t fromSec, uint64_t toSec)
+{
+    struct st_recFile rf;
+    struct st_recCursor c;
+    const struct st_recBlock *block;
+    const struct st_recIndex *idx;
+    uint64_t fromMs = fromSec * 1000ULL;
+    uint64_t toMs = toSec ? toSec * 1000ULL : UINT64_MAX;
+    uint64_t prev[REC_COUNTERS];
+    uint64_t prevMs = 0;
+    bool havePrev;
+    uint64_t *runs;
+    uint32_t numRuns = 0;
+    uint32_t r;
+    uint64_t oldest;
+    uint64_t newest;
+    uint64_t first;
+    uint64_t last;
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t mid;
+    uint64_t seq;
+    double dt;
+    int i;
+
+    if(rec_open(&rf, fileName, false, 0, 0) != 0)
+        return -1;
+
+    newest = rf.header->nextSeq - 1;
+    oldest = (rf.header->nextSeq > rf.header->numBlocks) ? rf.header->nextSeq - rf.header->numBlocks : 1;
+
+    /* the first blocks of the runs, from the newest run back. Every step of the
+       wall clock back started a run, a damaged index entry is a run on its own. */
+    runs = malloc(rf.header->numBlocks * sizeof(uint64_t));
+    if(runs == NULL)
+    {
+        printf("ERROR: out of memory\n");
+        rec_close(&rf);
+        return -1;
+    }
+    for(seq = newest; seq >= oldest && seq > 0; seq = first - 1)
+    {
+        idx = &rf.index[seq % rf.header->numBlocks];
+        first = (idx->seq == seq && idx->runSeq <= seq) ? idx->runSeq : seq;
+        if(first < oldest)
+            first = oldest;     /* the beginning of the run was overwritten */
+        runs[numRuns++] = first;
+    }
+
+    printf("time,interval");
+    for(i = 0; i < REC_COUNTERS; i++)
+        printf(",%s", counterNames[i]);
+    printf("\n");
+
+    for(r = numRuns; r-- > 0; )
+    {
+        first = runs[r];
+        last = r ? runs[r - 1] - 1 : newest;
+
+        /* the last block of the run starting before fromMs holds the record
+           preceding the first one of the range, the earlier blocks are skipped */
+        lo = first;
+        hi = last;
+        while(lo < hi)
+        {
+            mid = lo + (hi - lo + 1) / 2;
+            if(rf.index[mid % rf.header->numBlocks].startMs < fromMs)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        /* no rate across a step of the wall clock back */
+        havePrev = false;
+        for(seq = lo; seq <= last; seq++)
+        {
+            if(rf.index[seq % rf.header->numBlocks].startMs > toMs)
+                break;
+            block = block_of(&rf, seq);
+            if(block->seq != seq)
+            {
+                havePrev = false;   /* overwritten while we read or damaged */
+                continue;
+            }
+
+            cursor_init(&c, block);
+            while(cursor_next(&c) == 0)
+            {
+                if(havePrev && c.ms > prevMs && c.ms >= fromMs && c.ms <= toMs)
+                {
+                    dt = (c.ms - prevMs) / 1000.0;
+                    printf("%llu.%03u,%.3f", (unsigned long long)(c.ms / 1000), (unsigned int)(c.ms % 1000), dt);
+                    /* a counter that went back was reset, it counts from 0 again */
+                    for(i = 0; i < REC_COUNTERS; i++)
+                        printf(",%.3f", ((c.counters[i] >= prev[i]) ? c.counters[i] - prev[i] : c.counters[i]) / dt);
+                    printf("\n");
+                }
+                prevMs = c.ms;
+                memcpy(prev, c.counters, sizeof(prev));
+                havePrev = true;
+            }
+        }
+    }
+
+    free(runs);
+    rec_close(&rf);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+    Statistics recorder of the Moitessier HAT control program.
+
+    The history is kept in a ring file of fixed size that is memory mapped:
+
+        header      struct st_recHeader
+        index       struct st_recIndex[numBlocks], sparse time index
+        blocks      numBlocks blocks of blockSize bytes
+
+    Every block starts with a key record (struct st_recBlock, absolute time
+    and counters), the following records store the time and counter deltas
+    to the previous record as zig-zag encoded varints, i.e. typically 10...15
+    bytes per record. A block can be decoded on its own, the oldest block is
+    overwritten when the file is full. The index holds the start time of each
+    block. The Pi has no RTC, the wall clock may be stepped back (NTP,
+    fake-hwclock), so the blocks form runs of ordered start times, a block
+    that starts before the last record of its predecessor starts a new run.
+    Every index entry refers to the first block of its run, a time stamp is
+    found with a binary search within each run.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include "moitessier_ctrl.h"
+
+#define REC_MAGIC                   0x4345524d      /* "MREC" */
+#define REC_VERSION                 2
+#define REC_BLOCK_SIZE              4096
+#define REC_COUNTERS                7               /* uint64_t counters of struct st_statistics */
+#define REC_DEFAULT_SIZE_MB         64              /* about two months of 1 s records */
+
+struct st_recHeader{
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    blockSize;
+    uint32_t    numBlocks;
+    uint64_t    dataOffset;             /* file offset of the first block */
+    uint64_t    nextSeq;                /* sequence number of the next block, starts at 1 */
+    uint32_t    intervalMs;             /* polling interval of the recorder that created the file */
+    uint32_t    reserved[7];
+};
+
+struct st_recIndex{
+    uint64_t    seq;                    /* 0 if the block was never written */
+    uint64_t    startMs;
+    uint64_t    runSeq;                 /* first block of the run of ordered start times */
+};
+
+struct st_recBlock{
+    uint64_t    seq;
+    uint64_t    startMs;                /* CLOCK_REALTIME [ms] of the key record, the later ones are
+                                           CLOCK_MONOTONIC based on it */
+    uint64_t    lastMs;
+    uint64_t    counters[REC_COUNTERS]; /* key record */
+    uint32_t    used;                   /* bytes of delta records following the header */
+    uint32_t    records;                /* including the key record */
+};
+
+/* polls the statistics every intervalMs and appends them to the ring file,
+   which is created with sizeMB if it does not exist */
+int run_recorder(int fd, const char *fileName, uint32_t sizeMB, uint32_t intervalMs);
+
+/* prints the rates between consecutive records of [fromSec, toSec] (UNIX
+   time, 0 for open ends) as CSV */
+int recorder_dump(const char *fileName, uint64_t fromSec, uint64_t toSec);
+
+#endif /* RECORDER_H */
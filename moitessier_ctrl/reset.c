@@ -0,0 +1,110 @@
+/*
+    HAT reset with readiness polling of the Moitessier HAT control program
+    (see reset.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include "moitessier_ctrl.h"
+#include "reset.h"
+
+/* Sleeps for the current poll interval and grows it. The HAT needs some
+   hundred milliseconds to boot, polling fast in the beginning catches quick
+   restarts, backing off keeps the SPI load low during a slow one. Returns
+   -1 if the deadline has passed. */
+static int backoff(uint64_t *intervalUs, uint64_t deadline)
+{
+    uint64_t next = time_now_ns() + *intervalUs * 1000ULL;
+
+    if(next > deadline)
+        next = deadline;
+    sleep_until_ns(next);
+    *intervalUs = *intervalUs * 3 / 2;
+    if(*intervalUs > RESET_POLL_MAX_US)
+        *intervalUs = RESET_POLL_MAX_US;
+    return (time_now_ns() >= deadline) ? -1 : 0;
+}
+
+int hat_reset_wait(int fd, uint32_t timeoutMs, const struct st_configHAT *configHAT, struct st_resetTimes *times)
+{
+    unsigned char buf[IOCTL_BUF_SIZE];
+    struct st_statistics statistics;
+    struct st_info info;
+    uint64_t intervalUs;
+    uint64_t deadline;
+    uint64_t start;
+    uint64_t payload;
+
+    memset(times, 0, sizeof(*times));
+    memset(buf, 0, sizeof(buf));
+
+    start = time_now_ns();
+    deadline = start + (uint64_t)timeoutMs * 1000000ULL;
+    if(ioctl(fd, IOCTL_RESET_HAT, &buf) < 0)
+    {
+        printf("ERROR: resetting HAT failed\n");
+        return -1;
+    }
+
+    /* right after the IOCTL the HAT may not have dropped info->valid yet,
+       so the first poll follows RESET_POLL_MIN_US after the reset */
+    intervalUs = RESET_POLL_MIN_US;
+    for(;;)
+    {
+        if(backoff(&intervalUs, deadline) != 0)
+        {
+            printf("ERROR: HAT not ready within %u ms\n", timeoutMs);
+            return -1;
+        }
+        times->polls++;
+        if(hat_get_info(fd, &info) == 0 && info.valid)
+            break;
+    }
+    times->readyNs = time_now_ns() - start;
+
+    /* the HAT runs its default configuration after the reset */
+    if(configHAT)
+    {
+        if(hat_config(fd, configHAT) != 0)
+        {
+            printf("ERROR: configuring HAT failed\n");
+            return -1;
+        }
+        times->configNs = time_now_ns() - start;
+    }
+
+    /* the first payload byte shows the receivers are really up again */
+    if(hat_get_statistics(fd, &statistics) != 0)
+        return 0;
+    payload = statistics.totalRxPayloadBytes;
+    intervalUs = RESET_POLL_MIN_US;
+    while(backoff(&intervalUs, deadline) == 0)
+    {
+        times->polls++;
+        if(hat_get_statistics(fd, &statistics) != 0)
+            break;
+        if(statistics.totalRxPayloadBytes != payload)
+        {
+            times->payloadNs = time_now_ns() - start;
+            break;
+        }
+    }
+    return 0;
+}
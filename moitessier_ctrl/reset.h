@@ -0,0 +1,43 @@
+/*
+    HAT reset with readiness polling of the Moitessier HAT control program.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef RESET_H
+#define RESET_H
+
+#include <stdint.h>
+#include "moitessier_ctrl.h"
+
+#define RESET_POLL_MIN_US           500     /* first GET_INFO poll after the reset */
+#define RESET_POLL_MAX_US           20000   /* the poll interval grows by 1.5 up to this value */
+
+struct st_resetTimes{
+    uint64_t    readyNs;        /* reset until info->valid, 0 if not reached */
+    uint64_t    configNs;       /* reset until the configuration was applied, 0 if none */
+    uint64_t    payloadNs;      /* reset until totalRxPayloadBytes increased, 0 if not reached */
+    uint32_t    polls;          /* IOCTLs issued while waiting */
+};
+
+/* Resets the HAT, waits until it reports valid info, applies configHAT (may be
+   NULL) and waits for the first payload byte, all within timeoutMs. Returns
+   0 if the HAT got ready, -1 otherwise. A missing payload is not an error,
+   there may just be no AIS traffic. */
+int hat_reset_wait(int fd, uint32_t timeoutMs, const struct st_configHAT *configHAT, struct st_resetTimes *times);
+
+#endif /* RESET_H */
@@ -0,0 +1,138 @@
+/*
+    Statistics daemon of the Moitessier HAT control program. Polls the
+    statistics of the HAT and publishes them in shared memory (see
+    stats_shm.h for the reader side).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "moitessier_ctrl.h"
+#include "stats_shm.h"
+
+/* creates (or re-initializes) the shared memory segment, returns NULL on error */
+struct st_statsShm* stats_shm_create(const char *name)
+{
+    int fd;
+    struct st_statsShm *shm;
+
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if(fd < 0)
+    {
+        printf("ERROR: could not create shared memory \"%s\": %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    if(ftruncate(fd, sizeof(struct st_statsShm)) != 0)
+    {
+        printf("ERROR: could not size shared memory \"%s\": %s\n", name, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    shm = mmap(NULL, sizeof(struct st_statsShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(shm == MAP_FAILED)
+    {
+        printf("ERROR: could not map shared memory \"%s\": %s\n", name, strerror(errno));
+        return NULL;
+    }
+
+    /* readers reject the segment until magic and version are set */
+    shm->magic = 0;
+    __atomic_store_n(&shm->seq, 0, __ATOMIC_RELEASE);
+    memset(&shm->snapshot, 0, sizeof(shm->snapshot));
+    shm->version = STATS_SHM_VERSION;
+    __atomic_store_n(&shm->magic, STATS_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    return shm;
+}
+
+/* writer side of the sequence lock, there must only be a single writer */
+void stats_shm_publish(struct st_statsShm *shm, const struct st_statsSnapshot *snap)
+{
+    uint32_t seq = shm->seq;
+
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&shm->snapshot, snap, sizeof(*snap));
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void stats_shm_destroy(struct st_statsShm *shm, const char *name)
+{
+    if(shm)
+        munmap(shm, sizeof(struct st_statsShm));
+    shm_unlink(name);
+}
+
+/* Polls the statistics every intervalMs milliseconds until SIGINT/SIGTERM is
+   received. The deadline is advanced by the interval (not by the time the
+   IOCTL took), so the polling rate does not drift. */
+int run_daemon(int fd, uint32_t intervalMs, const char *shmName)
+{
+    struct st_statsShm *shm;
+    struct st_statsSnapshot snap;
+    uint64_t deadline;
+    uint64_t interval;
+
+    if(intervalMs == 0)
+    {
+        printf("ERROR: polling interval must be greater than 0\n");
+        return -1;
+    }
+
+    shm = stats_shm_create(shmName);
+    if(!shm)
+        return -1;
+
+    stop_on_signal();
+    printf("publishing statistics to shared memory \"%s\" every %u ms\n", shmName, intervalMs);
+    fflush(stdout);
+
+    memset(&snap, 0, sizeof(snap));
+    snap.pollIntervalMs = intervalMs;
+    interval = (uint64_t)intervalMs * 1000000ULL;
+    deadline = time_now_ns();
+
+    while(!stopRequested)
+    {
+        snap.timestampNs = time_now_ns();
+        if(hat_get_statistics(fd, &snap.statistics) == 0)
+            snap.error = 0;
+        else
+            snap.error = errno;
+        snap.updates++;
+        stats_shm_publish(shm, &snap);
+
+        deadline += interval;
+        /* we fell behind (e.g. the system was suspended), do not try to catch up */
+        if(deadline < time_now_ns())
+            deadline = time_now_ns() + interval;
+        sleep_until_ns(deadline);
+    }
+
+    stats_shm_destroy(shm, shmName);
+    printf("daemon stopped after %llu updates\n", (unsigned long long)snap.updates);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+    Shared memory segment used to publish HAT statistics snapshots.
+
+    The daemon mode (command 8) keeps the control device open, polls
+    IOCTL_GET_STATISTICS and writes every snapshot into a POSIX shared memory
+    segment protected by a sequence lock. Readers map the segment once and
+    afterwards get consistent counters without any system call:
+
+        int fd = shm_open(STATS_SHM_DEFAULT_NAME, O_RDONLY, 0);
+        const struct st_statsShm *shm = mmap(NULL, sizeof(*shm), PROT_READ, MAP_SHARED, fd, 0);
+        struct st_statsSnapshot snap;
+        stats_shm_read(shm, &snap);
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "moitessier_ctrl.h"
+
+#define STATS_SHM_DEFAULT_NAME      "/moitessier_stats"
+#define STATS_SHM_MAGIC             0x4d535453      /* "MSTS" */
+#define STATS_SHM_VERSION           1
+
+struct st_statsSnapshot{
+    uint64_t                timestampNs;    /* CLOCK_MONOTONIC time of the IOCTL */
+    uint64_t                updates;        /* number of snapshots published so far */
+    uint32_t                pollIntervalMs;
+    int32_t                 error;          /* 0 if the last IOCTL succeeded, else errno */
+    struct st_statistics    statistics;
+};
+
+struct st_statsShm{
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                seq;            /* odd while the writer updates the snapshot */
+    uint32_t                reserved;
+    struct st_statsSnapshot snapshot;
+};
+
+/* Copies a consistent snapshot out of the segment. Returns 0 on success or -1
+   if the segment was not initialized by a compatible writer. */
+static inline int stats_shm_read(const struct st_statsShm *shm, struct st_statsSnapshot *snap)
+{
+    uint32_t s1;
+    uint32_t s2;
+
+    if(shm->magic != STATS_SHM_MAGIC || shm->version != STATS_SHM_VERSION)
+        return -1;
+
+    do
+    {
+        s1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        memcpy(snap, (const void*)&shm->snapshot, sizeof(*snap));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    }while((s1 & 1) || s1 != s2);
+
+    return 0;
+}
+
+/* stats_shm.c - writer side */
+struct st_statsShm* stats_shm_create(const char *name);
+void stats_shm_publish(struct st_statsShm *shm, const struct st_statsSnapshot *snap);
+void stats_shm_destroy(struct st_statsShm *shm, const char *name);
+
+int run_daemon(int fd, uint32_t intervalMs, const char *shmName);
+
+#endif /* STATS_SHM_H */
@@ -0,0 +1,411 @@
+/*
+    Temperature compensated TCXO tracking of the Moitessier HAT control
+    program (see tcxo_track.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "calib.h"
+#include "temp.h"
+#include "tcxo_track.h"
+
+#define STATE_IDLE                  0
+#define STATE_PROBE_PLUS            1
+#define STATE_PROBE_MINUS           2
+
+struct st_tcxoBin{
+    double      offsetHz;
+    uint32_t    probes;
+};
+
+struct st_tcxoTrack{
+    int                     fd;
+    const struct st_tcxoTrackParams *params;
+    struct st_configHAT     base;
+    struct st_tcxoBin       bins[TCXO_TRACK_BINS];
+    double                  coeff[3];       /* offset = c0 + c1 * x + c2 * x^2, x = T - 25 degrees */
+    int32_t                 applied;        /* [Hz] offset the HAT is running */
+    int                     state;
+    uint64_t                stateEnd;
+    uint64_t                nextProbe;
+    int                     probeBin;
+    double                  probeScore;
+    struct st_statistics    probeStart;
+    uint64_t                probeStartNs;
+};
+
+static void log_stamp(void)
+{
+    char stamp[32];
+    time_t t = time(NULL);
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+    printf("%s ", stamp);
+}
+
+static int bin_of(double celsius)
+{
+    int bin = (int)floor(celsius) - TCXO_TRACK_MIN_DEG;
+
+    if(bin < 0)
+        return 0;
+    if(bin >= TCXO_TRACK_BINS)
+        return TCXO_TRACK_BINS - 1;
+    return bin;
+}
+
+static double predict(const struct st_tcxoTrack *t, double celsius)
+{
+    double x = celsius - 25.0;
+
+    return t->coeff[0] + t->coeff[1] * x + t->coeff[2] * x * x;
+}
+
+/* weighted least squares fit over the learned bins, the degree is limited by
+   the number of bins so a single bin gives a constant offset */
+static void fit_model(struct st_tcxoTrack *t)
+{
+    double a[3][4];
+    double x;
+    double w;
+    double f;
+    int used = 0;
+    int degree;
+    int n;
+    int i;
+    int j;
+    int k;
+
+    memset(a, 0, sizeof(a));
+    for(i = 0; i < TCXO_TRACK_BINS; i++)
+    {
+        if(t->bins[i].probes)
+            used++;
+    }
+    memset(t->coeff, 0, sizeof(t->coeff));
+    if(used == 0)
+        return;
+    degree = (used > 2) ? 2 : used - 1;
+    n = degree + 1;
+
+    /* normal equations */
+    for(i = 0; i < TCXO_TRACK_BINS; i++)
+    {
+        if(!t->bins[i].probes)
+            continue;
+        x = i + TCXO_TRACK_MIN_DEG + 0.5 - 25.0;
+        w = t->bins[i].probes;
+        for(j = 0; j < n; j++)
+        {
+            for(k = 0; k < n; k++)
+                a[j][k] += w * pow(x, j + k);
+            a[j][n] += w * pow(x, j) * t->bins[i].offsetHz;
+        }
+    }
+
+    /* Gauss-Jordan elimination with partial pivoting */
+    for(j = 0; j < n; j++)
+    {
+        for(i = j + 1, k = j; i < n; i++)
+        {
+            if(fabs(a[i][j]) > fabs(a[k][j]))
+                k = i;
+        }
+        for(i = 0; i <= n; i++)
+        {
+            f = a[j][i];
+            a[j][i] = a[k][i];
+            a[k][i] = f;
+        }
+        if(fabs(a[j][j]) < 1e-12)
+            return;
+        for(i = 0; i < n; i++)
+        {
+            if(i == j)
+                continue;
+            f = a[i][j] / a[j][j];
+            for(k = j; k <= n; k++)
+                a[i][k] -= f * a[j][k];
+        }
+    }
+    for(j = 0; j < n; j++)
+        t->coeff[j] = a[j][n] / a[j][j];
+}
+
+static void load_model(struct st_tcxoTrack *t)
+{
+    FILE *fp;
+    char line[128];
+    double celsius;
+    double offset;
+    unsigned int probes;
+
+    if(!t->params->modelFile || !(fp = fopen(t->params->modelFile, "r")))
+        return;
+    while(fgets(line, sizeof(line), fp))
+    {
+        if(line[0] == '#' || sscanf(line, "%lf %lf %u", &celsius, &offset, &probes) != 3)
+            continue;
+        t->bins[bin_of(celsius)].offsetHz = offset;
+        t->bins[bin_of(celsius)].probes = probes;
+    }
+    fclose(fp);
+    fit_model(t);
+}
+
+static void save_model(const struct st_tcxoTrack *t)
+{
+    FILE *fp;
+    int i;
+
+    if(!t->params->modelFile)
+        return;
+    if(!(fp = fopen(t->params->modelFile, "w")))
+    {
+        printf("ERROR: could not write model \"%s\"\n", t->params->modelFile);
+        return;
+    }
+    fprintf(fp, "# temperature [degrees Celsius], tcxoFreq offset [Hz], probes\n");
+    for(i = 0; i < TCXO_TRACK_BINS; i++)
+    {
+        if(t->bins[i].probes)
+            fprintf(fp, "%d %.1f %u\n", i + TCXO_TRACK_MIN_DEG, t->bins[i].offsetHz, (unsigned int)t->bins[i].probes);
+    }
+    fclose(fp);
+}
+
+static int apply_offset(struct st_tcxoTrack *t, int32_t offset)
+{
+    struct st_configHAT cfg = t->base;
+    int i;
+
+    for(i = 0; i < NUM_RCV; i++)
+        cfg.rcv[i].tcxoFreq = (uint32_t)((int64_t)t->base.rcv[i].tcxoFreq + offset);
+    if(hat_config(t->fd, &cfg) != 0)
+    {
+        printf("ERROR: configuring HAT failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* starts a probe dwell at the given offset, the statistics are taken after the receivers settled */
+static int probe_start(struct st_tcxoTrack *t, int32_t offset, int state)
+{
+    if(apply_offset(t, offset) != 0)
+        return -1;
+    sleep_until_ns(time_now_ns() + CALIB_SETTLE_MS * 1000000ULL);
+    if(hat_get_statistics(t->fd, &t->probeStart) != 0)
+        return -1;
+    t->probeStartNs = time_now_ns();
+    t->stateEnd = t->probeStartNs + (uint64_t)t->params->probeDwellSec * 1000000000ULL;
+    t->state = state;
+    return 0;
+}
+
+/* score of the finished dwell (see calib.h), -1 if there was too little traffic */
+static int probe_score(struct st_tcxoTrack *t, double *score)
+{
+    struct st_statistics s;
+    uint64_t payload;
+    uint64_t crc;
+    double dt;
+
+    if(hat_get_statistics(t->fd, &s) != 0 || s.totalRxPayloadBytes < t->probeStart.totalRxPayloadBytes)
+        return -1;
+    dt = (double)(time_now_ns() - t->probeStartNs) / 1e9;
+    payload = s.totalRxPayloadBytes - t->probeStart.totalRxPayloadBytes;
+    crc = (s.payloadCrcErrors - t->probeStart.payloadCrcErrors) + (s.headerCrcErrors - t->probeStart.headerCrcErrors);
+    if(payload < TCXO_TRACK_PROBE_MIN_BYTES)
+        return -1;
+    *score = (payload - CALIB_CRC_PENALTY * (double)crc) / dt;
+    return 0;
+}
+
+static void probe_finish(struct st_tcxoTrack *t, double celsius)
+{
+    struct st_tcxoBin *bin = &t->bins[t->probeBin];
+    double plus = t->probeScore;
+    double minus;
+    const char *result;
+
+    t->state = STATE_IDLE;
+    t->nextProbe = time_now_ns() + TCXO_TRACK_PROBE_PERIOD_SEC * 1000000000ULL;
+    if(probe_score(t, &minus) != 0 || apply_offset(t, t->applied) != 0)
+    {
+        log_stamp();
+        printf("probe discarded, too little traffic\n");
+        apply_offset(t, t->applied);
+        return;
+    }
+    if(bin_of(celsius) != t->probeBin)
+    {
+        log_stamp();
+        printf("probe discarded, temperature changed\n");
+        return;
+    }
+
+    /* a new bin starts at the current prediction */
+    if(!bin->probes)
+        bin->offsetHz = t->applied;
+    if(plus > minus * (1.0 + TCXO_TRACK_PROBE_MARGIN) && plus > minus)
+    {
+        bin->offsetHz += TCXO_TRACK_PROBE_HZ / 2.0;
+        result = "higher";
+    }
+    else if(minus > plus * (1.0 + TCXO_TRACK_PROBE_MARGIN) && minus > plus)
+    {
+        bin->offsetHz -= TCXO_TRACK_PROBE_HZ / 2.0;
+        result = "lower";
+    }
+    else
+        result = "centered";
+    if(bin->probes < TCXO_TRACK_MAX_PROBES)
+        bin->probes++;
+
+    fit_model(t);
+    save_model(t);
+    log_stamp();
+    printf("probe at %.2f degrees: score %+d Hz %.1f, %+d Hz %.1f -> %s, bin offset %.1f Hz (%u probes)\n",
+           celsius, (int)(t->applied + TCXO_TRACK_PROBE_HZ), plus, (int)(t->applied - TCXO_TRACK_PROBE_HZ), minus,
+           result, bin->offsetHz, (unsigned int)bin->probes);
+}
+
+int run_tcxo_track(int fd, const struct st_tcxoTrackParams *params)
+{
+    static struct st_tcxoTrack t;
+    struct st_tempSensor sensor;
+    struct st_info info;
+    uint64_t interval;
+    uint64_t deadline;
+    uint64_t now;
+    double celsius;
+    double filtered = 0;
+    bool haveTemp = false;
+    int32_t predicted;
+
+    if(params->probeDwellSec == 0)
+    {
+        printf("ERROR: probe dwell time must be greater than 0\n");
+        return -1;
+    }
+
+    memset(&t, 0, sizeof(t));
+    t.fd = fd;
+    t.params = params;
+    if(params->configFile)
+    {
+        if(config_load(params->configFile, &t.base) != 0)
+            return -1;
+    }
+    else
+    {
+        if(hat_get_info(fd, &info) != 0 || !info.valid)
+        {
+            printf("ERROR: could not read the configuration of the HAT\n");
+            return -1;
+        }
+        config_from_info(&info, &t.base);
+    }
+    if(temp_open(&sensor, params->sensor) != 0)
+        return -1;
+    load_model(&t);
+
+    stop_on_signal();
+    printf("tracking tcxoFreq %u Hz, threshold %u Hz, probing +-%d Hz for %u s every %d s\n",
+           (unsigned int)t.base.rcv[0].tcxoFreq, params->thresholdHz, TCXO_TRACK_PROBE_HZ,
+           params->probeDwellSec, TCXO_TRACK_PROBE_PERIOD_SEC);
+    fflush(stdout);
+
+    /* start with the base configuration, the first prediction corrects it */
+    if(apply_offset(&t, 0) != 0)
+    {
+        temp_close(&sensor);
+        return -1;
+    }
+    interval = TCXO_TRACK_INTERVAL_MS * 1000000ULL;
+    deadline = time_now_ns();
+    t.nextProbe = deadline;
+
+    while(!stopRequested)
+    {
+        now = time_now_ns();
+        if(temp_read(&sensor, &celsius) == 0)
+        {
+            filtered = haveTemp ? filtered + 0.3 * (celsius - filtered) : celsius;
+            haveTemp = true;
+        }
+        else
+            printf("ERROR: reading temperature failed\n");
+
+        if(haveTemp && t.state == STATE_IDLE)
+        {
+            predicted = (int32_t)lround(predict(&t, filtered));
+            if(abs(predicted - t.applied) >= (int)params->thresholdHz && apply_offset(&t, predicted) == 0)
+            {
+                log_stamp();
+                printf("%.2f degrees: tcxoFreq offset %+d Hz -> %+d Hz\n", filtered, (int)t.applied, (int)predicted);
+                t.applied = predicted;
+            }
+            if(now >= t.nextProbe)
+            {
+                t.probeBin = bin_of(filtered);
+                if(probe_start(&t, t.applied + TCXO_TRACK_PROBE_HZ, STATE_PROBE_PLUS) != 0)
+                {
+                    t.state = STATE_IDLE;
+                    t.nextProbe = now + TCXO_TRACK_PROBE_PERIOD_SEC * 1000000000ULL;
+                    apply_offset(&t, t.applied);
+                }
+            }
+        }
+        else if(t.state == STATE_PROBE_PLUS && now >= t.stateEnd)
+        {
+            if(probe_score(&t, &t.probeScore) != 0 ||
+               probe_start(&t, t.applied - TCXO_TRACK_PROBE_HZ, STATE_PROBE_MINUS) != 0)
+            {
+                log_stamp();
+                printf("probe discarded, too little traffic\n");
+                t.state = STATE_IDLE;
+                t.nextProbe = now + TCXO_TRACK_PROBE_PERIOD_SEC * 1000000000ULL;
+                apply_offset(&t, t.applied);
+            }
+        }
+        else if(t.state == STATE_PROBE_MINUS && now >= t.stateEnd)
+            probe_finish(&t, filtered);
+        fflush(stdout);
+
+        deadline += interval;
+        if(t.state != STATE_IDLE && t.stateEnd < deadline)
+            deadline = t.stateEnd;
+        if(deadline < time_now_ns())
+            deadline = time_now_ns() + interval;
+        sleep_until_ns(deadline);
+    }
+
+    /* leave the HAT with the compensated configuration */
+    if(t.state != STATE_IDLE)
+        apply_offset(&t, t.applied);
+    temp_close(&sensor);
+    return 0;
+}
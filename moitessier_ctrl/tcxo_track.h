@@ -0,0 +1,55 @@
+/*
+    Temperature compensated TCXO tracking of the Moitessier HAT control
+    program.
+
+    The TCXO drifts with the board temperature. The tracker learns the best
+    tcxoFreq offset per 1 degree Celsius temperature bin by probing: now and
+    then the offset is moved by +-TCXO_TRACK_PROBE_HZ for one dwell each and
+    the bin estimate moves towards the side with the better reception score
+    (see calib.h). A polynomial fitted over all learned bins predicts the
+    offset for the current temperature, tcxoFreq is only pushed to the HAT
+    if the prediction moves more than a threshold away from the applied value.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef TCXO_TRACK_H
+#define TCXO_TRACK_H
+
+#include <stdint.h>
+
+#define TCXO_TRACK_INTERVAL_MS      10000   /* temperature sampling */
+#define TCXO_TRACK_MIN_DEG          (-40)   /* temperature bins */
+#define TCXO_TRACK_BINS             126
+#define TCXO_TRACK_PROBE_HZ         20      /* probing offset around the applied value */
+#define TCXO_TRACK_PROBE_PERIOD_SEC 1800    /* time between two probes */
+#define TCXO_TRACK_PROBE_MIN_BYTES  2000    /* minimum payload per probe dwell for a valid comparison */
+#define TCXO_TRACK_PROBE_MARGIN     0.05    /* relative score difference considered significant */
+#define TCXO_TRACK_MAX_PROBES       10      /* weight limit of a bin, so old bins keep adapting */
+
+struct st_tcxoTrackParams{
+    const char  *configFile;        /* base configuration, NULL for the one the HAT is running */
+    const char  *sensor;            /* see temp.h */
+    uint32_t    thresholdHz;
+    uint32_t    probeDwellSec;
+    const char  *modelFile;         /* learned bins are loaded from and saved to this file, may be NULL */
+};
+
+/* runs until SIGINT/SIGTERM is received */
+int run_tcxo_track(int fd, const struct st_tcxoTrackParams *params);
+
+#endif /* TCXO_TRACK_H */
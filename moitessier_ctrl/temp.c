@@ -0,0 +1,204 @@
+/*
+    Board temperature for the Moitessier HAT control program (see temp.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include "moitessier_ctrl.h"
+#include "temp.h"
+
+/* see sensors/Si7020-A20.c and sensors/MS5607-02BA03.c, we must not use clock stretching commands */
+#define SI7020_I2C_ADDR             0x40
+#define SI7020_CMD_MEAS_TEMP        0xF3
+#define SI7020_TIMEOUT_MS           100     /* conversion takes up to 10.8 ms */
+
+#define MS5607_I2C_ADDR             0x77
+#define MS5607_CMD_D2_OSR_4096      0x58
+#define MS5607_CMD_READ_ADC         0x00
+#define MS5607_CMD_READ_PROM        0xA0
+#define MS5607_CONV_US              9040    /* maximum conversion time at OSR 4096 */
+
+/* CRC-4 of the PROM coefficients (MS5607 application note AN520) */
+static uint8_t ms5607_crc4(const uint16_t *prom)
+{
+    uint16_t rem = 0;
+    uint16_t word;
+    int cnt;
+    int bit;
+
+    for(cnt = 0; cnt < 16; cnt++)
+    {
+        word = (cnt >> 1 == 7) ? (prom[7] & 0xFF00) : prom[cnt >> 1];
+        rem ^= (cnt & 1) ? (word & 0x00FF) : (word >> 8);
+        for(bit = 8; bit > 0; bit--)
+            rem = (rem & 0x8000) ? (rem << 1) ^ 0x3000 : (rem << 1);
+    }
+    return (rem >> 12) & 0x0F;
+}
+
+static int ms5607_open(struct st_tempSensor *sensor)
+{
+    uint8_t cmd;
+    uint8_t buf[2];
+    int i;
+
+    for(i = 0; i < 8; i++)
+    {
+        cmd = MS5607_CMD_READ_PROM + i * 2;
+        if(write(sensor->fd, &cmd, 1) != 1 || read(sensor->fd, buf, 2) != 2)
+            return -1;
+        sensor->prom[i] = (buf[0] << 8) | buf[1];
+    }
+    if(ms5607_crc4(sensor->prom) != (sensor->prom[7] & 0x0F))
+    {
+        printf("ERROR: MS5607 PROM CRC invalid\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int ms5607_read(struct st_tempSensor *sensor, double *celsius)
+{
+    uint8_t cmd = MS5607_CMD_D2_OSR_4096;
+    uint8_t buf[3];
+    uint32_t d2;
+    int64_t dT;
+    int64_t temp;
+
+    if(write(sensor->fd, &cmd, 1) != 1)
+        return -1;
+    usleep(MS5607_CONV_US);
+    cmd = MS5607_CMD_READ_ADC;
+    if(write(sensor->fd, &cmd, 1) != 1 || read(sensor->fd, buf, 3) != 3)
+        return -1;
+    d2 = ((uint32_t)buf[0] << 16) | ((uint32_t)buf[1] << 8) | buf[2];
+
+    /* compensation of the datasheet, TEMP in 0.01 degrees Celsius, second order below 20 degrees */
+    dT = (int64_t)d2 - ((int64_t)sensor->prom[5] << 8);
+    temp = 2000 + ((dT * sensor->prom[6]) >> 23);
+    if(temp < 2000)
+        temp -= (dT * dT) >> 31;
+    *celsius = temp / 100.0;
+    return 0;
+}
+
+static int si7020_read(struct st_tempSensor *sensor, double *celsius)
+{
+    uint8_t cmd = SI7020_CMD_MEAS_TEMP;
+    uint8_t buf[2];
+    uint64_t deadline;
+
+    if(write(sensor->fd, &cmd, 1) != 1)
+        return -1;
+
+    /* the sensor NACKs reads until the conversion has finished */
+    deadline = time_now_ns() + SI7020_TIMEOUT_MS * 1000000ULL;
+    while(read(sensor->fd, buf, 2) != 2)
+    {
+        if(time_now_ns() > deadline)
+            return -1;
+        usleep(1000);
+    }
+    *celsius = 175.72 * ((buf[0] << 8) | buf[1]) / 65536.0 - 46.85;
+    return 0;
+}
+
+static int thermal_read(struct st_tempSensor *sensor, double *celsius)
+{
+    char buf[32];
+    ssize_t n;
+
+    n = pread(sensor->fd, buf, sizeof(buf) - 1, 0);
+    if(n <= 0)
+        return -1;
+    buf[n] = '\0';
+    *celsius = atof(buf) / 1000.0;
+    return 0;
+}
+
+int temp_open(struct st_tempSensor *sensor, const char *spec)
+{
+    const char *path = strchr(spec, ':');
+    int addr;
+
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->fd = -1;
+    if(path == NULL)
+    {
+        printf("ERROR: invalid temperature sensor \"%s\"\n", spec);
+        return -1;
+    }
+    if(!strncmp(spec, "si7020:", 7))
+        sensor->type = TEMP_SI7020;
+    else if(!strncmp(spec, "ms5607:", 7))
+        sensor->type = TEMP_MS5607;
+    else if(!strncmp(spec, "thermal:", 8))
+        sensor->type = TEMP_THERMAL;
+    else
+    {
+        printf("ERROR: invalid temperature sensor \"%s\"\n", spec);
+        return -1;
+    }
+    snprintf(sensor->path, sizeof(sensor->path), "%s", path + 1);
+
+    sensor->fd = open(sensor->path, (sensor->type == TEMP_THERMAL) ? O_RDONLY : O_RDWR);
+    if(sensor->fd < 0)
+    {
+        printf("ERROR: could not open \"%s\": %s\n", sensor->path, strerror(errno));
+        return -1;
+    }
+    if(sensor->type == TEMP_THERMAL)
+        return 0;
+
+    addr = (sensor->type == TEMP_SI7020) ? SI7020_I2C_ADDR : MS5607_I2C_ADDR;
+    if(ioctl(sensor->fd, I2C_SLAVE, addr) < 0 ||
+       (sensor->type == TEMP_MS5607 && ms5607_open(sensor) != 0))
+    {
+        printf("ERROR: could not access the temperature sensor on \"%s\"\n", sensor->path);
+        temp_close(sensor);
+        return -1;
+    }
+    return 0;
+}
+
+int temp_read(struct st_tempSensor *sensor, double *celsius)
+{
+    switch(sensor->type)
+    {
+        case TEMP_SI7020:
+            return si7020_read(sensor, celsius);
+        case TEMP_MS5607:
+            return ms5607_read(sensor, celsius);
+        default:
+            return thermal_read(sensor, celsius);
+    }
+}
+
+void temp_close(struct st_tempSensor *sensor)
+{
+    if(sensor->fd >= 0)
+        close(sensor->fd);
+    sensor->fd = -1;
+}
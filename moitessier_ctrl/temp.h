@@ -0,0 +1,52 @@
+/*
+    Board temperature for the Moitessier HAT control program.
+
+    The temperature is read from one of the sensors on the HAT or from a
+    thermal zone of the Raspberry Pi:
+
+        si7020:<I2C_BUS>        Si7020-A20, e.g. "si7020:/dev/i2c-1"
+        ms5607:<I2C_BUS>        MS5607-02BA03 (temperature only)
+        thermal:<PATH>          file containing milli degrees Celsius, e.g.
+                                "thermal:/sys/class/thermal/thermal_zone0/temp"
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef TEMP_H
+#define TEMP_H
+
+#include <stdint.h>
+
+#define TEMP_DEFAULT_SENSOR         "si7020:/dev/i2c-1"
+
+#define TEMP_SI7020                 0
+#define TEMP_MS5607                 1
+#define TEMP_THERMAL                2
+
+struct st_tempSensor{
+    int         type;
+    int         fd;
+    char        path[256];
+    uint16_t    prom[8];        /* calibration coefficients of the MS5607 */
+};
+
+/* returns 0 on success, -1 on error */
+int temp_open(struct st_tempSensor *sensor, const char *spec);
+int temp_read(struct st_tempSensor *sensor, double *celsius);
+void temp_close(struct st_tempSensor *sensor);
+
+#endif /* TEMP_H */
@@ -0,0 +1,131 @@
+/*
+    Hot reload of the configuration of the Moitessier HAT control program
+    (see watch.h).
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include "moitessier_ctrl.h"
+#include "config.h"
+#include "watch.h"
+
+/* loads and validates the file, pushes it if it differs from applied */
+static void reload(int fd, const char *fileName, struct st_configHAT *applied)
+{
+    struct st_configHAT configHAT;
+    uint64_t start = time_now_ns();
+    int diffs;
+
+    if(config_load(fileName, &configHAT) != 0 || config_validate(&configHAT) != 0)
+    {
+        printf("configuration rejected, keeping the one applied last\n");
+        return;
+    }
+
+    diffs = config_compare(applied, &configHAT, true);
+    if(diffs == 0)
+    {
+        printf("configuration unchanged, not pushed\n");
+        return;
+    }
+    if(hat_config(fd, &configHAT) != 0)
+    {
+        printf("ERROR: configuring HAT failed\n");
+        return;
+    }
+    *applied = configHAT;
+    printf("configuration applied, %d field(s) changed, %.3f ms\n", diffs, (time_now_ns() - start) / 1e6);
+}
+
+int run_config_watch(int fd, const char *fileName)
+{
+    struct st_configHAT applied;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char dir[PATH_MAX];
+    const struct inotify_event *ev;
+    const char *base;
+    struct pollfd pfd;
+    bool changed;
+    ssize_t n;
+    ssize_t pos;
+    int ifd;
+
+    if(config_load(fileName, &applied) != 0 || config_validate(&applied) != 0 ||
+       config_push(fd, &applied, false) < 0)
+        return -1;
+
+    /* Editors usually write a new file and rename it, so the directory is
+       watched and the events are filtered by name. */
+    base = strrchr(fileName, '/');
+    if(base == fileName)
+        strcpy(dir, "/");
+    else if(base)
+        snprintf(dir, sizeof(dir), "%.*s", (int)(base - fileName), fileName);
+    if(base)
+        base++;
+    else
+    {
+        strcpy(dir, ".");
+        base = fileName;
+    }
+
+    ifd = inotify_init1(IN_CLOEXEC);
+    if(ifd < 0 || inotify_add_watch(ifd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        printf("ERROR: could not watch \"%s\": %s\n", dir, strerror(errno));
+        if(ifd >= 0)
+            close(ifd);
+        return -1;
+    }
+
+    stop_on_signal();
+    printf("watching \"%s\"\n", fileName);
+    fflush(stdout);
+
+    pfd.fd = ifd;
+    pfd.events = POLLIN;
+    while(!stopRequested)
+    {
+        if(poll(&pfd, 1, -1) <= 0)
+            continue;
+        n = read(ifd, events, sizeof(events));
+        if(n <= 0)
+            continue;
+
+        /* several events of one save are handled with a single reload */
+        changed = false;
+        for(pos = 0; pos < n; pos += sizeof(struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event*)(events + pos);
+            if(ev->len && !strcmp(ev->name, base))
+                changed = true;
+        }
+        if(changed)
+            reload(fd, fileName, &applied);
+        fflush(stdout);
+    }
+
+    close(ifd);
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+    Hot reload of the configuration of the Moitessier HAT control program.
+
+    Copyright (C) 2018  Thomas POMS <hwsw.development@gmail.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Applies the configuration file (config.xml or blob) and watches it with
+   inotify until SIGINT/SIGTERM is received. The file is only parsed when it
+   was written or replaced, an invalid file is rejected and the HAT keeps the
+   configuration applied last, an unchanged one is not pushed. */
+int run_config_watch(int fd, const char *fileName);
+
+#endif /* WATCH_H */
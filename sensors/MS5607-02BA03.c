@@ -36,6 +36,15 @@
     
     Running with specified iterations:
     ./MS5607-02BA03 /dev/i2c-1 <ITERATIONS> <HUMAN_READABLE>
+    
+    Continuous sampling as fast as possible with OSR 256, e.g. for wave and
+    gust pressure analysis (stop with CTRL+C, the sample rate and jitter
+    are printed at the end):
+    ./MS5607-02BA03 /dev/i2c-1 0 1 0 256 0
+    
+    Compensating measurements logged with <DEBUG_ENABLE> again, the raw
+    values and PROM coefficients are taken from each line:
+    ./MS5607-02BA03 - <ITERATIONS> <HUMAN_READABLE> < log.txt
 */
 
 #include <stdio.h>
@@ -49,6 +58,8 @@
 #include <math.h>
 #include <stdlib.h>
 #include <inttypes.h>
+#include <signal.h>
+#include <time.h>
 
 #define I2C_ADDR                    0x77                /* slave address of the sensor */
 //#define I2C_BUS                     "/dev/i2c-1"        /* I2C bus where the sensor is connected to */
@@ -56,30 +67,94 @@ char* I2C_BUS;
 
 /* sensor commands */
 /* YOU MUST NOT USE CLOCK STRETCHING COMMANDS ON THE RASPBERRY PI */
-#define CMD_D1_OSR_4096             0x48                /* convert digital pressure value */
-#define CMD_D2_OSR_4096             0x58                /* convert digital temperature value */
+#define CMD_D1_OSR_256              0x40                /* convert digital pressure value */
+#define CMD_D1_OSR_512              0x42
+#define CMD_D1_OSR_1024             0x44
+#define CMD_D1_OSR_2048             0x46
+#define CMD_D1_OSR_4096             0x48
+#define CMD_D2_OSR_256              0x50                /* convert digital temperature value */
+#define CMD_D2_OSR_512              0x52
+#define CMD_D2_OSR_1024             0x54
+#define CMD_D2_OSR_2048             0x56
+#define CMD_D2_OSR_4096             0x58
 #define CMD_READ_ADC                0x00
 #define CMD_READ_PROM               0xA0
 
-/* measure temperature */
-int readPressure(int fd, uint16_t *prom, double *pressure, double *temp, uint32_t *d_D1, uint32_t *d_D2, int32_t *d_dT, int64_t *d_OFF, int64_t *d_SENS)
+#define DEFAULT_OSR                 4096
+#define DEFAULT_INTERVAL            1000                /* time between measurements [ms] */
+#define BATCH_SIZE                  1024                /* measurements compensated at once when reprocessing a log */
+
+/* oversampling ratios, a higher one reduces the noise but takes longer */
+struct st_osr
 {
-    uint8_t cmd;
-    uint32_t D1 = 0, D2 = 0;
-    double P, T;
-    int64_t OFF, SENS;
-    int32_t dT;
-    uint8_t buf[4];
+    uint16_t osr;
+    uint8_t cmdD1;
+    uint8_t cmdD2;
+    uint16_t convTime;                                  /* maximum conversion time of the datasheet [us] */
+};
+
+static const struct st_osr osrList[] =
+{
+    {256,   CMD_D1_OSR_256,     CMD_D2_OSR_256,     600},
+    {512,   CMD_D1_OSR_512,     CMD_D2_OSR_512,     1170},
+    {1024,  CMD_D1_OSR_1024,    CMD_D2_OSR_1024,    2280},
+    {2048,  CMD_D1_OSR_2048,    CMD_D2_OSR_2048,    4540},
+    {4096,  CMD_D1_OSR_4096,    CMD_D2_OSR_4096,    9040}
+};
+
+/* sample rate and jitter of the measurements */
+struct st_timing
+{
+    uint32_t samples;
+    uint32_t late;                                      /* measurements started after their scheduled time */
+    struct timespec last;
+    double sum;                                         /* sum of the intervals [s] */
+    double sumSq;                                       /* sum of the squared intervals */
+    double min;
+    double max;
+};
+
+/* compensated measurement */
+struct st_measurement
+{
+    int32_t dT;                                         /* difference between actual and reference temperature */
+    int32_t TEMP;                                       /* actual temperature [0.01 °C] */
+    int64_t OFF;                                        /* offset at actual temperature */
+    int64_t SENS;                                       /* sensitivity at actual temperature */
+    int32_t P;                                          /* temperature compensated pressure [0.01 mbar] */
+};
+
+static volatile sig_atomic_t terminate = 0;
+
+static void signalHandler(int sig)
+{
+    terminate = 1;
+}
+
+/* returns the oversampling ratio osr, NULL if not supported */
+const struct st_osr* getOSR(int osr)
+{
+    uint8_t i;
+    
+    for(i = 0; i < sizeof(osrList) / sizeof(osrList[0]); i++)
+    {
+        if(osrList[i].osr == osr)
+            return &osrList[i];
+    }
+    return NULL;
+}
+
+/* starts a conversion and reads its result */
+int readADC(int fd, uint8_t cmd, uint16_t convTime, uint32_t *value)
+{
+    uint8_t buf[3];
     
-    /* initiate a pressure conversion */    
-    cmd = CMD_D1_OSR_4096;
     if(write(fd, &cmd, 1) == -1)
         return -1;
     
-    /* we need to wait till conversion has finished */    
-    usleep(10 * 10000);
+    /* we need to wait till conversion has finished */
+    usleep(convTime);
     
-    /* read measurement result */
     cmd = CMD_READ_ADC;
     if(write(fd, &cmd, 1) == -1)
         return -1;
@@ -87,50 +162,139 @@ int readPressure(int fd, uint16_t *prom, double *pressure, double *temp, uint32_
     if(read(fd, buf, 3) != 3)
         return -1;
     
-    D1 = buf[0] * 65536;
-	D1 += buf[1] * 256;
-	D1 += buf[2];
+    *value = ((uint32_t)buf[0] << 16) | ((uint32_t)buf[1] << 8) | buf[2];
     
-	/* initiate a temperature conversion */
-    cmd = CMD_D2_OSR_4096;
-    if(write(fd, &cmd, 1) == -1)
+    /* the sensor returns 0 if the conversion has not finished yet */
+    if(*value == 0)
         return -1;
- 
- 
-    /* we need to wait till conversion has finished */    
-    usleep(10 * 10000);
     
-    cmd = CMD_READ_ADC;
-    if(write(fd, &cmd, 1) == -1)
-        return -1;
-  
-    if(read(fd, buf, 3) != 3)
-        return -1;
+    return 0;
+}
+
+/* 
+    Integer compensation of the datasheet including the second order
+    temperature compensation. Divisions by powers of 2 are arithmetic shifts
+    like in the datasheet. There are no branches and every product is a 32 x 32
+    bit one with a 64 bit result, so loops over it can be vectorized. D1 * SENS
+    needs more than 32 bits of SENS, it is split at bit 21 which gives the same
+    result as the 64 bit product shifted by 21.
+*/
+static inline void compensate(const uint16_t *prom, uint32_t D1, uint32_t D2, struct st_measurement *m)
+{
+    int32_t dT, TEMP;
+    int32_t t, u;
+    int64_t OFF, SENS;
+    int64_t T2, OFF2, SENS2;
+    int64_t low, veryLow;
+    
+    /* first order */
+    dT = (int32_t)D2 - ((int32_t)prom[5] << 8);
+    TEMP = 2000 + (int32_t)(((int64_t)dT * (int32_t)prom[6]) >> 23);
+    OFF = ((int64_t)prom[2] << 17) + (((int64_t)dT * (int32_t)prom[4]) >> 6);
+    SENS = ((int64_t)prom[1] << 16) + (((int64_t)dT * (int32_t)prom[3]) >> 7);
+    
+    /* second order, below 20 °C and additionally below -15 °C */
+    t = (TEMP < 2000) ? TEMP - 2000 : 0;
+    u = (TEMP < -1500) ? TEMP + 1500 : 0;
+    low = (int64_t)t * t;
+    veryLow = (int64_t)u * u;
+    T2 = (TEMP < 2000) ? ((int64_t)dT * dT) >> 31 : 0;
+    OFF2 = ((61 * low) >> 4) + 15 * veryLow;
+    SENS2 = 2 * low + 8 * veryLow;
+    
+    OFF -= OFF2;
+    SENS -= SENS2;
+    m->dT = dT;
+    m->TEMP = TEMP - T2;
+    m->OFF = OFF;
+    m->SENS = SENS;
+    m->P = (((int64_t)D1 * (int32_t)(SENS >> 21) + (((uint64_t)D1 * (uint32_t)(SENS & 0x1FFFFF)) >> 21)) - OFF) >> 15;
+}
+
+/* compensates n raw measurements, e.g. logged ones, TEMP in 0.01 °C and P in 0.01 mbar */
+void compensateBatch(const uint16_t *prom, const uint32_t *D1, const uint32_t *D2, int32_t *TEMP, int32_t *P, size_t n)
+{
+    struct st_measurement m;
+    size_t i;
+    
+    for(i = 0; i < n; i++)
+    {
+        compensate(prom, D1[i], D2[i], &m);
+        TEMP[i] = m.TEMP;
+        P[i] = m.P;
+    }
+}
+
+/* measure pressure and temperature */
+int readPressure(int fd, uint16_t *prom, const struct st_osr *osr, double *pressure, double *temp, uint32_t *d_D1, uint32_t *d_D2, int32_t *d_dT, int64_t *d_OFF, int64_t *d_SENS)
+{
+    uint32_t D1 = 0, D2 = 0;
+    struct st_measurement m;
     
-    D2 = buf[0] * 65536;
-	D2 += buf[1] * 256;
-	D2 += buf[2];
+    /* pressure conversion */
+    if(readADC(fd, osr->cmdD1, osr->convTime, &D1) != 0)
+        return -1;
     
-    /* calculate temperature */
-    dT = D2 - prom[5] * pow(2,8);
-    T = (2000 + dT * (double)prom[6] / pow(2,23)) / 100;
-    *temp = T;
+    /* temperature conversion */
+    if(readADC(fd, osr->cmdD2, osr->convTime, &D2) != 0)
+        return -1;
     
-    /* calculate temperature compensated pressure */
-    OFF = prom[2] * pow(2,17) + dT * (double)prom[4] / pow(2,6);
-    SENS = prom[1] * pow(2,16) + dT * (double)prom[3] / pow(2,7);
-    P = ((D1 * SENS / pow(2,21) - OFF) / pow(2,15)) / 100;
-    *pressure = P;
+    compensate(prom, D1, D2, &m);
+    *temp = m.TEMP / 100.0;
+    *pressure = m.P / 100.0;
     
-    *d_dT = dT;
+    *d_dT = m.dT;
     *d_D1 = D1;
     *d_D2 = D2;
-    *d_OFF = OFF;
-    *d_SENS = SENS;
+    *d_OFF = m.OFF;
+    *d_SENS = m.SENS;
        
     return 0;
 }
 
+static double timespecDiff(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+/* adds the start time of a measurement */
+void addTiming(struct st_timing *timing, const struct timespec *t)
+{
+    double interval;
+    
+    if(timing->samples++ == 0)
+    {
+        timing->last = *t;
+        return;
+    }
+    
+    interval = timespecDiff(t, &timing->last);
+    timing->last = *t;
+    timing->sum += interval;
+    timing->sumSq += interval * interval;
+    if(timing->samples == 2 || interval < timing->min)
+        timing->min = interval;
+    if(timing->samples == 2 || interval > timing->max)
+        timing->max = interval;
+}
+
+/* prints the achieved sample rate and the jitter of the sampling interval */
+void printTiming(FILE *stream, const struct st_timing *timing)
+{
+    uint32_t n = timing->samples - 1;
+    double mean;
+    double var;
+    
+    if(n == 0)
+        return;
+    
+    mean = timing->sum / n;
+    var = timing->sumSq / n - mean * mean;
+    fprintf(stream, "%u samples in %.3f s, %.2f Hz, interval %.3f ms (min %.3f ms, max %.3f ms, jitter %.3f ms rms), %u late\n",
+            timing->samples, timing->sum, n / timing->sum, mean * 1000, timing->min * 1000, timing->max * 1000,
+            (var > 0) ? sqrt(var) * 1000 : 0, timing->late);
+}
+
 /* calculate the CRC of the PROM coefficients */
 uint8_t MS5607_crc4(uint16_t *n_prom) 
 { 
@@ -198,6 +362,81 @@ int readPROM(int fd, uint16_t *prom, uint8_t promSize)
     return 0;
 }
 
+static void printBatch(const uint16_t *prom, const uint32_t *D1, const uint32_t *D2, size_t n, int humanReadable)
+{
+    static int32_t TEMP[BATCH_SIZE];
+    static int32_t P[BATCH_SIZE];
+    size_t i;
+    
+    compensateBatch(prom, D1, D2, TEMP, P, n);
+    for(i = 0; i < n; i++)
+    {
+        if(humanReadable)
+            printf("%.2f mbar, %0.2f °C\n", P[i] / 100.0, TEMP[i] / 100.0);
+        else
+            printf("%.2f,%0.2f\n", P[i] / 100.0, TEMP[i] / 100.0);
+    }
+}
+
+/* 
+    Compensates the lines logged with <DEBUG_ENABLE> read from stdin again,
+    at most iterations lines if iterations is greater than 0. A line ends with
+    D1,D2,dT,OFF,SENS and the 8 PROM coefficients, lines without them or with
+    an invalid PROM CRC are skipped.
+*/
+int reprocess(int iterations, int humanReadable)
+{
+    static uint32_t D1[BATCH_SIZE];
+    static uint32_t D2[BATCH_SIZE];
+    uint16_t prom[8];
+    uint16_t batchProm[8];
+    char line[512];
+    char *field[32];
+    char *s;
+    size_t n = 0;
+    int lines = 0;
+    int skipped = 0;
+    int i;
+    int k;
+    
+    while((iterations == 0 || lines < iterations) && fgets(line, sizeof(line), stdin))
+    {
+        lines++;
+        for(k = 0, s = strtok(line, ","); s && k < 32; s = strtok(NULL, ","))
+            field[k++] = s;
+        if(k < 13)
+        {
+            skipped++;
+            continue;
+        }
+        
+        for(i = 0; i < 8; i++)
+            prom[i] = strtoul(field[k - 8 + i], NULL, 10);
+        if(MS5607_crc4(prom) != (prom[7] & 0xF))
+        {
+            skipped++;
+            continue;
+        }
+        
+        /* a batch is compensated with the coefficients of one sensor */
+        if(n == BATCH_SIZE || (n > 0 && memcmp(prom, batchProm, sizeof(prom))))
+        {
+            printBatch(batchProm, D1, D2, n, humanReadable);
+            n = 0;
+        }
+        memcpy(batchProm, prom, sizeof(prom));
+        D1[n] = strtoul(field[k - 13], NULL, 10);
+        D2[n] = strtoul(field[k - 12], NULL, 10);
+        n++;
+    }
+    if(n > 0)
+        printBatch(batchProm, D1, D2, n, humanReadable);
+    
+    if(skipped && humanReadable)
+        fprintf(stderr, "%d of %d lines skipped.\n", skipped, lines);
+    return 0;
+}
+
 int main (int argc,char** argv)
 {
 	int fd;
@@ -214,14 +453,22 @@ int main (int argc,char** argv)
     int64_t d_SENS;
     int64_t d_OFF;
     int32_t d_dT;
+    const struct st_osr *osr = getOSR(DEFAULT_OSR);
+    int interval = DEFAULT_INTERVAL;
+    struct st_timing timing;
+    struct timespec next;
+    struct timespec now;
      
     if(argc < 2)
     {
         printf("Missing parameter.\n");
-        printf("Usage: %s <I2C_BUS> <ITERATIONS> <HUMAN_READABLE>\n", argv[0]);
-        printf("       <ITERATIONS> is optional, must be greater than 0. Default = 1\n");
+        printf("Usage: %s <I2C_BUS> <ITERATIONS> <HUMAN_READABLE> <DEBUG_ENABLE> <OSR> <INTERVAL>\n", argv[0]);
+        printf("       <I2C_BUS> - compensates the lines logged with <DEBUG_ENABLE> read from stdin again\n");
+        printf("       <ITERATIONS> is optional, 0...endless (stop with CTRL+C), > 0 iterations. Default = 1\n");
         printf("       <HUMAN_READABLE> is optional, 1...human readable output, else 0. Default = 1\n");
         printf("       <DEBUG_ENABLE> is optional, 1...debugging enabled, else 0. Default = 0\n");
+        printf("       <OSR> is optional, oversampling ratio 256, 512, 1024, 2048 or 4096. Default = %u\n", DEFAULT_OSR);
+        printf("       <INTERVAL> is optional, time between measurements [ms], 0...continuous. Default = %u\n", DEFAULT_INTERVAL);
         return 1;
     }
     
@@ -237,10 +484,35 @@ int main (int argc,char** argv)
         humanReadable = atoi(argv[3]);
     }
     
-    if(argc == 5)
+    if(argc >= 5)
     {
         debugEnabled = atoi(argv[4]);
     }
+    
+    if(argc >= 6)
+    {
+        osr = getOSR(atoi(argv[5]));
+        if(!osr)
+        {
+            if(humanReadable)
+                printf("Invalid OSR %s.\n", argv[5]);
+            return 1;
+        }
+    }
+    
+    if(argc >= 7)
+    {
+        interval = atoi(argv[6]);
+        if(interval < 0)
+        {
+            if(humanReadable)
+                printf("Invalid interval %s.\n", argv[6]);
+            return 1;
+        }
+    }
+    
+	if(!strcmp(I2C_BUS, "-"))
+	    return reprocess(iterations, humanReadable);
         
 	fd = open(I2C_BUS, O_RDWR);
 
@@ -272,12 +544,26 @@ int main (int argc,char** argv)
         return 1;
 	}
 	
-	while(argc < 2 || (argc >= 2 && cycles < iterations))
+	
+	/* finish the running measurement and print the sample rate when stopped */
+	signal(SIGINT, signalHandler);
+	signal(SIGTERM, signalHandler);
+	
+	memset(&timing, 0, sizeof(timing));
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	
+	while(!terminate && (iterations == 0 || cycles < iterations))
     {
         cycles++;
         
-        if(readPressure(fd, prom, &pressure, &temp, &d_D1, &d_D2, &d_dT, &d_OFF, &d_SENS) != 0)
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        addTiming(&timing, &now);
+        
+        if(readPressure(fd, prom, osr, &pressure, &temp, &d_D1, &d_D2, &d_dT, &d_OFF, &d_SENS) != 0)
         {
+            /* a conversion interrupted by CTRL+C */
+            if(terminate)
+                break;
             if(humanReadable)
 		        printf("Measuring pressure failed.\n");
             return 1;
@@ -292,8 +578,30 @@ int main (int argc,char** argv)
 		}
 		else
 		    printf("%.2f,%0.2f\n", pressure, temp);
-        sleep(1);
+        
+        if(interval == 0 || (iterations != 0 && cycles >= iterations))
+            continue;
+        
+        /* the measurements are scheduled at fixed times, so the rate does not drift with the conversion time */
+        next.tv_sec += interval / 1000;
+        next.tv_nsec += (interval % 1000) * 1000000L;
+        if(next.tv_nsec >= 1000000000L)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000L;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(timespecDiff(&next, &now) < 0)
+        {
+            timing.late++;
+            next = now;
+        }
+        else
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
     }
+    
+	if(cycles > 1)
+	    printTiming((humanReadable) ? stdout : stderr, &timing);
 
 	return 0;
 }